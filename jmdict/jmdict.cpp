@@ -6,9 +6,97 @@
  * ---------------------------------------------------------------- */
 
 #include "jmdict.h"
+#include "jmdict_client.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <unordered_set>
 
 namespace kuu
 {
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+// JMdict sequence numbers span about two million numbers. The
+// limit keeps a corrupted sequence number from allocating the
+// whole 32-bit range.
+const quint32 MAX_SEQUENCE_NUMBER_SPAN = 1u << 26;
+
+// Maximum edit distance of the approximate reading search and the
+// reading length from which the larger distance is used.
+const int FUZZY_DISTANCE = 2;
+const int FUZZY_LONG_READING = 4;
+// Minimum length of a text searched by approximate reading. Almost
+// every reading is within the distance of a one character text.
+const int FUZZY_MIN_READING = 2;
+// Maximum count of entries of the approximate reading search.
+const size_t FUZZY_ENTRIES = 100;
+
+// Maximum count of forms of the pattern search.
+const size_t PATTERN_FORMS = 500;
+
+// Revision of the latest built word index of any dictionary.
+std::atomic<quint32> latestWordIndexRevision(0);
+
+/* ---------------------------------------------------------------- *
+   Adds the entry index to the index of word. The indices are kept
+   in ascending order. An entry can have the same form more than
+   once.
+ * ---------------------------------------------------------------- */
+void addToIndex(QHash<QString, std::vector<qint32>>& index,
+                const QString& word,
+                qint32 entryIndex)
+{
+    std::vector<qint32>& indices = index[word];
+    if (indices.empty() || indices.back() < entryIndex)
+    {
+        indices.push_back(entryIndex);
+        return;
+    }
+
+    auto it = std::lower_bound(indices.begin(), indices.end(), entryIndex);
+    if (*it != entryIndex)
+        indices.insert(it, entryIndex);
+}
+
+/* ---------------------------------------------------------------- *
+   Removes the entry index from the index of word. A word without
+   entries is removed from the index.
+ * ---------------------------------------------------------------- */
+void removeFromIndex(QHash<QString, std::vector<qint32>>& index,
+                     const QString& word,
+                     qint32 entryIndex)
+{
+    auto it = index.find(word);
+    if (it == index.end())
+        return;
+
+    std::vector<qint32>& indices = it.value();
+    auto i = std::lower_bound(indices.begin(), indices.end(), entryIndex);
+    if (i != indices.end() && *i == entryIndex)
+        indices.erase(i);
+    if (indices.empty())
+        index.erase(it);
+}
+
+/* ---------------------------------------------------------------- *
+   Raises the maximum form lengths to the length of the form.
+ * ---------------------------------------------------------------- */
+void addLength(JMdict& dict, const QString& form)
+{
+    if (form.isEmpty())
+        return;
+    const int length = std::min(form.size(), 0xFFFF);
+    quint16& byFirst = dict.maxWordLengthByFirst[form[0].unicode()];
+    byFirst = std::max(byFirst, quint16(length));
+    dict.maxWordLength = std::max(dict.maxWordLength, length);
+}
+
+} // anonymous namespace
 
 /* ---------------------------------------------------------------- *
    Implementation of JMdict streaming operator..
@@ -17,6 +105,8 @@ QDebug operator<<(QDebug debug, const JMdict& dict)
 {
     QDebugStateSaver saver(debug);
     debug << "JMdict";
+    for (const JMdict::Tag& tag : dict.tags)
+        debug << "\nJMdict::Tag" << tag.name << tag.description;
     for (const JMdict::Entry& entry : dict.entries)
         debug << entry;
 
@@ -36,7 +126,7 @@ QDebug operator<<(QDebug debug, const JMdict::Entry& dictEntry)
     for (const JMdict::Kanji& kanji : dictEntry.kanjis)
     {
         debug << "\n\t\tWord or phrase:" << kanji.wordOrPhrase;
-        for (const QString& info : kanji.info)
+        for (const JMdict::TagId info : kanji.info)
             debug << "\n\t\t\tInfo:" << info;
         for (const QString& priority : kanji.priorities)
             debug << "\n\t\t\tPriority:" << priority;
@@ -55,7 +145,7 @@ QDebug operator<<(QDebug debug, const JMdict::Entry& dictEntry)
     debug << "\n\tSenses";
     for (const JMdict::Sense& sense : dictEntry.senses)
     {
-        for (const QString& partOfSpeech : sense.partOfSpeeches)
+        for (const JMdict::TagId partOfSpeech : sense.partOfSpeeches)
             debug << "\n\t\tPart-of-spheech:" << partOfSpeech;
         for (const QString& gloss : sense.glosses)
             debug << "\n\t\tGloss:" << gloss;
@@ -68,15 +158,15 @@ QDebug operator<<(QDebug debug, const JMdict::Entry& dictEntry)
                   << loadWordSource.descFullOrPartial;
             debug << "\n\t\t\tWasei:" << loadWordSource.wasei;
         }
-        for (const QString& fieldOfApplication
+        for (const JMdict::TagId fieldOfApplication
              : sense.fieldOfApplications)
         {
             debug << "\n\t\tField Of Application:"
                   << fieldOfApplication;
         }
-        for (const QString& misc : sense.misc)
+        for (const JMdict::TagId misc : sense.misc)
             debug << "\n\t\tMisc:" << misc;
-        for (const QString& dialect : sense.dialect)
+        for (const JMdict::TagId dialect : sense.dialect)
             debug << "\n\t\tDialect:" << dialect;
         for (const QString& info : sense.infos)
             debug << "\n\t\tInfo:" << info;
@@ -86,23 +176,360 @@ QDebug operator<<(QDebug debug, const JMdict::Entry& dictEntry)
 }
 
 /* ---------------------------------------------------------------- *
-   Search entries containing the text.
+   Implementation of JMdict::Kanji comparison operator.
+ * ---------------------------------------------------------------- */
+bool operator==(const JMdict::Kanji& a, const JMdict::Kanji& b)
+{
+    return a.wordOrPhrase == b.wordOrPhrase &&
+           a.info         == b.info &&
+           a.priorities   == b.priorities;
+}
+
+/* ---------------------------------------------------------------- *
+   Implementation of JMdict::Reading comparison operator.
+ * ---------------------------------------------------------------- */
+bool operator==(const JMdict::Reading& a, const JMdict::Reading& b)
+{
+    return a.wordOrPhrase == b.wordOrPhrase &&
+           a.noKanji      == b.noKanji &&
+           a.restriction  == b.restriction &&
+           a.info         == b.info &&
+           a.priorities   == b.priorities;
+}
+
+/* ---------------------------------------------------------------- *
+   Implementation of JMdict::LoadWordSource comparison operator.
+ * ---------------------------------------------------------------- */
+bool operator==(const JMdict::LoadWordSource& a,
+                const JMdict::LoadWordSource& b)
+{
+    return a.source            == b.source &&
+           a.descFullOrPartial == b.descFullOrPartial &&
+           a.wasei             == b.wasei;
+}
+
+/* ---------------------------------------------------------------- *
+   Implementation of JMdict::Sense comparison operator.
+ * ---------------------------------------------------------------- */
+bool operator==(const JMdict::Sense& a, const JMdict::Sense& b)
+{
+    return a.partOfSpeeches      == b.partOfSpeeches &&
+           a.glosses             == b.glosses &&
+           a.loanwordSources     == b.loanwordSources &&
+           a.fieldOfApplications == b.fieldOfApplications &&
+           a.misc                == b.misc &&
+           a.dialect             == b.dialect &&
+           a.infos               == b.infos;
+}
+
+/* ---------------------------------------------------------------- *
+   Implementation of JMdict::Entry comparison operators.
+ * ---------------------------------------------------------------- */
+bool operator==(const JMdict::Entry& a, const JMdict::Entry& b)
+{
+    return a.sequenceNumber == b.sequenceNumber &&
+           a.kanjis         == b.kanjis &&
+           a.readings       == b.readings &&
+           a.senses         == b.senses;
+}
+
+bool operator!=(const JMdict::Entry& a, const JMdict::Entry& b)
+{ return !(a == b); }
+
+/* ---------------------------------------------------------------- *
+   Builds the lookup table from sequence numbers into entries.
+ * ---------------------------------------------------------------- */
+void JMdict::buildSequenceNumberIndex()
+{
+    firstSequenceNumber = 0;
+    sequenceNumberIndex.clear();
+    if (entries.empty())
+        return;
+
+    quint32 min = entries.front().sequenceNumber;
+    quint32 max = min;
+    for (const Entry& e : entries)
+    {
+        min = std::min(min, e.sequenceNumber);
+        max = std::max(max, e.sequenceNumber);
+    }
+
+    if (max - min >= MAX_SEQUENCE_NUMBER_SPAN)
+        throw std::runtime_error("Sequence numbers are too sparse");
+
+    firstSequenceNumber = min;
+    sequenceNumberIndex.assign(size_t(max - min) + 1, -1);
+    for (size_t i = 0; i < entries.size(); ++i)
+        sequenceNumberIndex[entries[i].sequenceNumber - min] = qint32(i);
+}
+
+/* ---------------------------------------------------------------- *
+   Grows the lookup table to cover the sequence numbers. The table
+   is checked before it is changed.
+ * ---------------------------------------------------------------- */
+void JMdict::reserveSequenceNumbers(quint32 first, quint32 last)
+{
+    if (!sequenceNumberIndex.empty())
+    {
+        first = std::min(first, firstSequenceNumber);
+        last  = std::max(last, firstSequenceNumber +
+                               quint32(sequenceNumberIndex.size()) - 1);
+    }
+    if (last - first >= MAX_SEQUENCE_NUMBER_SPAN)
+        throw std::runtime_error("Sequence numbers are too sparse");
+
+    if (sequenceNumberIndex.empty())
+        firstSequenceNumber = first;
+    if (first < firstSequenceNumber)
+    {
+        sequenceNumberIndex.insert(sequenceNumberIndex.begin(),
+                                   size_t(firstSequenceNumber - first), -1);
+        firstSequenceNumber = first;
+    }
+    sequenceNumberIndex.resize(size_t(last - first) + 1, -1);
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the index of the entry with the sequence number.
+ * ---------------------------------------------------------------- */
+int JMdict::indexOfSequenceNumber(quint32 sequenceNumber) const
+{
+    if (sequenceNumber < firstSequenceNumber)
+        return -1;
+
+    const quint32 offset = sequenceNumber - firstSequenceNumber;
+    if (offset >= sequenceNumberIndex.size())
+        return -1;
+
+    return sequenceNumberIndex[offset];
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the entry with the sequence number.
+ * ---------------------------------------------------------------- */
+const JMdict::Entry* JMdict::findBySequenceNumber(
+    quint32 sequenceNumber) const
+{
+    const int index = indexOfSequenceNumber(sequenceNumber);
+    if (index < 0)
+        return nullptr;
+    return &entries[size_t(index)];
+}
+
+/* ---------------------------------------------------------------- *
+   Builds the indexes from kanji and reading forms into entries.
+ * ---------------------------------------------------------------- */
+void JMdict::buildWordIndex()
+{
+    kanjiIndex.clear();
+    readingIndex.clear();
+    maxWordLength = 0;
+    maxWordLengthByFirst.assign(0x10000, 0);
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        const Entry& e = entries[i];
+        for (const Kanji& kanji : e.kanjis)
+        {
+            addToIndex(kanjiIndex, kanji.wordOrPhrase, qint32(i));
+            addLength(*this, kanji.wordOrPhrase);
+        }
+        for (const Reading& reading : e.readings)
+        {
+            addToIndex(readingIndex, reading.wordOrPhrase, qint32(i));
+            addLength(*this, reading.wordOrPhrase);
+        }
+    }
+
+    std::vector<QString> readings;
+    readings.reserve(size_t(readingIndex.size()));
+    for (auto it = readingIndex.constBegin();
+         it != readingIndex.constEnd();
+         ++it)
+    {
+        readings.push_back(it.key());
+    }
+    std::vector<QString> forms = readings;
+    for (auto it = kanjiIndex.constBegin(); it != kanjiIndex.constEnd(); ++it)
+        forms.push_back(it.key());
+    formIndex = JMdictFormIndex(std::move(forms));
+    readingTrie = JMdictReadingTrie(std::move(readings));
+
+    wordIndexRevision = ++latestWordIndexRevision;
+}
+
+/* ---------------------------------------------------------------- *
+   Adds the entry at the index into the sequence number and word
+   indexes.
+ * ---------------------------------------------------------------- */
+void JMdict::addToIndexes(qint32 index)
+{
+    const Entry& e = entries[size_t(index)];
+    reserveSequenceNumbers(e.sequenceNumber, e.sequenceNumber);
+    sequenceNumberIndex[e.sequenceNumber - firstSequenceNumber] = index;
+
+    if (maxWordLengthByFirst.empty())
+        maxWordLengthByFirst.assign(0x10000, 0);
+    for (const Kanji& kanji : e.kanjis)
+    {
+        addToIndex(kanjiIndex, kanji.wordOrPhrase, index);
+        addLength(*this, kanji.wordOrPhrase);
+        formIndex.insert(kanji.wordOrPhrase);
+    }
+    for (const Reading& reading : e.readings)
+    {
+        addToIndex(readingIndex, reading.wordOrPhrase, index);
+        addLength(*this, reading.wordOrPhrase);
+        formIndex.insert(reading.wordOrPhrase);
+        readingTrie.insert(reading.wordOrPhrase);
+    }
+
+    wordIndexRevision = ++latestWordIndexRevision;
+}
+
+/* ---------------------------------------------------------------- *
+   Removes the entry at the index from the sequence number and word
+   indexes. A form without entries is removed from the form index.
+   The form lengths and the reading trie keep the forms, the
+   searches skip the forms without entries.
+ * ---------------------------------------------------------------- */
+void JMdict::removeFromIndexes(qint32 index)
+{
+    const Entry& e = entries[size_t(index)];
+    if (indexOfSequenceNumber(e.sequenceNumber) == index)
+        sequenceNumberIndex[e.sequenceNumber - firstSequenceNumber] = -1;
+
+    for (const Kanji& kanji : e.kanjis)
+        removeFromIndex(kanjiIndex, kanji.wordOrPhrase, index);
+    for (const Reading& reading : e.readings)
+        removeFromIndex(readingIndex, reading.wordOrPhrase, index);
+
+    auto removeForm = [this](const QString& form)
+    {
+        if (!kanjiIndex.contains(form) && !readingIndex.contains(form))
+            formIndex.remove(form);
+    };
+    for (const Kanji& kanji : e.kanjis)
+        removeForm(kanji.wordOrPhrase);
+    for (const Reading& reading : e.readings)
+        removeForm(reading.wordOrPhrase);
+
+    wordIndexRevision = ++latestWordIndexRevision;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the length of the longest form starting at position.
+ * ---------------------------------------------------------------- */
+int JMdict::longestMatch(const QString& text,
+                         int position,
+                         std::vector<qint32>* entryIndices) const
+{
+    int maxLength = std::min(maxWordLength, text.size() - position);
+    if (!maxWordLengthByFirst.empty() && maxLength > 0)
+        maxLength = std::min(maxLength,
+            int(maxWordLengthByFirst[text[position].unicode()]));
+
+    if (client)
+        return maxLength > 0
+            ? client->longestMatch(text.mid(position, maxLength),
+                                   entryIndices)
+            : 0;
+
+    // The candidate forms refer to the text without copying it.
+    for (int length = maxLength; length > 0; --length)
+    {
+        const QString word = QString::fromRawData(
+            text.constData() + position, length);
+        auto kanji   = kanjiIndex.constFind(word);
+        auto reading = readingIndex.constFind(word);
+        const bool hasKanji   = kanji   != kanjiIndex.constEnd();
+        const bool hasReading = reading != readingIndex.constEnd();
+        if (!hasKanji && !hasReading)
+            continue;
+
+        if (entryIndices)
+        {
+            entryIndices->clear();
+            if (hasKanji)
+                *entryIndices = kanji.value();
+            if (hasReading)
+            {
+                entryIndices->insert(entryIndices->end(),
+                                     reading.value().begin(),
+                                     reading.value().end());
+                std::sort(entryIndices->begin(), entryIndices->end());
+                entryIndices->erase(
+                    std::unique(entryIndices->begin(),
+                                entryIndices->end()),
+                    entryIndices->end());
+            }
+        }
+        return length;
+    }
+    return 0;
+}
+
+/* ---------------------------------------------------------------- *
+   Splits the text into the longest forms.
+ * ---------------------------------------------------------------- */
+std::vector<JMdict::Token> JMdict::tokenize(const QString& text,
+                                            bool withEntries) const
+{
+    if (client)
+        return client->tokenize(text, withEntries);
+
+    std::vector<Token> tokens;
+    int position = 0;
+    while (position < text.size())
+    {
+        Token token;
+        token.length = longestMatch(text, position,
+                                    withEntries ? &token.entries : nullptr);
+        if (token.length == 0)
+        {
+            ++position;
+            continue;
+        }
+
+        token.position = position;
+        position += token.length;
+        tokens.push_back(std::move(token));
+    }
+    return tokens;
+}
+
+/* ---------------------------------------------------------------- *
+   Search entries containing the text. Uses the reading index if
+   it has been built.
  * ---------------------------------------------------------------- */
 std::vector<JMdict::Entry> JMdict::searchByReading(
-    const QString& text)
+    const QString& text) const
 {
+    if (client)
+        return client->searchByReading(text);
+
     std::vector<Entry> matches;
-    std::copy_if(
-        entries.begin(),
-        entries.end(),
-        std::back_inserter(matches),
-        [text](const Entry& e)
-    {
-        for(const Reading& reading : e.readings)
-            if (reading.wordOrPhrase == text)
-                return true;
-        return false;
-    });
+    if (!readingIndex.isEmpty())
+    {
+        auto it = readingIndex.constFind(text);
+        if (it != readingIndex.constEnd())
+            for (const qint32 index : it.value())
+                matches.push_back(entries[size_t(index)]);
+    }
+    else
+    {
+        std::copy_if(
+            entries.begin(),
+            entries.end(),
+            std::back_inserter(matches),
+            [text](const Entry& e)
+        {
+            for(const Reading& reading : e.readings)
+                if (reading.wordOrPhrase == text)
+                    return true;
+            return false;
+        });
+    }
 
     std::sort(
         matches.begin(),
@@ -120,4 +547,160 @@ std::vector<JMdict::Entry> JMdict::searchByReading(
     return matches;
 }
 
+/* ---------------------------------------------------------------- *
+   Search entries by approximate reading. The reading trie gives
+   the readings within the distance, an entry is ranked by its
+   closest reading.
+ * ---------------------------------------------------------------- */
+std::vector<JMdict::Entry> JMdict::searchByReadingFuzzy(
+    const QString& text) const
+{
+    if (text.size() < FUZZY_MIN_READING)
+        return std::vector<Entry>();
+    if (client)
+        return client->searchByReadingFuzzy(text);
+
+    const int maxDistance =
+        text.size() >= FUZZY_LONG_READING ? FUZZY_DISTANCE : 1;
+
+    struct Candidate
+    {
+        int distance;
+        int priorities;
+        qint32 index;
+    };
+    std::vector<Candidate> candidates;
+    for (const JMdictReadingTrie::Match& match :
+             readingTrie.search(text, maxDistance))
+    {
+        for (const qint32 index : readingIndex.value(match.reading))
+        {
+            int priorities = 0;
+            for (const Reading& reading : entries[size_t(index)].readings)
+                if (reading.wordOrPhrase == match.reading)
+                    priorities = std::max(priorities,
+                                          int(reading.priorities.size()));
+            candidates.push_back({ match.distance, priorities, index });
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate& a, const Candidate& b)
+    {
+        if (a.distance != b.distance)
+            return a.distance < b.distance;
+        if (a.priorities != b.priorities)
+            return a.priorities > b.priorities;
+        return a.index < b.index;
+    });
+
+    std::unordered_set<qint32> added;
+    std::vector<Entry> matches;
+    for (const Candidate& candidate : candidates)
+    {
+        if (matches.size() == FUZZY_ENTRIES)
+            break;
+        if (!added.insert(candidate.index).second)
+            continue;
+        matches.push_back(entries[size_t(candidate.index)]);
+    }
+    return matches;
+}
+
+/* ---------------------------------------------------------------- *
+   Search entries by a pattern of the kanji and reading forms.
+ * ---------------------------------------------------------------- */
+std::vector<JMdict::Entry> JMdict::searchByPattern(
+    const QString& pattern) const
+{
+    if (client)
+        return client->searchByPattern(pattern);
+
+    std::vector<qint32> indices;
+    for (const QString& form : formIndex.search(pattern, PATTERN_FORMS))
+    {
+        for (const qint32 index : kanjiIndex.value(form))
+            indices.push_back(index);
+        for (const qint32 index : readingIndex.value(form))
+            indices.push_back(index);
+    }
+
+    std::unordered_set<qint32> added;
+    std::vector<Entry> matches;
+    for (const qint32 index : indices)
+    {
+        if (!added.insert(index).second)
+            continue;
+        matches.push_back(entries[size_t(index)]);
+    }
+    return matches;
+}
+
+/* ---------------------------------------------------------------- *
+   Search entries by their glosses.
+ * ---------------------------------------------------------------- */
+std::vector<JMdict::Entry> JMdict::searchByGloss(const QString& text,
+                                                 bool startsWith,
+                                                 bool endsWith) const
+{
+    if (client)
+        return client->searchByGloss(text, startsWith, endsWith);
+
+    std::vector<Entry> matches;
+    for (const Entry& e : entries)
+    {
+        bool match = false;
+        for (const Sense& sense : e.senses)
+        {
+            for (const QString& gloss : sense.glosses)
+            {
+                if (startsWith && !gloss.startsWith(text))
+                    continue;
+                if (endsWith && !gloss.endsWith(text))
+                    continue;
+                if (!startsWith && !endsWith && gloss != text)
+                    continue;
+
+                match = true;
+                break;
+            }
+            if (match)
+                break;
+        }
+        if (match)
+            matches.push_back(e);
+    }
+    return matches;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the entry at the index.
+ * ---------------------------------------------------------------- */
+JMdict::EntryPtr JMdict::entry(qint32 index) const
+{
+    if (client)
+        return client->entry(index);
+    // The local entry is not owned by the pointer.
+    return EntryPtr(EntryPtr(), &entries[size_t(index)]);
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the indices of the entries of the kanji form.
+ * ---------------------------------------------------------------- */
+std::vector<qint32> JMdict::kanjiEntries(const QString& word) const
+{
+    if (client)
+        return client->kanjiEntries(word);
+    return kanjiIndex.value(word);
+}
+
+/* ---------------------------------------------------------------- *
+   Attaches the dictionary to the dictionary server.
+ * ---------------------------------------------------------------- */
+void JMdict::attach(std::shared_ptr<JMdictClient> client)
+{
+    this->client = client;
+    wordIndexRevision = ++latestWordIndexRevision;
+}
+
 } // namespace kuu
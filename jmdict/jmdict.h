@@ -10,16 +10,37 @@
 #include <memory>
 #include <vector>
 #include <QtCore/QDebug>
+#include <QtCore/QHash>
 #include <QtCore/QString>
+#include "jmdict_form_index.h"
+#include "jmdict_reading_trie.h"
 
 namespace kuu
 {
 
+class JMdictClient;
+
 /* ---------------------------------------------------------------- *
    The JM dictionary.
  * ---------------------------------------------------------------- */
 struct JMdict
 {    
+    // Identifies an entity tag of the dictionary. Coded fields such
+    // as part-of-speech, field of application and misc information
+    // are stored as tag IDs that index the tags vector.
+    using TagId = quint16;
+
+    // Defines an entity tag. The tags are read from the entity
+    // declarations of the DTD.
+    struct Tag
+    {
+        // Entity name, e.g. "v5k".
+        QString name;
+
+        // Entity description, e.g. "Godan verb with `ku' ending".
+        QString description;
+    };
+
     // Defines a kanji element. Most of the entries have a single
     // kanji element.
     struct Kanji
@@ -29,7 +50,7 @@ struct JMdict
 
        // A coded information field related specifically to the
        // orthography of the word/phrase
-       std::vector<QString> info;
+       std::vector<TagId> info;
 
        // Relative priorities. The value can be:
        // - news1/2: appears in the "wordfreq" file
@@ -95,7 +116,7 @@ struct JMdict
         // multiple senses in an entry, the part-of-speech of an
         // earlier sense will apply to later senses unless there is
         // a new part-of-speech indicated.
-        std::vector<QString> partOfSpeeches;
+        std::vector<TagId> partOfSpeeches;
 
         // Target-language words or phrases which are equivalents to
         // the Japanese word. This element would normally be present,
@@ -109,17 +130,17 @@ struct JMdict
         // Information about the field of application of the entry /
         // sense. When absent, general application is implied.
         // Entity coding for specific fields of application.
-        std::vector<QString> fieldOfApplications;
+        std::vector<TagId> fieldOfApplications;
 
         // This is used for other relevant information about
         // the entry/sense. As with part-of-speech, information will
         // usually apply to several senses.
-        std::vector<QString> misc;
+        std::vector<TagId> misc;
 
         // For words specifically associated with regional dialects
         // in Japanese, the entity code for that dialect, e.g. ksb
         // for Kansaiben.
-        std::vector<QString> dialect;
+        std::vector<TagId> dialect;
 
         // Additional information to be recorded about a sense.
         // Typical usage would be to indicate such things as level
@@ -131,7 +152,7 @@ struct JMdict
     struct Entry
     {
         // A unique numeric sequence number for each entry
-        QString sequenceNumber;
+        quint32 sequenceNumber = 0;
 
         // Kanjis and its readings
         std::vector<Kanji> kanjis;
@@ -144,8 +165,124 @@ struct JMdict
     // Entries
     std::vector<Entry> entries;
 
+    // Entity tags, indexed by tag ID.
+    std::vector<Tag> tags;
+
+    // Builds the lookup table from sequence numbers into entries.
+    // Call this after entries have been added or removed. Throws
+    // std::runtime_error if the sequence numbers are too sparse
+    // for the dense table.
+    void buildSequenceNumberIndex();
+
+    // Grows the lookup table from sequence numbers into entries to
+    // cover the sequence numbers from first to last. Throws
+    // std::runtime_error if the table would be too sparse.
+    void reserveSequenceNumbers(quint32 first, quint32 last);
+
+    // Returns the index of the entry with the sequence number or
+    // -1 if there is no such entry.
+    int indexOfSequenceNumber(quint32 sequenceNumber) const;
+    // Returns the entry with the sequence number or nullptr if
+    // there is no such entry.
+    const Entry* findBySequenceNumber(quint32 sequenceNumber) const;
+
+    // Dense lookup table from sequence numbers into entry indices,
+    // starting from the smallest sequence number. Missing sequence
+    // numbers are -1.
+    quint32 firstSequenceNumber = 0;
+    std::vector<qint32> sequenceNumberIndex;
+
+    // Builds the indexes from kanji and reading forms into entries.
+    // Call this after entries have been added or removed.
+    void buildWordIndex();
+
+    // Patch the sequence number and word indexes for a single entry
+    // instead of building them again. Call addToIndexes() after the
+    // entry has been stored at the index and removeFromIndexes()
+    // before it is removed or replaced. The form lengths are only
+    // raised so they are upper bounds after a removal.
+    void addToIndexes(qint32 index);
+    void removeFromIndexes(qint32 index);
+
+    // Returns the length of the longest kanji or reading form that
+    // starts at the position of the text, or 0 if there is no such
+    // form. The indices of the matching entries are stored into
+    // entryIndices if it is not nullptr.
+    int longestMatch(const QString& text,
+                     int position,
+                     std::vector<qint32>* entryIndices = nullptr) const;
+
+    // A dictionary word of a text.
+    struct Token
+    {
+        int position = 0;             // position in the text
+        int length   = 0;             // length of the word
+        std::vector<qint32> entries;  // indices of the entries
+    };
+
+    // Splits the text into the longest forms from the start. The
+    // characters that do not start a form are skipped. The indices
+    // of the entries of the words are stored if withEntries is set.
+    // An attached dictionary tokenizes the text with one request.
+    std::vector<Token> tokenize(const QString& text,
+                                bool withEntries = false) const;
+
+    // Indexes from kanji and reading forms into entry indices. The
+    // indices are in entry order.
+    QHash<QString, std::vector<qint32>> kanjiIndex;
+    QHash<QString, std::vector<qint32>> readingIndex;
+    // Length of the longest indexed form.
+    int maxWordLength = 0;
+    // Length of the longest indexed form by the first UTF-16 code
+    // unit of the form. Zero if no form starts with the code unit.
+    std::vector<quint16> maxWordLengthByFirst;
+    // N-gram index of the kanji and reading forms for the pattern
+    // search.
+    JMdictFormIndex formIndex;
+    // Trie of the reading forms for the approximate search.
+    JMdictReadingTrie readingTrie;
+    // Changes each time the word indexes are built. Lets the caches
+    // of lookup results to notice a changed dictionary.
+    quint32 wordIndexRevision = 0;
+
     // Search entries containing the text.
-    std::vector<Entry> searchByReading(const QString& text);
+    std::vector<Entry> searchByReading(const QString& text) const;
+    // Search entries that have a reading within a small edit
+    // distance of the text. The distance is 1 for short texts and 2
+    // for longer ones. The entries are ordered by the distance and
+    // then by the priorities of the reading. Nothing is searched for
+    // an empty or one character text.
+    std::vector<Entry> searchByReadingFuzzy(const QString& text) const;
+    // Search entries that have a kanji or reading form matching the
+    // pattern. '?' matches one character and '*' any run of
+    // characters. The entries of the shortest forms come first.
+    std::vector<Entry> searchByPattern(const QString& pattern) const;
+    // Search entries that have a gloss matching the text. The gloss
+    // equals the text unless it is matched by the start and/or the
+    // end of the gloss.
+    std::vector<Entry> searchByGloss(const QString& text,
+                                     bool startsWith,
+                                     bool endsWith) const;
+
+    // Shared pointer of an entry. The entry of the dictionary
+    // server stays valid while the pointer is held even if the
+    // client evicts it from its cache.
+    using EntryPtr = std::shared_ptr<const Entry>;
+
+    // Returns the entry at the index.
+    EntryPtr entry(qint32 index) const;
+    // Returns the indices of the entries that have the word as a
+    // kanji form.
+    std::vector<qint32> kanjiEntries(const QString& word) const;
+
+    // Attaches the dictionary to a dictionary server. The entries and
+    // the word indexes stay in the server process and the lookups
+    // are forwarded to the server. Only the tags and the form lengths
+    // are held locally.
+    void attach(std::shared_ptr<JMdictClient> client);
+    // Client of the dictionary server or nullptr if the dictionary
+    // is local.
+    std::shared_ptr<JMdictClient> client;
 };
 
 /* ---------------------------------------------------------------- *
@@ -154,6 +291,18 @@ struct JMdict
 QDebug operator<<(QDebug debug, const JMdict& dict);
 QDebug operator<<(QDebug debug, const JMdict::Entry& dictEntry);
 
+/* ---------------------------------------------------------------- *
+   Defines comparison operators. The tag IDs are compared as is so
+   the compared entries need to share the tags.
+ * ---------------------------------------------------------------- */
+bool operator==(const JMdict::Kanji& a, const JMdict::Kanji& b);
+bool operator==(const JMdict::Reading& a, const JMdict::Reading& b);
+bool operator==(const JMdict::LoadWordSource& a,
+                const JMdict::LoadWordSource& b);
+bool operator==(const JMdict::Sense& a, const JMdict::Sense& b);
+bool operator==(const JMdict::Entry& a, const JMdict::Entry& b);
+bool operator!=(const JMdict::Entry& a, const JMdict::Entry& b);
+
 /* ---------------------------------------------------------------- *
    Declares a shared pointer of JMdict struct.
  * ---------------------------------------------------------------- */
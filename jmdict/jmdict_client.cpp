@@ -0,0 +1,506 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::JMdictClient class.
+ * ---------------------------------------------------------------- */
+
+#include "jmdict_client.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QThread>
+#include <QtNetwork/QLocalSocket>
+#include "jmdict_protocol.h"
+
+namespace kuu
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+// Time in milliseconds to wait for the server to connect and to
+// answer. The local lookups are answered in microseconds.
+const int CONNECT_TIMEOUT = 1000;
+const int REPLY_TIMEOUT   = 30000;
+// Time in milliseconds that a call from the GUI thread waits for
+// the reply before falling back to an empty result.
+const int GUI_REPLY_TIMEOUT = 200;
+// Count of the client threads and so the count of the calls that
+// the server can serve at the same time.
+const int CLIENT_THREADS = 4;
+// Maximum count of cached entries.
+const size_t CACHE_SIZE = 20000;
+
+using jmdict_protocol::Request;
+
+/* ---------------------------------------------------------------- *
+   Starts the request payload with the request code.
+ * ---------------------------------------------------------------- */
+void startRequest(QDataStream& stream, Request request)
+{
+    stream.setVersion(jmdict_protocol::STREAM_VERSION);
+    stream << quint8(request);
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if the caller is in the GUI thread.
+ * ---------------------------------------------------------------- */
+bool isGuiThread()
+{
+    const QCoreApplication* app = QCoreApplication::instance();
+    return app && app->thread() == QThread::currentThread();
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Private data of the client.
+ * ---------------------------------------------------------------- */
+struct JMdictClient::Impl
+{
+    // A request and its reply. A call that is no longer waited
+    // for is finished and dropped by the client thread.
+    struct Call
+    {
+        QByteArray payload;
+        QByteArray reply;
+        bool done = false;
+    };
+    using CallPtr = std::shared_ptr<Call>;
+
+    // Serves the calls in a client thread.
+    void run()
+    {
+        QLocalSocket socket;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            condition.wait(lock, [&]() { return !calls.empty() || stopped; });
+            if (stopped)
+                return;
+
+            CallPtr call = calls.front();
+            calls.pop_front();
+            lock.unlock();
+            const QByteArray replyPayload = exchange(socket, call->payload);
+            lock.lock();
+
+            call->reply = replyPayload;
+            call->done  = true;
+            replied.notify_all();
+        }
+    }
+
+    // Writes the request and reads the reply. Connects the socket
+    // if it is not connected.
+    QByteArray exchange(QLocalSocket& socket, const QByteArray& payload)
+    {
+        if (socket.state() != QLocalSocket::ConnectedState)
+        {
+            socket.abort();
+            socket.connectToServer(serverName);
+            if (!socket.waitForConnected(CONNECT_TIMEOUT))
+                return QByteArray();
+        }
+
+        socket.write(jmdict_protocol::frame(payload));
+        while (socket.bytesToWrite() > 0)
+            if (!socket.waitForBytesWritten(REPLY_TIMEOUT))
+            {
+                socket.abort();
+                return QByteArray();
+            }
+
+        QByteArray buffer;
+        QByteArray replyPayload;
+        for (;;)
+        {
+            const jmdict_protocol::Frame status = jmdict_protocol::takeFrame(
+                buffer, replyPayload, jmdict_protocol::MAX_REPLY_SIZE);
+            if (status == jmdict_protocol::Frame::Taken)
+                return replyPayload;
+            if (status == jmdict_protocol::Frame::TooLarge ||
+                !socket.waitForReadyRead(REPLY_TIMEOUT))
+            {
+                socket.abort();
+                return QByteArray();
+            }
+            buffer += socket.readAll();
+        }
+    }
+
+    QString serverName;
+    std::vector<std::thread> threads;
+
+    // Call handoff to the client threads.
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::condition_variable replied;
+    std::deque<CallPtr> calls;
+    bool stopped = false;
+
+    // Returns the cached entry or nullptr. The entry becomes the
+    // most recently used one. Call with the cache mutex locked.
+    JMdict::EntryPtr cached(qint32 index)
+    {
+        auto it = cache.find(index);
+        if (it == cache.end())
+            return nullptr;
+        recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed,
+                            it->second.second);
+        return it->second.first;
+    }
+
+    // Adds the entry into the cache and evicts the least recently
+    // used entries. Call with the cache mutex locked.
+    void insert(qint32 index, JMdict::EntryPtr entry)
+    {
+        if (cached(index))
+            return;
+
+        recentlyUsed.push_front(index);
+        cache.emplace(index, std::make_pair(entry, recentlyUsed.begin()));
+        while (cache.size() > CACHE_SIZE)
+        {
+            cache.erase(recentlyUsed.back());
+            recentlyUsed.pop_back();
+        }
+    }
+
+    // Fetched entries and their indices from the most recently used.
+    std::mutex cacheMutex;
+    std::list<qint32> recentlyUsed;
+    std::unordered_map<qint32,
+        std::pair<JMdict::EntryPtr, std::list<qint32>::iterator>> cache;
+};
+
+/* ---------------------------------------------------------------- *
+   Connects to the server.
+ * ---------------------------------------------------------------- */
+JMdictPtr JMdictClient::connect(const QString& serverName)
+{
+    std::shared_ptr<JMdictClient> client =
+        std::make_shared<JMdictClient>(serverName);
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    startRequest(out, Request::Hello);
+    const QByteArray reply = client->request(payload, true);
+    if (reply.isEmpty())
+        return nullptr;
+
+    JMdictPtr dict = std::make_shared<JMdict>();
+    QDataStream in(reply);
+    in.setVersion(jmdict_protocol::STREAM_VERSION);
+    quint32 entryCount = 0;
+    qint32 maxWordLength = 0;
+    in >> entryCount >> maxWordLength;
+    jmdict_protocol::readVector(in, dict->maxWordLengthByFirst);
+    jmdict_protocol::readVector(in, dict->tags);
+    if (in.status() != QDataStream::Ok)
+        return nullptr;
+
+    dict->maxWordLength = maxWordLength;
+    dict->attach(client);
+    return dict;
+}
+
+/* ---------------------------------------------------------------- *
+   Constructs the client and starts the client threads.
+ * ---------------------------------------------------------------- */
+JMdictClient::JMdictClient(const QString& serverName)
+    : impl(std::make_shared<Impl>())
+{
+    impl->serverName = serverName;
+    for (int i = 0; i < CLIENT_THREADS; ++i)
+        impl->threads.push_back(std::thread(&Impl::run, impl.get()));
+}
+
+/* ---------------------------------------------------------------- *
+   Stops the client threads.
+ * ---------------------------------------------------------------- */
+JMdictClient::~JMdictClient()
+{
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        impl->stopped = true;
+        impl->condition.notify_all();
+    }
+    for (std::thread& thread : impl->threads)
+        thread.join();
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the longest form that starts the text.
+ * ---------------------------------------------------------------- */
+int JMdictClient::longestMatch(const QString& text,
+                               std::vector<qint32>* entryIndices)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    startRequest(out, Request::LongestMatch);
+    out << text;
+
+    const QByteArray reply = request(payload);
+    QDataStream in(reply);
+    in.setVersion(jmdict_protocol::STREAM_VERSION);
+    qint32 length = 0;
+    std::vector<qint32> indices;
+    in >> length;
+    jmdict_protocol::readVector(in, indices);
+    if (in.status() != QDataStream::Ok)
+        return 0;
+
+    if (entryIndices)
+    {
+        fetch(indices);
+        entryIndices->swap(indices);
+    }
+    return length;
+}
+
+/* ---------------------------------------------------------------- *
+   Splits the text into the longest forms with one request.
+ * ---------------------------------------------------------------- */
+std::vector<JMdict::Token> JMdictClient::tokenize(const QString& text,
+                                                  bool withEntries)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    startRequest(out, Request::Tokenize);
+    out << text << withEntries;
+
+    const QByteArray reply = request(payload);
+    QDataStream in(reply);
+    in.setVersion(jmdict_protocol::STREAM_VERSION);
+    quint32 count = 0;
+    in >> count;
+    std::vector<JMdict::Token> tokens;
+    std::vector<qint32> indices;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+    {
+        JMdict::Token token;
+        qint32 position = 0;
+        qint32 length = 0;
+        in >> position >> length;
+        jmdict_protocol::readVector(in, token.entries);
+        token.position = position;
+        token.length   = length;
+        indices.insert(indices.end(), token.entries.begin(),
+                       token.entries.end());
+        tokens.push_back(std::move(token));
+    }
+    if (in.status() != QDataStream::Ok)
+        return std::vector<JMdict::Token>();
+
+    if (withEntries)
+    {
+        std::sort(indices.begin(), indices.end());
+        indices.erase(std::unique(indices.begin(), indices.end()),
+                      indices.end());
+        fetch(indices);
+    }
+    return tokens;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the entry at the index.
+ * ---------------------------------------------------------------- */
+JMdict::EntryPtr JMdictClient::entry(qint32 index)
+{
+    static const JMdict::EntryPtr empty =
+        std::make_shared<JMdict::Entry>();
+
+    {
+        std::lock_guard<std::mutex> lock(impl->cacheMutex);
+        if (JMdict::EntryPtr e = impl->cached(index))
+            return e;
+    }
+
+    fetch({ index });
+    std::lock_guard<std::mutex> lock(impl->cacheMutex);
+    JMdict::EntryPtr e = impl->cached(index);
+    return e ? e : empty;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the indices of the entries of the kanji form.
+ * ---------------------------------------------------------------- */
+std::vector<qint32> JMdictClient::kanjiEntries(const QString& word)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    startRequest(out, Request::KanjiEntries);
+    out << word;
+
+    const QByteArray reply = request(payload);
+    QDataStream in(reply);
+    in.setVersion(jmdict_protocol::STREAM_VERSION);
+    std::vector<qint32> indices;
+    jmdict_protocol::readVector(in, indices);
+    if (in.status() != QDataStream::Ok)
+        return std::vector<qint32>();
+    return indices;
+}
+
+/* ---------------------------------------------------------------- *
+   Search entries by reading.
+ * ---------------------------------------------------------------- */
+std::vector<JMdict::Entry> JMdictClient::searchByReading(
+    const QString& text)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    startRequest(out, Request::SearchByReading);
+    out << text;
+
+    const QByteArray reply = request(payload);
+    QDataStream in(reply);
+    in.setVersion(jmdict_protocol::STREAM_VERSION);
+    std::vector<JMdict::Entry> entries;
+    jmdict_protocol::readVector(in, entries);
+    return entries;
+}
+
+/* ---------------------------------------------------------------- *
+   Search entries by approximate reading.
+ * ---------------------------------------------------------------- */
+std::vector<JMdict::Entry> JMdictClient::searchByReadingFuzzy(
+    const QString& text)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    startRequest(out, Request::SearchByReadingFuzzy);
+    out << text;
+
+    const QByteArray reply = request(payload);
+    QDataStream in(reply);
+    in.setVersion(jmdict_protocol::STREAM_VERSION);
+    std::vector<JMdict::Entry> entries;
+    jmdict_protocol::readVector(in, entries);
+    return entries;
+}
+
+/* ---------------------------------------------------------------- *
+   Search entries by form pattern.
+ * ---------------------------------------------------------------- */
+std::vector<JMdict::Entry> JMdictClient::searchByPattern(
+    const QString& pattern)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    startRequest(out, Request::SearchByPattern);
+    out << pattern;
+
+    const QByteArray reply = request(payload);
+    QDataStream in(reply);
+    in.setVersion(jmdict_protocol::STREAM_VERSION);
+    std::vector<JMdict::Entry> entries;
+    jmdict_protocol::readVector(in, entries);
+    return entries;
+}
+
+/* ---------------------------------------------------------------- *
+   Search entries by gloss.
+ * ---------------------------------------------------------------- */
+std::vector<JMdict::Entry> JMdictClient::searchByGloss(
+    const QString& text, bool startsWith, bool endsWith)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    startRequest(out, Request::SearchByGloss);
+    out << text << startsWith << endsWith;
+
+    const QByteArray reply = request(payload);
+    QDataStream in(reply);
+    in.setVersion(jmdict_protocol::STREAM_VERSION);
+    std::vector<JMdict::Entry> entries;
+    jmdict_protocol::readVector(in, entries);
+    return entries;
+}
+
+/* ---------------------------------------------------------------- *
+   Hands the request to the client threads and waits for the reply.
+   A call from the GUI thread that is not answered in time is
+   withdrawn if no thread has taken it yet. Otherwise the thread
+   finishes it and its reply is dropped.
+ * ---------------------------------------------------------------- */
+QByteArray JMdictClient::request(const QByteArray& payload, bool waitReply)
+{
+    Impl::CallPtr call = std::make_shared<Impl::Call>();
+    call->payload = payload;
+
+    std::unique_lock<std::mutex> lock(impl->mutex);
+    impl->calls.push_back(call);
+    impl->condition.notify_one();
+
+    auto isDone = [&]() { return call->done; };
+    if (waitReply || !isGuiThread())
+    {
+        impl->replied.wait(lock, isDone);
+    }
+    else if (!impl->replied.wait_for(
+                 lock, std::chrono::milliseconds(GUI_REPLY_TIMEOUT), isDone))
+    {
+        impl->calls.erase(
+            std::remove(impl->calls.begin(), impl->calls.end(), call),
+            impl->calls.end());
+        return QByteArray();
+    }
+    return call->reply;
+}
+
+/* ---------------------------------------------------------------- *
+   Fetches the entries that are not in the cache with one request.
+   The cache is not locked during the request so the other threads
+   can use the cached entries meanwhile.
+ * ---------------------------------------------------------------- */
+void JMdictClient::fetch(const std::vector<qint32>& indices)
+{
+    std::vector<qint32> missing;
+    {
+        std::lock_guard<std::mutex> lock(impl->cacheMutex);
+        for (const qint32 index : indices)
+            if (!impl->cached(index))
+                missing.push_back(index);
+    }
+    if (missing.empty())
+        return;
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    startRequest(out, Request::Entries);
+    jmdict_protocol::writeVector(out, missing);
+
+    const QByteArray reply = request(payload);
+    QDataStream in(reply);
+    in.setVersion(jmdict_protocol::STREAM_VERSION);
+    quint32 count = 0;
+    in >> count;
+    std::vector<std::pair<qint32, JMdict::EntryPtr>> fetched;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+    {
+        qint32 index = -1;
+        std::shared_ptr<JMdict::Entry> entry =
+            std::make_shared<JMdict::Entry>();
+        in >> index;
+        jmdict_protocol::operator>>(in, *entry);
+        if (in.status() == QDataStream::Ok)
+            fetched.push_back(std::make_pair(index, entry));
+    }
+
+    std::lock_guard<std::mutex> lock(impl->cacheMutex);
+    for (const std::pair<qint32, JMdict::EntryPtr>& f : fetched)
+        impl->insert(f.first, f.second);
+}
+
+} // namespace kuu
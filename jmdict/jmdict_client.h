@@ -0,0 +1,76 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::JMdictClient class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <QtCore/QByteArray>
+#include "jmdict.h"
+
+namespace kuu
+{
+
+/* ---------------------------------------------------------------- *
+   A client of the dictionary server. The sockets live in the
+   threads of the client so that the lookups can be called from any
+   thread. Each thread serves one call at a time. A call from the
+   GUI thread waits only briefly for the reply and falls back to an
+   empty result so that a busy server does not freeze the editor.
+   The fetched entries are kept in a cache of the least recently
+   used entries.
+ * ---------------------------------------------------------------- */
+class JMdictClient
+{
+public:
+    // Connects to the server and returns a dictionary that is
+    // attached to the server. Returns nullptr if no server answers.
+    static JMdictPtr connect(const QString& serverName);
+
+    // Constructs the client of the named server. The client
+    // connects on the first request.
+    explicit JMdictClient(const QString& serverName);
+    // Stops the client threads.
+    ~JMdictClient();
+
+    // Returns the length of the longest form that starts the text
+    // and stores the indices of its entries. The entries are fetched
+    // into the cache. Returns 0 if the server has gone.
+    int longestMatch(const QString& text,
+                     std::vector<qint32>* entryIndices);
+    // Splits the text into the longest forms. The entries are
+    // fetched into the cache if withEntries is set. Returns no
+    // tokens if the server has gone.
+    std::vector<JMdict::Token> tokenize(const QString& text,
+                                        bool withEntries);
+    // Returns the entry at the index. An empty entry is returned if
+    // the server has gone.
+    JMdict::EntryPtr entry(qint32 index);
+    // Returns the indices of the entries of the kanji form.
+    std::vector<qint32> kanjiEntries(const QString& word);
+    // Search entries by reading, by form pattern and by gloss.
+    std::vector<JMdict::Entry> searchByReading(const QString& text);
+    std::vector<JMdict::Entry> searchByReadingFuzzy(const QString& text);
+    std::vector<JMdict::Entry> searchByPattern(const QString& pattern);
+    std::vector<JMdict::Entry> searchByGloss(const QString& text,
+                                             bool startsWith,
+                                             bool endsWith);
+
+private:
+    // Sends the request and returns the reply. Returns an empty
+    // reply if the server cannot be reached or if the call from
+    // the GUI thread was not answered in time. The reply is always
+    // waited for if waitReply is set.
+    QByteArray request(const QByteArray& payload, bool waitReply = false);
+    // Fetches the missing entries into the cache.
+    void fetch(const std::vector<qint32>& indices);
+
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace kuu
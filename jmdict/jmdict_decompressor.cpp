@@ -0,0 +1,360 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::JMdictDecompressor class.
+ * ---------------------------------------------------------------- */
+
+#include "jmdict_decompressor.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <zlib.h>
+#ifdef JPAD_WITH_LZMA
+#include <lzma.h>
+#endif
+
+namespace kuu
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+const int BLOCK_SIZE = 1 << 20;
+const size_t MAX_QUEUED_BLOCKS = 8;
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Private data of the decompressor.
+ * ---------------------------------------------------------------- */
+struct JMdictDecompressor::Impl
+{
+    // Pushes a decompressed block into queue. Blocks while the
+    // queue is full. Returns false if the decompression has been
+    // cancelled.
+    bool push(const QByteArray& block)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this]()
+        {
+            return blocks.size() < MAX_QUEUED_BLOCKS || cancelled;
+        });
+
+        if (cancelled)
+            return false;
+
+        blocks.push_back(block);
+        cv.notify_all();
+        return true;
+    }
+
+    // Reads the next block of compressed data from the source.
+    qint64 readSource(QByteArray& in)
+    {
+        const qint64 count = source->read(in.data(), in.size());
+        if (count < 0)
+            failure = source->errorString();
+        return count;
+    }
+
+    // Decompresses the gzip source. Concatenated gzip members are
+    // decompressed as a single stream.
+    void inflateGzip()
+    {
+        z_stream z;
+        std::memset(&z, 0, sizeof(z));
+        if (inflateInit2(&z, 15 + 32) != Z_OK)
+        {
+            failure = "Failed to initialize gzip decompression";
+            return;
+        }
+
+        QByteArray in(BLOCK_SIZE, 0);
+        bool streamEnd = false;
+        for (;;)
+        {
+            if (z.avail_in == 0)
+            {
+                const qint64 count = readSource(in);
+                if (count < 0)
+                    break;
+                if (count == 0)
+                {
+                    if (!streamEnd)
+                        failure = "Unexpected end of gzip data";
+                    break;
+                }
+                z.next_in  = reinterpret_cast<Bytef*>(in.data());
+                z.avail_in = uInt(count);
+            }
+
+            if (streamEnd)
+            {
+                inflateReset(&z);
+                streamEnd = false;
+            }
+
+            QByteArray out(BLOCK_SIZE, 0);
+            z.next_out  = reinterpret_cast<Bytef*>(out.data());
+            z.avail_out = uInt(out.size());
+
+            const int ret = inflate(&z, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END)
+                streamEnd = true;
+            else if (ret != Z_OK && ret != Z_BUF_ERROR)
+            {
+                failure = z.msg ? QString(z.msg)
+                                : QString("Invalid gzip data");
+                break;
+            }
+
+            const int produced = out.size() - int(z.avail_out);
+            if (produced > 0)
+            {
+                out.resize(produced);
+                if (!push(out))
+                    break;
+            }
+        }
+
+        inflateEnd(&z);
+    }
+
+#ifdef JPAD_WITH_LZMA
+    // Decompresses the xz source.
+    void inflateXz()
+    {
+        lzma_stream s = LZMA_STREAM_INIT;
+        if (lzma_stream_decoder(&s, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+        {
+            failure = "Failed to initialize xz decompression";
+            return;
+        }
+
+        QByteArray in(BLOCK_SIZE, 0);
+        lzma_action action = LZMA_RUN;
+        for (;;)
+        {
+            if (s.avail_in == 0 && action == LZMA_RUN)
+            {
+                const qint64 count = readSource(in);
+                if (count < 0)
+                    break;
+                if (count == 0)
+                    action = LZMA_FINISH;
+                s.next_in  = reinterpret_cast<const uint8_t*>(in.constData());
+                s.avail_in = size_t(count);
+            }
+
+            QByteArray out(BLOCK_SIZE, 0);
+            s.next_out  = reinterpret_cast<uint8_t*>(out.data());
+            s.avail_out = size_t(out.size());
+
+            const lzma_ret ret = lzma_code(&s, action);
+            if (ret != LZMA_OK && ret != LZMA_STREAM_END)
+            {
+                failure = "Invalid xz data";
+                break;
+            }
+
+            const int produced = out.size() - int(s.avail_out);
+            if (produced > 0)
+            {
+                out.resize(produced);
+                if (!push(out))
+                    break;
+            }
+
+            if (ret == LZMA_STREAM_END)
+                break;
+        }
+
+        lzma_end(&s);
+    }
+#endif
+
+    // Runs the decompression in the worker thread.
+    void run()
+    {
+        switch (format)
+        {
+            case Format::Gzip:
+                inflateGzip();
+                break;
+
+            case Format::Xz:
+#ifdef JPAD_WITH_LZMA
+                inflateXz();
+#else
+                failure = "xz support is not enabled";
+#endif
+                break;
+
+            default:
+                failure = "The source is not compressed";
+                break;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        cv.notify_all();
+    }
+
+    // Stops the worker thread.
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            cancelled = true;
+            cv.notify_all();
+        }
+
+        if (thread.joinable())
+            thread.join();
+    }
+
+    QIODevice* source = nullptr;
+    Format format = Format::Uncompressed;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<QByteArray> blocks;
+    bool finished  = false;
+    bool cancelled = false;
+    QString failure;
+
+    QByteArray current;
+    int currentPos = 0;
+};
+
+/* ---------------------------------------------------------------- *
+   Detects the compression format from the first bytes.
+ * ---------------------------------------------------------------- */
+JMdictDecompressor::Format JMdictDecompressor::detectFormat(
+    QIODevice* device)
+{
+    const QByteArray magic = device->peek(6);
+    if (magic.startsWith("\x1f\x8b"))
+        return Format::Gzip;
+    if (magic == QByteArray("\xfd" "7zXZ\x00", 6))
+        return Format::Xz;
+    return Format::Uncompressed;
+}
+
+/* ---------------------------------------------------------------- *
+   Constructs the decompressor.
+ * ---------------------------------------------------------------- */
+JMdictDecompressor::JMdictDecompressor(QIODevice* source,
+                                       Format format)
+    : impl(std::make_shared<Impl>())
+{
+    impl->source = source;
+    impl->format = format;
+}
+
+/* ---------------------------------------------------------------- *
+   Stops the worker thread.
+ * ---------------------------------------------------------------- */
+JMdictDecompressor::~JMdictDecompressor()
+{ impl->stop(); }
+
+/* ---------------------------------------------------------------- *
+   Starts the worker thread.
+ * ---------------------------------------------------------------- */
+bool JMdictDecompressor::open(OpenMode mode)
+{
+    if (isOpen() || (mode & WriteOnly))
+        return false;
+
+    impl->finished  = false;
+    impl->cancelled = false;
+    impl->failure.clear();
+    impl->blocks.clear();
+    impl->current.clear();
+    impl->currentPos = 0;
+    impl->thread = std::thread(&Impl::run, impl.get());
+
+    return QIODevice::open(mode);
+}
+
+/* ---------------------------------------------------------------- *
+   Stops the worker thread.
+ * ---------------------------------------------------------------- */
+void JMdictDecompressor::close()
+{
+    impl->stop();
+    QIODevice::close();
+}
+
+/* ---------------------------------------------------------------- *
+   The decompressed data can only be read once.
+ * ---------------------------------------------------------------- */
+bool JMdictDecompressor::isSequential() const
+{ return true; }
+
+/* ---------------------------------------------------------------- *
+   Reads the decompressed data. Blocks until the worker thread
+   has decompressed data or it has finished. Returns 0 at the
+   end of data.
+ * ---------------------------------------------------------------- */
+qint64 JMdictDecompressor::readData(char* data, qint64 maxSize)
+{
+    qint64 total = 0;
+    while (total < maxSize)
+    {
+        if (impl->currentPos >= impl->current.size())
+        {
+            std::unique_lock<std::mutex> lock(impl->mutex);
+            if (total > 0 && impl->blocks.empty())
+                break;
+
+            Impl* d = impl.get();
+            d->cv.wait(lock, [d]()
+            {
+                return !d->blocks.empty() || d->finished;
+            });
+
+            if (d->blocks.empty())
+            {
+                if (!d->failure.isEmpty())
+                {
+                    setErrorString(d->failure);
+                    return total > 0 ? total : -1;
+                }
+                break;
+            }
+
+            d->current = d->blocks.front();
+            d->currentPos = 0;
+            d->blocks.pop_front();
+            d->cv.notify_all();
+        }
+
+        const qint64 count = qMin<qint64>(
+            maxSize - total,
+            impl->current.size() - impl->currentPos);
+        std::memcpy(data + total,
+                    impl->current.constData() + impl->currentPos,
+                    size_t(count));
+        impl->currentPos += int(count);
+        total += count;
+    }
+
+    return total;
+}
+
+/* ---------------------------------------------------------------- *
+   Writing is not supported.
+ * ---------------------------------------------------------------- */
+qint64 JMdictDecompressor::writeData(const char* /*data*/,
+                                     qint64 /*maxSize*/)
+{ return -1; }
+
+} // namespace kuu
@@ -0,0 +1,64 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::JMdictDecompressor class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <memory>
+#include <QtCore/QIODevice>
+
+namespace kuu
+{
+
+/* ---------------------------------------------------------------- *
+   A sequential read-only device that decompresses a gzip or xz
+   compressed source device. The decompression runs in a worker
+   thread that fills a bounded queue of blocks while the reader of
+   the device parses the previous blocks.
+ * ---------------------------------------------------------------- */
+class JMdictDecompressor : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    // Compression formats.
+    enum class Format
+    {
+        Uncompressed,
+        Gzip,
+        Xz
+    };
+
+    // Detects the compression format from the first bytes of the
+    // device. The device needs to be open.
+    static Format detectFormat(QIODevice* device);
+
+    // Constructs the decompressor of a gzip or xz source. The source
+    // device needs to be open and it must stay alive while the
+    // decompressor is open. An uncompressed source is read without
+    // a decompressor.
+    JMdictDecompressor(QIODevice* source, Format format);
+    // Stops the worker thread.
+    ~JMdictDecompressor();
+
+    // Starts the worker thread. Only the read-only mode is
+    // supported.
+    bool open(OpenMode mode) override;
+    // Stops the worker thread.
+    void close() override;
+
+    bool isSequential() const override;
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override;
+    qint64 writeData(const char* data, qint64 maxSize) override;
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace kuu
@@ -0,0 +1,359 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::JMdictFormIndex class.
+ * ---------------------------------------------------------------- */
+
+#include "jmdict_form_index.h"
+#include <algorithm>
+
+namespace kuu
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+// Start and end marks of a form. The control characters are not
+// used in the forms.
+const ushort START_MARK = 0x0002;
+const ushort END_MARK   = 0x0003;
+// High half of a single character gram. U+FFFF is not a character
+// so the key does not collide with a bigram.
+const quint32 UNIGRAM = 0xFFFF0000u;
+
+/* ---------------------------------------------------------------- *
+   Returns the key of the bigram.
+ * ---------------------------------------------------------------- */
+quint32 bigram(ushort a, ushort b)
+{ return (quint32(a) << 16) | b; }
+
+/* ---------------------------------------------------------------- *
+   Returns the pattern with the full-width wildcards of a Japanese
+   input method replaced by the ASCII wildcards.
+ * ---------------------------------------------------------------- */
+QString normalizePattern(QString pattern)
+{
+    pattern.replace(QChar(0xFF0A), QLatin1Char('*'));
+    pattern.replace(QChar(0xFF1F), QLatin1Char('?'));
+    return pattern;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if the character is a wildcard.
+ * ---------------------------------------------------------------- */
+bool isWildcard(QChar c)
+{ return c == QLatin1Char('*') || c == QLatin1Char('?'); }
+
+/* ---------------------------------------------------------------- *
+   Returns true if the pattern matches the whole text. A star
+   backtracks to the latest star only, which is enough as a star
+   matches any run.
+ * ---------------------------------------------------------------- */
+bool matches(const QString& pattern, const QString& text)
+{
+    int p = 0;
+    int t = 0;
+    int star = -1;
+    int starText = 0;
+    while (t < text.size())
+    {
+        if (p < pattern.size() &&
+            (pattern[p] == QLatin1Char('?') || pattern[p] == text[t]))
+        {
+            ++p;
+            ++t;
+        }
+        else if (p < pattern.size() && pattern[p] == QLatin1Char('*'))
+        {
+            star = p++;
+            starText = t;
+        }
+        else if (star >= 0)
+        {
+            p = star + 1;
+            t = ++starText;
+        }
+        else
+            return false;
+    }
+    while (p < pattern.size() && pattern[p] == QLatin1Char('*'))
+        ++p;
+    return p == pattern.size();
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the grams of the literal parts of the pattern. The start
+   and end marks are a part of the pattern unless it starts or ends
+   with a wildcard.
+ * ---------------------------------------------------------------- */
+std::vector<quint32> patternGrams(const QString& pattern)
+{
+    std::vector<ushort> marked;
+    if (pattern.isEmpty() || !isWildcard(pattern[0]))
+        marked.push_back(START_MARK);
+    for (const QChar c : pattern)
+        marked.push_back(isWildcard(c) ? 0 : c.unicode());
+    if (pattern.isEmpty() || !isWildcard(pattern[pattern.size() - 1]))
+        marked.push_back(END_MARK);
+
+    std::vector<quint32> grams;
+    size_t start = 0;
+    for (size_t i = 0; i <= marked.size(); ++i)
+    {
+        if (i < marked.size() && marked[i] != 0)
+            continue;
+
+        // A literal run from start to i.
+        if (i - start == 1 &&
+            marked[start] != START_MARK && marked[start] != END_MARK)
+        {
+            grams.push_back(UNIGRAM | marked[start]);
+        }
+        for (size_t j = start + 1; j < i; ++j)
+            grams.push_back(bigram(marked[j - 1], marked[j]));
+        start = i + 1;
+    }
+
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    return grams;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if the form a is before the form b in the result
+   order, i.e. it is shorter or of the same length and before b.
+ * ---------------------------------------------------------------- */
+bool formLess(const QString& a, const QString& b)
+{
+    if (a.size() != b.size())
+        return a.size() < b.size();
+    return a < b;
+}
+
+/* ---------------------------------------------------------------- *
+   Appends the value as a variable-length integer of 7 bits per
+   byte. The high bit of a byte tells that more bytes follow.
+ * ---------------------------------------------------------------- */
+void appendVarint(QByteArray& bytes, quint32 value)
+{
+    while (value >= 0x80)
+    {
+        bytes.append(char((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    bytes.append(char(value));
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Constructs an empty index.
+ * ---------------------------------------------------------------- */
+JMdictFormIndex::JMdictFormIndex()
+{}
+
+/* ---------------------------------------------------------------- *
+   Builds the index. The forms are numbered in the result order so
+   the posting lists give the results in order as well.
+ * ---------------------------------------------------------------- */
+JMdictFormIndex::JMdictFormIndex(std::vector<QString> forms)
+    : forms(std::move(forms))
+{
+    std::vector<QString>& f = this->forms;
+    std::sort(f.begin(), f.end(), formLess);
+    f.erase(std::unique(f.begin(), f.end()), f.end());
+
+    QHash<quint32, qint32> lastForm;
+    std::vector<quint32> grams;
+    for (size_t i = 0; i < f.size(); ++i)
+    {
+        const QString& form = f[i];
+        grams.clear();
+        ushort previous = START_MARK;
+        for (const QChar c : form)
+        {
+            grams.push_back(UNIGRAM | c.unicode());
+            grams.push_back(bigram(previous, c.unicode()));
+            previous = c.unicode();
+        }
+        grams.push_back(bigram(previous, END_MARK));
+        std::sort(grams.begin(), grams.end());
+        grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+
+        for (const quint32 gram : grams)
+        {
+            auto last = lastForm.find(gram);
+            const qint32 delta = last == lastForm.end()
+                ? qint32(i) : qint32(i) - last.value();
+            appendVarint(postingLists[gram], quint32(delta));
+            lastForm[gram] = qint32(i);
+        }
+    }
+
+    for (auto it = postingLists.begin(); it != postingLists.end(); ++it)
+        it->squeeze();
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the forms that match the pattern. The smallest posting
+   list gives the candidates that are narrowed by the other lists
+   before the pattern is checked. The inserted forms are checked
+   even if no indexed form has a gram of the pattern.
+ * ---------------------------------------------------------------- */
+std::vector<QString> JMdictFormIndex::search(const QString& pattern,
+                                             size_t maxCount) const
+{
+    const QString p = normalizePattern(pattern);
+    std::vector<QString> results;
+
+    std::vector<quint32> grams = patternGrams(p);
+    bool gramsIndexed = true;
+    for (const quint32 gram : grams)
+        if (!postingLists.contains(gram))
+            gramsIndexed = false;
+
+    std::sort(grams.begin(), grams.end(), [this](quint32 a, quint32 b)
+    {
+        return postingLists.value(a).size() < postingLists.value(b).size();
+    });
+
+    // The indexed forms are candidates only if each gram is indexed.
+    std::vector<qint32> candidates;
+    if (gramsIndexed && grams.empty())
+    {
+        // Only wildcards, every form is a candidate.
+        for (size_t i = 0; i < forms.size(); ++i)
+            candidates.push_back(qint32(i));
+    }
+    else if (gramsIndexed)
+    {
+        candidates = postings(grams.front());
+        for (size_t i = 1; i < grams.size() && !candidates.empty(); ++i)
+        {
+            const std::vector<qint32> other = postings(grams[i]);
+            std::vector<qint32> both;
+            std::set_intersection(candidates.begin(), candidates.end(),
+                                  other.begin(), other.end(),
+                                  std::back_inserter(both));
+            candidates.swap(both);
+        }
+    }
+
+    for (const qint32 candidate : candidates)
+    {
+        if (results.size() >= maxCount)
+            break;
+        const QString& form = forms[size_t(candidate)];
+        if (matches(p, form) && !isRemoved(form))
+            results.push_back(form);
+    }
+
+    // The inserted forms are merged into the results in order.
+    const size_t indexed = results.size();
+    for (const QString& form : insertedForms)
+        if (matches(p, form))
+            results.push_back(form);
+    std::inplace_merge(results.begin(), results.begin() + indexed,
+                       results.end(), formLess);
+    if (results.size() > maxCount)
+        results.resize(maxCount);
+    return results;
+}
+
+/* ---------------------------------------------------------------- *
+   Inserts the form if it is not in the index yet. A removed form
+   of the index is restored.
+ * ---------------------------------------------------------------- */
+void JMdictFormIndex::insert(const QString& form)
+{
+    if (std::binary_search(forms.begin(), forms.end(), form, formLess))
+    {
+        auto it = std::lower_bound(removedForms.begin(),
+                                   removedForms.end(),
+                                   form, formLess);
+        if (it != removedForms.end() && *it == form)
+            removedForms.erase(it);
+        return;
+    }
+
+    auto it = std::lower_bound(insertedForms.begin(), insertedForms.end(),
+                               form, formLess);
+    if (it == insertedForms.end() || *it != form)
+        insertedForms.insert(it, form);
+}
+
+/* ---------------------------------------------------------------- *
+   Removes the form. An inserted form is dropped, a form of the
+   index is marked removed.
+ * ---------------------------------------------------------------- */
+void JMdictFormIndex::remove(const QString& form)
+{
+    auto it = std::lower_bound(insertedForms.begin(), insertedForms.end(),
+                               form, formLess);
+    if (it != insertedForms.end() && *it == form)
+    {
+        insertedForms.erase(it);
+        return;
+    }
+
+    if (!std::binary_search(forms.begin(), forms.end(), form, formLess))
+        return;
+    it = std::lower_bound(removedForms.begin(), removedForms.end(),
+                          form, formLess);
+    if (it == removedForms.end() || *it != form)
+        removedForms.insert(it, form);
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if the text has a wildcard.
+ * ---------------------------------------------------------------- */
+bool JMdictFormIndex::isPattern(const QString& text)
+{
+    for (const QChar c : normalizePattern(text))
+        if (isWildcard(c))
+            return true;
+    return false;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if the form of the index has been removed.
+ * ---------------------------------------------------------------- */
+bool JMdictFormIndex::isRemoved(const QString& form) const
+{
+    return !removedForms.empty() &&
+           std::binary_search(removedForms.begin(), removedForms.end(),
+                              form, formLess);
+}
+
+/* ---------------------------------------------------------------- *
+   Decodes the posting list of the gram.
+ * ---------------------------------------------------------------- */
+std::vector<qint32> JMdictFormIndex::postings(quint32 gram) const
+{
+    std::vector<qint32> values;
+    const QByteArray bytes = postingLists.value(gram);
+    const uchar* p   = reinterpret_cast<const uchar*>(bytes.constData());
+    const uchar* end = p + bytes.size();
+
+    qint32 value = 0;
+    while (p < end)
+    {
+        quint32 delta = 0;
+        int shift = 0;
+        while (p < end && (*p & 0x80))
+        {
+            delta |= quint32(*p++ & 0x7F) << shift;
+            shift += 7;
+        }
+        if (p < end)
+            delta |= quint32(*p++) << shift;
+        value += qint32(delta);
+        values.push_back(value);
+    }
+    return values;
+}
+
+} // namespace kuu
@@ -0,0 +1,71 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::JMdictFormIndex class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <vector>
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QString>
+
+namespace kuu
+{
+
+/* ---------------------------------------------------------------- *
+   A character n-gram index of the kanji and reading forms for the
+   wildcard queries. A pattern matches whole forms, '?' matches one
+   character and '*' any run of characters, e.g. "*食*" matches the
+   forms that contain 食.
+
+   Each form is indexed by its characters and by the bigrams of the
+   form with a start and an end mark, so the anchored parts of a
+   pattern are indexed as well. The posting list of a gram is the
+   ascending form numbers as variable-length deltas. A query
+   intersects the posting lists of the grams of the pattern and
+   checks the remaining candidates with the pattern.
+
+   The forms inserted after the index was built are kept in a
+   sorted list that is checked with each query. The forms removed
+   from the index are kept in a sorted list as well and skipped
+   before the result count is limited.
+ * ---------------------------------------------------------------- */
+class JMdictFormIndex
+{
+public:
+    // Constructs an empty index.
+    JMdictFormIndex();
+    // Builds the index of the forms.
+    explicit JMdictFormIndex(std::vector<QString> forms);
+
+    // Returns the forms that match the pattern ordered by length
+    // and then by the form. At most maxCount forms are returned.
+    std::vector<QString> search(const QString& pattern,
+                                size_t maxCount) const;
+
+    // Inserts the form into the index. The form is checked with
+    // each query until the index is built again.
+    void insert(const QString& form);
+    // Removes the form from the index. The form is skipped by the
+    // queries until the index is built again.
+    void remove(const QString& form);
+
+    // Returns true if the pattern has a wildcard.
+    static bool isPattern(const QString& text);
+
+private:
+    // Returns the form numbers of the posting list of the gram.
+    std::vector<qint32> postings(quint32 gram) const;
+    // Returns true if the indexed form has been removed.
+    bool isRemoved(const QString& form) const;
+
+    std::vector<QString> forms;
+    std::vector<QString> insertedForms;
+    std::vector<QString> removedForms;
+    QHash<quint32, QByteArray> postingLists;
+};
+
+} // namespace kuu
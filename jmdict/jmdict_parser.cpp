@@ -11,10 +11,14 @@
 
 #include "jmdict_parser.h"
 
+#include <algorithm>
 #include <exception>
+#include <limits>
 #include <QtCore/QDebug>
 #include <QtCore/QFile>
-#include <QtCore/QXmlStreamReader>
+#include <QtCore/QHash>
+#include "jmdict_decompressor.h"
+#include "jmdict_tokenizer.h"
 
 namespace kuu
 {
@@ -24,82 +28,94 @@ namespace
 {
 
 /* ---------------------------------------------------------------- *
-   Declares XML tag names.
+   Declares aliases of tokenizer types.
  * ---------------------------------------------------------------- */
-const QString TAG_ENTRY                = "entry";
-const QString TAG_SEQUENCE_NUMBER      = "ent_seq";
-const QString TAG_KANJI_ELEMENT        = "k_ele";
-const QString TAG_KANJI_PHRASE         = "keb";
-const QString TAG_KANJI_INFO           = "ke_inf";
-const QString TAG_KANJI_PRIORITY       = "ke_pri";
-const QString TAG_READING_ELEMENT      = "r_ele";
-const QString TAG_READING_PHRASE       = "reb";
-const QString TAG_READING_PRIORITY     = "re_pri";
-const QString TAG_SENSE                = "sense";
-const QString TAG_PART_OF_SPEECH       = "pos";
-const QString TAG_GLOSS                = "gloss";
-const QString TAG_LOANWORD_SOURCE      = "lsource";
-const QString TAG_FIELD_OF_APPLICATION = "field";
-const QString TAG_MISC                 = "misc";
-const QString TAG_DIALECT              = "dial";
-const QString TAG_INFO                 = "s_inf";
+using Token = JMdictTokenizer::Token;
+using Tag   = JMdictTokenizer::Tag;
 
 /* ---------------------------------------------------------------- *
    Declares XML tag attributes
  * ---------------------------------------------------------------- */
-const QString TAB_ATTRIBUTE_TYPE       = "ls_type";
-const QString TAB_ATTRIBUTE_WASEIEIGO  = "ls_wasei";
+const char* const TAG_ATTRIBUTE_TYPE      = "ls_type";
+const char* const TAG_ATTRIBUTE_WASEIEIGO = "ls_wasei";
+
+/* ---------------------------------------------------------------- *
+   Returns true if the token ends the element of the given tag or
+   if there are no more tokens in the stream.
+ * ---------------------------------------------------------------- */
+bool isEndOf(const JMdictTokenizer& r, Token token, Tag tag)
+{
+    return (token == Token::EndElement && r.tag() == tag) ||
+           token == Token::EndDocument ||
+           token == Token::Invalid;
+}
+
+/* ---------------------------------------------------------------- *
+   Reads a coded element as a tag ID.
+ * ---------------------------------------------------------------- */
+JMdict::TagId readTag(JMdictTokenizer& r)
+{
+    const int id = r.readElementEntity();
+    if (id > std::numeric_limits<JMdict::TagId>::max())
+        throw std::runtime_error("Too many entity tags");
+    return JMdict::TagId(id);
+}
 
 /* ---------------------------------------------------------------- *
    Reads a sense from the stream.
  * ---------------------------------------------------------------- */
-JMdict::Sense readSense(QXmlStreamReader& r)
+JMdict::Sense readSense(JMdictTokenizer& r)
 {
     JMdict::Sense out;
     for (;;)
     {
-        const QXmlStreamReader::TokenType token = r.readNext();
-        if (token == QXmlStreamReader::EndElement &&
-            r.name() == TAG_SENSE)
-        {
+        const Token token = r.next();
+        if (isEndOf(r, token, Tag::Sense))
             break;
-        }
+        if (token != Token::StartElement)
+            continue;
 
-        if (r.name() == TAG_PART_OF_SPEECH)
-            out.partOfSpeeches.push_back(r.readElementText());
+        switch (r.tag())
+        {
+            case Tag::PartOfSpeech:
+                out.partOfSpeeches.push_back(readTag(r));
+                break;
 
-        if (r.name() == TAG_GLOSS)
-            out.glosses.push_back(r.readElementText());
+            case Tag::Gloss:
+                out.glosses.push_back(r.readElementText());
+                break;
 
-        if (r.name() == TAG_LOANWORD_SOURCE)
-        {
-            JMdict::LoadWordSource src;
-            src.source = "full";
-            const QXmlStreamAttributes attributes = r.attributes();
-            if (attributes.size())
+            case Tag::LoanwordSource:
             {
-                if (attributes.hasAttribute(TAB_ATTRIBUTE_TYPE))
-                    src.source = attributes.value(TAB_ATTRIBUTE_TYPE).toString();
-
-                if (attributes.hasAttribute(TAB_ATTRIBUTE_WASEIEIGO))
-                    src.wasei = attributes.value(TAB_ATTRIBUTE_WASEIEIGO).toString();
+                JMdict::LoadWordSource src;
+                src.descFullOrPartial = r.attribute(TAG_ATTRIBUTE_TYPE);
+                if (src.descFullOrPartial.isNull())
+                    src.descFullOrPartial = "full";
+                src.wasei  = r.attribute(TAG_ATTRIBUTE_WASEIEIGO);
+                src.source = r.readElementText();
+                out.loanwordSources.push_back(std::move(src));
+                break;
             }
 
-            src.source = r.readElementText();
-            out.loanwordSources.push_back(src);
-        }
+            case Tag::FieldOfApplication:
+                out.fieldOfApplications.push_back(readTag(r));
+                break;
 
-        if (r.name() == TAG_FIELD_OF_APPLICATION)
-            out.fieldOfApplications.push_back(r.readElementText());
+            case Tag::Misc:
+                out.misc.push_back(readTag(r));
+                break;
 
-        if (r.name() == TAG_MISC)
-            out.misc.push_back(r.readElementText());
+            case Tag::Dialect:
+                out.dialect.push_back(readTag(r));
+                break;
 
-        if (r.name() == TAG_DIALECT)
-            out.dialect.push_back(r.readElementText());
+            case Tag::Info:
+                out.infos.push_back(r.readElementText());
+                break;
 
-        if (r.name() == TAG_INFO)
-            out.infos.push_back(r.readElementText());
+            default:
+                break;
+        }
     }
 
     return out;
@@ -108,24 +124,30 @@ JMdict::Sense readSense(QXmlStreamReader& r)
 /* ---------------------------------------------------------------- *
    Reads a reading element from the stream.
  * ---------------------------------------------------------------- */
-JMdict::Reading readReadingElement(QXmlStreamReader& r)
+JMdict::Reading readReadingElement(JMdictTokenizer& r)
 {
     JMdict::Reading out;
     for (;;)
     {
-        const QXmlStreamReader::TokenType token = r.readNext();
-        if (token == QXmlStreamReader::EndElement &&
-            r.name() == TAG_READING_ELEMENT)
-        {
+        const Token token = r.next();
+        if (isEndOf(r, token, Tag::ReadingElement))
             break;
-        }
+        if (token != Token::StartElement)
+            continue;
 
-        if (r.name() == TAG_READING_PHRASE)
-            out.wordOrPhrase = r.readElementText();
+        switch (r.tag())
+        {
+            case Tag::ReadingPhrase:
+                out.wordOrPhrase = r.readElementText();
+                break;
 
-        if (r.name() == TAG_READING_PRIORITY)
-            out.priorities.push_back(r.readElementText());
+            case Tag::ReadingPriority:
+                out.priorities.push_back(r.readElementText());
+                break;
 
+            default:
+                break;
+        }
     }
     return out;
 }
@@ -133,26 +155,34 @@ JMdict::Reading readReadingElement(QXmlStreamReader& r)
 /* ---------------------------------------------------------------- *
    Reads a kanji element from the stream.
  * ---------------------------------------------------------------- */
-JMdict::Kanji readKanjiElement(QXmlStreamReader& r)
+JMdict::Kanji readKanjiElement(JMdictTokenizer& r)
 {
     JMdict::Kanji out;
     for (;;)
     {
-        const QXmlStreamReader::TokenType token = r.readNext();
-        if (token == QXmlStreamReader::EndElement &&
-            r.name() == TAG_KANJI_ELEMENT)
-        {
+        const Token token = r.next();
+        if (isEndOf(r, token, Tag::KanjiElement))
             break;
-        }
+        if (token != Token::StartElement)
+            continue;
 
-        if (r.name() == TAG_KANJI_PHRASE)
-            out.wordOrPhrase = r.readElementText();
+        switch (r.tag())
+        {
+            case Tag::KanjiPhrase:
+                out.wordOrPhrase = r.readElementText();
+                break;
+
+            case Tag::KanjiPriority:
+                out.priorities.push_back(r.readElementText());
+                break;
 
-        if (r.name() == TAG_KANJI_PRIORITY)
-            out.priorities.push_back(r.readElementText());
+            case Tag::KanjiInfo:
+                out.info.push_back(readTag(r));
+                break;
 
-        if (r.name() == TAG_KANJI_INFO)
-            out.info.push_back(r.readElementText());
+            default:
+                break;
+        }
     }
     return out;
 }
@@ -160,42 +190,113 @@ JMdict::Kanji readKanjiElement(QXmlStreamReader& r)
 /* ---------------------------------------------------------------- *
    Reads an entry from the stream.
  * ---------------------------------------------------------------- */
-JMdict::Entry readEntry(QXmlStreamReader& r)
+JMdict::Entry readEntry(JMdictTokenizer& r)
 {
     JMdict::Entry e;
 
     for(;;)
     {
-        QXmlStreamReader::TokenType token = r.readNext();
-        if (token == QXmlStreamReader::EndElement &&
-            r.name() == TAG_ENTRY)
-        {
+        const Token token = r.next();
+        if (isEndOf(r, token, Tag::Entry))
             break;
-        }
-
-        if (r.name() == TAG_SEQUENCE_NUMBER) // entry sequence number
-            e.sequenceNumber = r.readElementText();
+        if (token != Token::StartElement)
+            continue;
 
-        if (r.name() == TAG_KANJI_ELEMENT) // kanji element
+        switch (r.tag())
         {
-            const JMdict::Kanji kanji = readKanjiElement(r);
-            e.kanjis.push_back(kanji);
-        }
+            case Tag::SequenceNumber: // entry sequence number
+            {
+                bool ok = false;
+                e.sequenceNumber = r.readElementText().toUInt(&ok);
+                if (!ok)
+                    throw std::runtime_error("Invalid entry sequence number");
+                break;
+            }
 
-        if (r.name() == TAG_READING_ELEMENT) // reading element
-        {
-            const JMdict::Reading reading = readReadingElement(r);
-            e.readings.push_back(reading);
+            case Tag::KanjiElement: // kanji element
+                e.kanjis.push_back(readKanjiElement(r));
+                break;
+
+            case Tag::ReadingElement: // reading element
+                e.readings.push_back(readReadingElement(r));
+                break;
+
+            case Tag::Sense: // sense
+                e.senses.push_back(readSense(r));
+                break;
+
+            default:
+                break;
         }
+    }
 
-        if (r.name() == TAG_SENSE) // sense
+    return e;
+}
+
+/* ---------------------------------------------------------------- *
+   Opens the XML file for reading. Compressed files are
+   decompressed in a worker thread while the previous blocks are
+   parsed.
+ * ---------------------------------------------------------------- */
+class Source
+{
+public:
+    explicit Source(const QString& filePath)
+        : file(filePath)
+    {
+        if (!QFile::exists(filePath))
+            throw std::runtime_error("File does not exits");
+
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+            throw std::runtime_error("Failed to open file");
+
+        const JMdictDecompressor::Format format =
+            JMdictDecompressor::detectFormat(&file);
+        if (format == JMdictDecompressor::Format::Uncompressed)
+            return;
+
+        decompressor = std::make_shared<JMdictDecompressor>(&file, format);
+        if (!decompressor->open(QIODevice::ReadOnly |
+                                QIODevice::Unbuffered))
         {
-            const JMdict::Sense sense = readSense(r);
-            e.senses.push_back(sense);
+            throw std::runtime_error("Failed to decompress file");
         }
     }
 
-    return e;
+    // Returns the device to read the XML from.
+    QIODevice* device()
+    {
+        if (decompressor)
+            return decompressor.get();
+        return &file;
+    }
+
+private:
+    QFile file;
+    std::shared_ptr<JMdictDecompressor> decompressor;
+};
+
+/* ---------------------------------------------------------------- *
+   Maps the tag IDs of the entry into other tag IDs.
+ * ---------------------------------------------------------------- */
+void remapTags(JMdict::Entry& e, const std::vector<JMdict::TagId>& map)
+{
+    auto remap = [&map](std::vector<JMdict::TagId>& ids)
+    {
+        for (JMdict::TagId& id : ids)
+            id = map[id];
+    };
+
+    for (JMdict::Kanji& kanji : e.kanjis)
+        remap(kanji.info);
+
+    for (JMdict::Sense& sense : e.senses)
+    {
+        remap(sense.partOfSpeeches);
+        remap(sense.fieldOfApplications);
+        remap(sense.misc);
+        remap(sense.dialect);
+    }
 }
 
 } // anonymous namespace
@@ -207,34 +308,168 @@ JMdictPtr read(const QString& filePath)
 {
     JMdictPtr out = std::make_shared<JMdict>();
 
-    if (!QFile::exists(filePath))
-        throw std::runtime_error("File does not exits");
+    Source source(filePath);
+    JMdictTokenizer r(source.device());
+    while (!r.atEnd())
+    {
+        const Token token = r.next();
+        if (token == Token::StartElement && r.tag() == Tag::Entry)
+            out->entries.push_back(readEntry(r));
+    }
+
+    if (r.hasError())
+        throw std::runtime_error(r.errorString().toStdString());
 
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly | QFile::Text))
-        throw std::runtime_error("Failed to open file");
+    out->tags.resize(size_t(r.entityCount()));
+    for (int id = 0; id < r.entityCount(); ++id)
+    {
+        out->tags[size_t(id)].name        = r.entityName(id);
+        out->tags[size_t(id)].description = r.entityText(id);
+    }
+    out->buildSequenceNumberIndex();
+    out->buildWordIndex();
 
-    QXmlStreamReader r(&file);
-    while (!r.atEnd() && !r.hasError())
+    return out;
+}
+
+/* ---------------------------------------------------------------- *
+   Updates the dictionary from a newer release of the XML file.
+ * ---------------------------------------------------------------- */
+UpdateReport update(JMdict& dict, const QString& filePath)
+{
+    // Index the current entries and tags.
+    if (dict.sequenceNumberIndex.empty())
+        dict.buildSequenceNumberIndex();
+
+    QHash<QString, JMdict::TagId> tagIds;
+    for (size_t id = 0; id < dict.tags.size(); ++id)
+        tagIds.insert(dict.tags[id].name, JMdict::TagId(id));
+
+    // Diff the release against the current entries. The changes
+    // are collected first so that the dictionary is left untouched
+    // if the release fails to parse.
+    std::vector<JMdict::Tag> newTags;
+    std::vector<JMdict::TagId> tagMap;
+    std::vector<bool> seen(dict.entries.size(), false);
+    std::vector<JMdict::Entry> addedEntries;
+    std::vector<std::pair<size_t, JMdict::Entry>> changedEntries;
+
+    Source source(filePath);
+    JMdictTokenizer r(source.device());
+    while (!r.atEnd())
     {
-        QXmlStreamReader::TokenType token = r.readNext();
-        if(token == QXmlStreamReader::StartDocument)
+        const Token token = r.next();
+        if (token != Token::StartElement || r.tag() != Tag::Entry)
             continue;
 
-        if(token == QXmlStreamReader::StartElement)
+        JMdict::Entry e = readEntry(r);
+
+        // Map the tag IDs of the release into the dictionary.
+        for (int id = int(tagMap.size()); id < r.entityCount(); ++id)
         {
-            if (r.name() == TAG_ENTRY)
+            const QString name = r.entityName(id);
+            auto it = tagIds.constFind(name);
+            if (it == tagIds.constEnd())
             {
-                const JMdict::Entry e = readEntry(r);
-                out->entries.push_back(e);
+                const size_t newId = dict.tags.size() + newTags.size();
+                if (newId > std::numeric_limits<JMdict::TagId>::max())
+                    throw std::runtime_error("Too many entity tags");
+
+                JMdict::Tag tag;
+                tag.name        = name;
+                tag.description = r.entityText(id);
+                newTags.push_back(tag);
+                it = tagIds.insert(name, JMdict::TagId(newId));
             }
+            tagMap.push_back(it.value());
         }
+        remapTags(e, tagMap);
+
+        const int entryIndex = dict.indexOfSequenceNumber(e.sequenceNumber);
+        if (entryIndex < 0)
+        {
+            addedEntries.push_back(std::move(e));
+            continue;
+        }
+
+        const size_t index = size_t(entryIndex);
+        seen[index] = true;
+        if (dict.entries[index] != e)
+            changedEntries.push_back(std::make_pair(index, std::move(e)));
     }
 
     if (r.hasError())
         throw std::runtime_error(r.errorString().toStdString());
 
-    return out;
+    // Check the sequence numbers of the added entries before the
+    // dictionary is touched.
+    for (const JMdict::Entry& e : addedEntries)
+        dict.reserveSequenceNumbers(e.sequenceNumber, e.sequenceNumber);
+
+    // Patch the dictionary and its indexes.
+    UpdateReport report;
+    dict.tags.insert(dict.tags.end(), newTags.begin(), newTags.end());
+
+    for (auto& change : changedEntries)
+    {
+        const qint32 index = qint32(change.first);
+        report.changed.push_back(change.second.sequenceNumber);
+        dict.removeFromIndexes(index);
+        dict.entries[change.first] = std::move(change.second);
+        dict.addToIndexes(index);
+    }
+
+    // A removed entry is replaced by the last entry. The entries are
+    // removed from the last one so the last entry is always a kept
+    // one.
+    for (size_t i = dict.entries.size(); i-- > 0;)
+    {
+        if (seen[i])
+            continue;
+
+        report.removed.push_back(dict.entries[i].sequenceNumber);
+        dict.removeFromIndexes(qint32(i));
+        const size_t last = dict.entries.size() - 1;
+        if (i != last)
+        {
+            dict.removeFromIndexes(qint32(last));
+            dict.entries[i] = std::move(dict.entries[last]);
+            dict.addToIndexes(qint32(i));
+        }
+        dict.entries.pop_back();
+    }
+    std::reverse(report.removed.begin(), report.removed.end());
+
+    for (JMdict::Entry& e : addedEntries)
+    {
+        report.added.push_back(e.sequenceNumber);
+        dict.entries.push_back(std::move(e));
+        dict.addToIndexes(qint32(dict.entries.size() - 1));
+    }
+
+    return report;
+}
+
+/* ---------------------------------------------------------------- *
+   Implementation of UpdateReport streaming operator.
+ * ---------------------------------------------------------------- */
+QDebug operator<<(QDebug debug, const UpdateReport& report)
+{
+    QDebugStateSaver saver(debug);
+    debug.noquote();
+    debug << "JMdict update:"
+          << report.added.size()   << "added,"
+          << report.removed.size() << "removed,"
+          << report.changed.size() << "changed";
+
+    for (const quint32 sequenceNumber : report.added)
+        debug << "\n\tAdded:" << sequenceNumber;
+    for (const quint32 sequenceNumber : report.removed)
+        debug << "\n\tRemoved:" << sequenceNumber;
+    for (const quint32 sequenceNumber : report.changed)
+        debug << "\n\tChanged:" << sequenceNumber;
+
+    return debug;
 }
 
 } // namespace jmdict_parser
@@ -16,9 +16,37 @@ namespace jmdict_parser
 
 /* ---------------------------------------------------------------- *
    Reads the JM dictionary from the XML file at give in file path.
+   The file can be gzip (or xz) compressed, e.g. JMdict_e.gz.
    Throw std::runtime_error if the file path is not valid.
  * ---------------------------------------------------------------- */
 JMdictPtr read(const QString& filePath);
 
+/* ---------------------------------------------------------------- *
+   Describes the changes made by a dictionary update. The entries
+   are identified by their sequence numbers.
+ * ---------------------------------------------------------------- */
+struct UpdateReport
+{
+    std::vector<quint32> added;
+    std::vector<quint32> removed;
+    std::vector<quint32> changed;
+};
+
+/* ---------------------------------------------------------------- *
+   Updates the dictionary from a newer release of the JMdict XML
+   file. The entries are matched by their sequence numbers and
+   only the added, removed and changed entries are touched. The
+   indexes are patched entry by entry. A removed entry is replaced
+   by the last entry so the entry order is not kept. The dictionary
+   is not modified if the file fails to parse.
+   Throws std::runtime_error if the file path is not valid.
+ * ---------------------------------------------------------------- */
+UpdateReport update(JMdict& dict, const QString& filePath);
+
+/* ---------------------------------------------------------------- *
+   Defines streaming operator.
+ * ---------------------------------------------------------------- */
+QDebug operator<<(QDebug debug, const UpdateReport& report);
+
 } // namespace jmdict_parser
 } // namespace kuu
@@ -0,0 +1,173 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::jmdict_protocol namespace.
+ * ---------------------------------------------------------------- */
+
+#include "jmdict_protocol.h"
+#include <QtCore/QDir>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QtEndian>
+
+namespace kuu
+{
+namespace jmdict_protocol
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+// Size of the frame header.
+const int HEADER_SIZE = 4;
+// Name of the local server.
+const char* const SERVER_NAME = "jpad-jmdict";
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Returns the name of the local server of the current user. On
+   Unix the socket file is in the runtime directory that only the
+   user can access so that another user cannot take the name.
+ * ---------------------------------------------------------------- */
+QString serverName()
+{
+#ifndef Q_OS_WIN
+    const QString runtimeDir = QStandardPaths::writableLocation(
+        QStandardPaths::RuntimeLocation);
+    if (!runtimeDir.isEmpty())
+        return QDir(runtimeDir).absoluteFilePath(SERVER_NAME);
+    const QByteArray user = qgetenv("USER");
+#else
+    const QByteArray user = qgetenv("USERNAME");
+#endif
+    return QString(SERVER_NAME) + "-" + QString::fromLocal8Bit(user);
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the frame of the payload.
+ * ---------------------------------------------------------------- */
+QByteArray frame(const QByteArray& payload)
+{
+    QByteArray bytes(HEADER_SIZE, Qt::Uninitialized);
+    qToBigEndian(quint32(payload.size()),
+                 reinterpret_cast<uchar*>(bytes.data()));
+    return bytes + payload;
+}
+
+/* ---------------------------------------------------------------- *
+   Takes the payload of the first complete frame.
+ * ---------------------------------------------------------------- */
+Frame takeFrame(QByteArray& buffer, QByteArray& payload, quint32 maxSize)
+{
+    if (buffer.size() < HEADER_SIZE)
+        return Frame::Incomplete;
+
+    const quint32 size = qFromBigEndian<quint32>(
+        reinterpret_cast<const uchar*>(buffer.constData()));
+    if (size > maxSize)
+        return Frame::TooLarge;
+    if (quint32(buffer.size() - HEADER_SIZE) < size)
+        return Frame::Incomplete;
+
+    payload = buffer.mid(HEADER_SIZE, int(size));
+    buffer.remove(0, HEADER_SIZE + int(size));
+    return Frame::Taken;
+}
+
+/* ---------------------------------------------------------------- *
+   Implementation of the tag and the entry element streaming
+   operators.
+ * ---------------------------------------------------------------- */
+QDataStream& operator<<(QDataStream& stream, const JMdict::Tag& tag)
+{ return stream << tag.name << tag.description; }
+
+QDataStream& operator>>(QDataStream& stream, JMdict::Tag& tag)
+{ return stream >> tag.name >> tag.description; }
+
+QDataStream& operator<<(QDataStream& stream, const JMdict::Kanji& k)
+{
+    stream << k.wordOrPhrase;
+    writeVector(stream, k.info);
+    writeVector(stream, k.priorities);
+    return stream;
+}
+
+QDataStream& operator>>(QDataStream& stream, JMdict::Kanji& k)
+{
+    stream >> k.wordOrPhrase;
+    readVector(stream, k.info);
+    readVector(stream, k.priorities);
+    return stream;
+}
+
+QDataStream& operator<<(QDataStream& stream, const JMdict::Reading& r)
+{
+    stream << r.wordOrPhrase << r.noKanji << r.restriction << r.info;
+    writeVector(stream, r.priorities);
+    return stream;
+}
+
+QDataStream& operator>>(QDataStream& stream, JMdict::Reading& r)
+{
+    stream >> r.wordOrPhrase >> r.noKanji >> r.restriction >> r.info;
+    readVector(stream, r.priorities);
+    return stream;
+}
+
+QDataStream& operator<<(QDataStream& stream,
+                        const JMdict::LoadWordSource& s)
+{ return stream << s.source << s.descFullOrPartial << s.wasei; }
+
+QDataStream& operator>>(QDataStream& stream, JMdict::LoadWordSource& s)
+{ return stream >> s.source >> s.descFullOrPartial >> s.wasei; }
+
+QDataStream& operator<<(QDataStream& stream, const JMdict::Sense& s)
+{
+    writeVector(stream, s.partOfSpeeches);
+    writeVector(stream, s.glosses);
+    writeVector(stream, s.loanwordSources);
+    writeVector(stream, s.fieldOfApplications);
+    writeVector(stream, s.misc);
+    writeVector(stream, s.dialect);
+    writeVector(stream, s.infos);
+    return stream;
+}
+
+QDataStream& operator>>(QDataStream& stream, JMdict::Sense& s)
+{
+    readVector(stream, s.partOfSpeeches);
+    readVector(stream, s.glosses);
+    readVector(stream, s.loanwordSources);
+    readVector(stream, s.fieldOfApplications);
+    readVector(stream, s.misc);
+    readVector(stream, s.dialect);
+    readVector(stream, s.infos);
+    return stream;
+}
+
+/* ---------------------------------------------------------------- *
+   Implementation of the entry streaming operators.
+ * ---------------------------------------------------------------- */
+QDataStream& operator<<(QDataStream& stream, const JMdict::Entry& entry)
+{
+    stream << entry.sequenceNumber;
+    writeVector(stream, entry.kanjis);
+    writeVector(stream, entry.readings);
+    writeVector(stream, entry.senses);
+    return stream;
+}
+
+QDataStream& operator>>(QDataStream& stream, JMdict::Entry& entry)
+{
+    stream >> entry.sequenceNumber;
+    readVector(stream, entry.kanjis);
+    readVector(stream, entry.readings);
+    readVector(stream, entry.senses);
+    return stream;
+}
+
+} // namespace jmdict_protocol
+} // namespace kuu
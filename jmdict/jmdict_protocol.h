@@ -0,0 +1,148 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::jmdict_protocol namespace.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDataStream>
+#include "jmdict.h"
+
+class QIODevice;
+
+namespace kuu
+{
+namespace jmdict_protocol
+{
+
+/* ---------------------------------------------------------------- *
+   The binary protocol of the dictionary server.
+
+   A message is a frame of a 32-bit big-endian payload size and the
+   payload. A request payload starts with the request code and is
+   followed by the arguments. The reply payload holds the results.
+   The payloads are written with QDataStream.
+
+   Request            Arguments                Reply
+   Hello              -                        entry count, longest
+                                               form length, longest
+                                               form lengths by the
+                                               first code unit, tags
+   LongestMatch       text                     length, entry indices
+   KanjiEntries       word                     entry indices
+   Entries            entry indices            count, pairs of entry
+                                               index and entry
+   SearchByReading    reading                  entries
+   SearchByGloss      text, starts with,       entries
+                      ends with
+   SearchByReadingFuzzy
+                      reading                  entries
+   SearchByPattern    pattern                  entries
+   Tokenize           text, with entries       count, triplets of
+                                               position, length and
+                                               entry indices
+
+   A request that cannot be read is not answered and the server
+   closes the connection. A frame larger than the maximum size of a
+   request or a reply closes the connection as well.
+
+   The server socket is private to the user. It is in the runtime
+   directory of the user, or named by the user where the runtime
+   directory is not available.
+ * ---------------------------------------------------------------- */
+enum class Request : quint8
+{
+    Hello,
+    LongestMatch,
+    KanjiEntries,
+    Entries,
+    SearchByReading,
+    SearchByGloss,
+    SearchByReadingFuzzy,
+    SearchByPattern,
+    Tokenize
+};
+
+// Result of taking a frame from a buffer.
+enum class Frame
+{
+    Incomplete,
+    Taken,
+    TooLarge
+};
+
+// Version of the QDataStream format.
+const int STREAM_VERSION = QDataStream::Qt_5_0;
+// Maximum payload sizes of a request and a reply.
+const quint32 MAX_REQUEST_SIZE = 16 * 1024 * 1024;
+const quint32 MAX_REPLY_SIZE   = 256 * 1024 * 1024;
+
+/* ---------------------------------------------------------------- *
+   Returns the name of the local server of the current user.
+ * ---------------------------------------------------------------- */
+QString serverName();
+
+/* ---------------------------------------------------------------- *
+   Returns the frame of the payload.
+ * ---------------------------------------------------------------- */
+QByteArray frame(const QByteArray& payload);
+
+/* ---------------------------------------------------------------- *
+   Takes the payload of the first complete frame from the buffer.
+   A frame with a payload larger than the maximum size is not
+   taken, its size is known from the header before the payload
+   has been received.
+ * ---------------------------------------------------------------- */
+Frame takeFrame(QByteArray& buffer, QByteArray& payload, quint32 maxSize);
+
+/* ---------------------------------------------------------------- *
+   Defines streaming operators of the dictionary entries and tags.
+ * ---------------------------------------------------------------- */
+QDataStream& operator<<(QDataStream& stream, const JMdict::Tag& tag);
+QDataStream& operator>>(QDataStream& stream, JMdict::Tag& tag);
+QDataStream& operator<<(QDataStream& stream, const JMdict::Kanji& kanji);
+QDataStream& operator>>(QDataStream& stream, JMdict::Kanji& kanji);
+QDataStream& operator<<(QDataStream& stream, const JMdict::Reading& reading);
+QDataStream& operator>>(QDataStream& stream, JMdict::Reading& reading);
+QDataStream& operator<<(QDataStream& stream,
+                        const JMdict::LoadWordSource& source);
+QDataStream& operator>>(QDataStream& stream,
+                        JMdict::LoadWordSource& source);
+QDataStream& operator<<(QDataStream& stream, const JMdict::Sense& sense);
+QDataStream& operator>>(QDataStream& stream, JMdict::Sense& sense);
+QDataStream& operator<<(QDataStream& stream, const JMdict::Entry& entry);
+QDataStream& operator>>(QDataStream& stream, JMdict::Entry& entry);
+
+/* ---------------------------------------------------------------- *
+   Writes the vector as its size and the elements.
+ * ---------------------------------------------------------------- */
+template<typename T>
+void writeVector(QDataStream& stream, const std::vector<T>& values)
+{
+    stream << quint32(values.size());
+    for (const T& value : values)
+        stream << value;
+}
+
+/* ---------------------------------------------------------------- *
+   Reads the vector written with writeVector.
+ * ---------------------------------------------------------------- */
+template<typename T>
+void readVector(QDataStream& stream, std::vector<T>& values)
+{
+    quint32 size = 0;
+    stream >> size;
+    values.clear();
+    for (quint32 i = 0; i < size && stream.status() == QDataStream::Ok; ++i)
+    {
+        T value;
+        stream >> value;
+        values.push_back(std::move(value));
+    }
+}
+
+} // namespace jmdict_protocol
+} // namespace kuu
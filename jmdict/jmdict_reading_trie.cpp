@@ -0,0 +1,174 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::JMdictReadingTrie class.
+ * ---------------------------------------------------------------- */
+
+#include "jmdict_reading_trie.h"
+#include <algorithm>
+
+namespace kuu
+{
+
+/* ---------------------------------------------------------------- *
+   Constructs an empty trie.
+ * ---------------------------------------------------------------- */
+JMdictReadingTrie::JMdictReadingTrie()
+    : nodes(1)
+{}
+
+/* ---------------------------------------------------------------- *
+   Builds the trie. The readings are inserted in sorted order so a
+   new child is always the last sibling of its parent.
+ * ---------------------------------------------------------------- */
+JMdictReadingTrie::JMdictReadingTrie(std::vector<QString> readings)
+    : nodes(1)
+    , readings(std::move(readings))
+{
+    std::vector<QString>& words = this->readings;
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+
+    std::vector<qint32> lastChild(1, -1);
+    for (size_t i = 0; i < words.size(); ++i)
+    {
+        qint32 node = 0;
+        for (const QChar c : words[i])
+        {
+            const qint32 last = lastChild[size_t(node)];
+            if (last >= 0 && nodes[size_t(last)].character == c.unicode())
+            {
+                node = last;
+                continue;
+            }
+
+            Node child;
+            child.character = c.unicode();
+            const qint32 index = qint32(nodes.size());
+            nodes.push_back(child);
+            lastChild.push_back(-1);
+
+            if (last >= 0)
+                nodes[size_t(last)].nextSibling = index;
+            else
+                nodes[size_t(node)].firstChild = index;
+            lastChild[size_t(node)] = index;
+            node = index;
+        }
+        nodes[size_t(node)].reading = qint32(i);
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Inserts the reading. A new child is linked into the siblings in
+   ascending character order.
+ * ---------------------------------------------------------------- */
+void JMdictReadingTrie::insert(const QString& reading)
+{
+    qint32 node = 0;
+    for (const QChar c : reading)
+    {
+        qint32 previous = -1;
+        qint32 child = nodes[size_t(node)].firstChild;
+        while (child >= 0 && nodes[size_t(child)].character < c.unicode())
+        {
+            previous = child;
+            child = nodes[size_t(child)].nextSibling;
+        }
+
+        if (child < 0 || nodes[size_t(child)].character != c.unicode())
+        {
+            Node n;
+            n.character = c.unicode();
+            n.nextSibling = child;
+            const qint32 index = qint32(nodes.size());
+            nodes.push_back(n);
+
+            if (previous >= 0)
+                nodes[size_t(previous)].nextSibling = index;
+            else
+                nodes[size_t(node)].firstChild = index;
+            child = index;
+        }
+        node = child;
+    }
+
+    if (nodes[size_t(node)].reading < 0)
+    {
+        nodes[size_t(node)].reading = qint32(readings.size());
+        readings.push_back(reading);
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the readings within the edit distance of the text.
+ * ---------------------------------------------------------------- */
+std::vector<JMdictReadingTrie::Match> JMdictReadingTrie::search(
+    const QString& text, int maxDistance) const
+{
+    // The first row is the distance of the empty prefix.
+    std::vector<std::vector<int>> rows(1);
+    for (int i = 0; i <= text.size(); ++i)
+        rows[0].push_back(i);
+
+    std::vector<Match> matches;
+    if (nodes[0].reading >= 0 && text.size() <= maxDistance)
+        matches.push_back({ readings[size_t(nodes[0].reading)],
+                            text.size() });
+    search(text, maxDistance, 0, 0, rows, matches);
+
+    std::sort(matches.begin(), matches.end(),
+              [](const Match& a, const Match& b)
+    {
+        if (a.distance != b.distance)
+            return a.distance < b.distance;
+        return a.reading < b.reading;
+    });
+    return matches;
+}
+
+/* ---------------------------------------------------------------- *
+   Visits the children of the node. The row of a child is computed
+   from the row of the node.
+ * ---------------------------------------------------------------- */
+void JMdictReadingTrie::search(const QString& text,
+                               int maxDistance,
+                               qint32 node,
+                               int depth,
+                               std::vector<std::vector<int>>& rows,
+                               std::vector<Match>& matches) const
+{
+    const int columns = text.size() + 1;
+    if (rows.size() <= size_t(depth + 1))
+        rows.push_back(std::vector<int>(size_t(columns)));
+
+    for (qint32 child = nodes[size_t(node)].firstChild;
+         child >= 0;
+         child = nodes[size_t(child)].nextSibling)
+    {
+        const Node& n = nodes[size_t(child)];
+        const std::vector<int>& previous = rows[size_t(depth)];
+        std::vector<int>& row = rows[size_t(depth + 1)];
+
+        row[0] = previous[0] + 1;
+        int minimum = row[0];
+        for (int i = 1; i < columns; ++i)
+        {
+            const int substitution =
+                previous[size_t(i - 1)] +
+                (text[i - 1].unicode() == n.character ? 0 : 1);
+            row[size_t(i)] = std::min({ row[size_t(i - 1)] + 1,
+                                        previous[size_t(i)] + 1,
+                                        substitution });
+            minimum = std::min(minimum, row[size_t(i)]);
+        }
+
+        if (n.reading >= 0 && row.back() <= maxDistance)
+            matches.push_back({ readings[size_t(n.reading)], row.back() });
+        if (minimum <= maxDistance)
+            search(text, maxDistance, child, depth + 1, rows, matches);
+    }
+}
+
+} // namespace kuu
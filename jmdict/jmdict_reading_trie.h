@@ -0,0 +1,72 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::JMdictReadingTrie class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <vector>
+#include <QtCore/QString>
+
+namespace kuu
+{
+
+/* ---------------------------------------------------------------- *
+   A trie of the reading forms for approximate lookup. The search
+   walks the trie with one row of the Levenshtein distance table
+   per trie level, which is the Levenshtein automaton of the text
+   run in lockstep with the trie. A branch is pruned as soon as
+   every cell of its row exceeds the maximum distance so only a
+   small part of the trie is visited.
+ * ---------------------------------------------------------------- */
+class JMdictReadingTrie
+{
+public:
+    // A reading within the maximum distance of the searched text.
+    struct Match
+    {
+        QString reading;
+        int distance;
+    };
+
+    // Constructs an empty trie.
+    JMdictReadingTrie();
+    // Builds the trie of the readings.
+    explicit JMdictReadingTrie(std::vector<QString> readings);
+
+    // Inserts the reading into the trie. The readings are not
+    // removed, the caller skips the readings that are no longer in
+    // the dictionary.
+    void insert(const QString& reading);
+
+    // Returns the readings within the edit distance of the text
+    // ordered by the distance and then by the reading.
+    std::vector<Match> search(const QString& text, int maxDistance) const;
+
+private:
+    // A trie node. The children of a node are a linked list of
+    // siblings in ascending character order.
+    struct Node
+    {
+        ushort character = 0;
+        qint32 firstChild = -1;
+        qint32 nextSibling = -1;
+        qint32 reading = -1;
+    };
+
+    // Visits the children of the node with the distance row of the
+    // node.
+    void search(const QString& text,
+                int maxDistance,
+                qint32 node,
+                int depth,
+                std::vector<std::vector<int>>& rows,
+                std::vector<Match>& matches) const;
+
+    std::vector<Node> nodes;
+    std::vector<QString> readings;
+};
+
+} // namespace kuu
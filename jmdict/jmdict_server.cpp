@@ -0,0 +1,390 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::JMdictServer class.
+ * ---------------------------------------------------------------- */
+
+#include "jmdict_server.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <QtNetwork/QLocalServer>
+#include <QtNetwork/QLocalSocket>
+#include "jmdict_protocol.h"
+
+namespace kuu
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+// Time in milliseconds to wait for a running server to answer.
+const int CONNECT_TIMEOUT = 1000;
+
+using jmdict_protocol::Request;
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Private data of the server.
+ * ---------------------------------------------------------------- */
+struct JMdictServer::Impl
+{
+    // A client connection. The bytes are buffered until a request
+    // frame is complete. The complete requests wait in the queue
+    // while a request of the connection is being served.
+    struct Connection
+    {
+        QLocalSocket* socket = nullptr;
+        QByteArray buffer;
+        std::deque<QByteArray> requests;
+        bool serving = false;
+    };
+
+    // A request or a reply of a connection.
+    struct Message
+    {
+        quint64 connection;
+        QByteArray payload;
+    };
+
+    JMdictPtr dictionary;
+    QLocalServer* server = nullptr;
+    std::unordered_map<quint64, Connection> connections;
+    quint64 nextConnection = 0;
+
+    // Requests and replies handed between the server thread and
+    // the worker threads.
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<Message> requests;
+    std::vector<Message> replies;
+    bool stopped = false;
+};
+
+/* ---------------------------------------------------------------- *
+   Constructs the server.
+ * ---------------------------------------------------------------- */
+JMdictServer::JMdictServer(JMdictPtr dictionary, QObject* parent)
+    : QObject(parent)
+    , impl(std::make_shared<Impl>())
+{
+    impl->dictionary = dictionary;
+    impl->server = new QLocalServer(this);
+    // Only the user of the server can connect.
+    impl->server->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(impl->server, &QLocalServer::newConnection,
+            this, &JMdictServer::onNewConnection);
+
+    const unsigned workerCount =
+        std::max(2u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < workerCount; ++i)
+        impl->workers.push_back(
+            std::thread(&JMdictServer::serveRequests, this));
+}
+
+/* ---------------------------------------------------------------- *
+   Stops the worker threads. The replies that are not sent yet are
+   dropped.
+ * ---------------------------------------------------------------- */
+JMdictServer::~JMdictServer()
+{
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        impl->stopped = true;
+        impl->condition.notify_all();
+    }
+    for (std::thread& worker : impl->workers)
+        worker.join();
+}
+
+/* ---------------------------------------------------------------- *
+   Starts listening. A socket file left by a crashed server is
+   removed.
+ * ---------------------------------------------------------------- */
+void JMdictServer::listen(const QString& serverName)
+{
+    QLocalSocket socket;
+    socket.connectToServer(serverName);
+    if (socket.waitForConnected(CONNECT_TIMEOUT))
+        throw std::runtime_error(
+            "The dictionary server " + serverName.toStdString() +
+            " is already running");
+
+    QLocalServer::removeServer(serverName);
+    if (!impl->server->listen(serverName))
+        throw std::runtime_error(
+            impl->server->errorString().toStdString());
+}
+
+/* ---------------------------------------------------------------- *
+   Serves the new connections.
+ * ---------------------------------------------------------------- */
+void JMdictServer::onNewConnection()
+{
+    while (QLocalSocket* socket = impl->server->nextPendingConnection())
+    {
+        const quint64 connection = impl->nextConnection++;
+        impl->connections[connection].socket = socket;
+
+        connect(socket, &QLocalSocket::readyRead,
+                this, [this, connection]()
+        {
+            readRequests(connection);
+        });
+        connect(socket, &QLocalSocket::disconnected,
+                this, [this, connection, socket]()
+        {
+            impl->connections.erase(connection);
+            socket->deleteLater();
+        });
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Writes the replies of the worker threads to the connections that
+   are still open and serves their next requests. An empty reply
+   closes the connection.
+ * ---------------------------------------------------------------- */
+void JMdictServer::sendReplies()
+{
+    std::vector<Message> replies;
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        replies.swap(impl->replies);
+    }
+
+    for (const Message& message : replies)
+    {
+        auto it = impl->connections.find(message.connection);
+        if (it == impl->connections.end())
+            continue;
+
+        Impl::Connection& connection = it->second;
+        connection.serving = false;
+        if (message.payload.isEmpty())
+        {
+            connection.socket->disconnectFromServer();
+            continue;
+        }
+        connection.socket->write(jmdict_protocol::frame(message.payload));
+        serveNext(message.connection);
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Reads the complete request frames of the connection into its
+   queue. A request larger than the maximum closes the connection.
+ * ---------------------------------------------------------------- */
+void JMdictServer::readRequests(quint64 connection)
+{
+    auto it = impl->connections.find(connection);
+    if (it == impl->connections.end())
+        return;
+
+    Impl::Connection& c = it->second;
+    c.buffer += c.socket->readAll();
+
+    QByteArray payload;
+    for (;;)
+    {
+        const jmdict_protocol::Frame status = jmdict_protocol::takeFrame(
+            c.buffer, payload, jmdict_protocol::MAX_REQUEST_SIZE);
+        if (status == jmdict_protocol::Frame::Incomplete)
+            break;
+        if (status == jmdict_protocol::Frame::TooLarge)
+        {
+            c.socket->disconnectFromServer();
+            return;
+        }
+        c.requests.push_back(payload);
+    }
+    serveNext(connection);
+}
+
+/* ---------------------------------------------------------------- *
+   Hands the next request of the connection to the workers.
+ * ---------------------------------------------------------------- */
+void JMdictServer::serveNext(quint64 connection)
+{
+    auto it = impl->connections.find(connection);
+    if (it == impl->connections.end())
+        return;
+
+    Impl::Connection& c = it->second;
+    if (c.serving || c.requests.empty())
+        return;
+
+    c.serving = true;
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    impl->requests.push_back({ connection, std::move(c.requests.front()) });
+    c.requests.pop_front();
+    impl->condition.notify_one();
+}
+
+/* ---------------------------------------------------------------- *
+   Serves the requests in a worker thread. The server thread is
+   notified when the first reply is ready.
+ * ---------------------------------------------------------------- */
+void JMdictServer::serveRequests()
+{
+    std::unique_lock<std::mutex> lock(impl->mutex);
+    for (;;)
+    {
+        impl->condition.wait(lock, [&]()
+        {
+            return !impl->requests.empty() || impl->stopped;
+        });
+        if (impl->stopped)
+            return;
+
+        Impl::Message request = std::move(impl->requests.front());
+        impl->requests.pop_front();
+        lock.unlock();
+        Impl::Message message = { request.connection,
+                                  reply(request.payload) };
+        lock.lock();
+
+        impl->replies.push_back(std::move(message));
+        if (impl->replies.size() == 1)
+            QMetaObject::invokeMethod(this, "sendReplies",
+                                      Qt::QueuedConnection);
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the reply of the request. Called in the worker threads.
+ * ---------------------------------------------------------------- */
+QByteArray JMdictServer::reply(const QByteArray& payload) const
+{
+    const JMdict& dict = *impl->dictionary;
+
+    QDataStream in(payload);
+    in.setVersion(jmdict_protocol::STREAM_VERSION);
+    quint8 request = 0;
+    in >> request;
+
+    QByteArray replyPayload;
+    QDataStream out(&replyPayload, QIODevice::WriteOnly);
+    out.setVersion(jmdict_protocol::STREAM_VERSION);
+
+    switch (Request(request))
+    {
+        case Request::Hello:
+        {
+            out << quint32(dict.entries.size())
+                << qint32(dict.maxWordLength);
+            jmdict_protocol::writeVector(out, dict.maxWordLengthByFirst);
+            jmdict_protocol::writeVector(out, dict.tags);
+            break;
+        }
+
+        case Request::LongestMatch:
+        {
+            QString text;
+            in >> text;
+            std::vector<qint32> indices;
+            const int length = dict.longestMatch(text, 0, &indices);
+            out << qint32(length);
+            jmdict_protocol::writeVector(out, indices);
+            break;
+        }
+
+        case Request::KanjiEntries:
+        {
+            QString word;
+            in >> word;
+            jmdict_protocol::writeVector(out, dict.kanjiEntries(word));
+            break;
+        }
+
+        case Request::Entries:
+        {
+            std::vector<qint32> indices;
+            jmdict_protocol::readVector(in, indices);
+
+            std::vector<qint32> valid;
+            for (const qint32 index : indices)
+                if (index >= 0 && size_t(index) < dict.entries.size())
+                    valid.push_back(index);
+
+            out << quint32(valid.size());
+            for (const qint32 index : valid)
+            {
+                out << index;
+                jmdict_protocol::operator<<(
+                    out, dict.entries[size_t(index)]);
+            }
+            break;
+        }
+
+        case Request::SearchByReading:
+        {
+            QString text;
+            in >> text;
+            jmdict_protocol::writeVector(out, dict.searchByReading(text));
+            break;
+        }
+
+        case Request::SearchByReadingFuzzy:
+        {
+            QString text;
+            in >> text;
+            jmdict_protocol::writeVector(
+                out, dict.searchByReadingFuzzy(text));
+            break;
+        }
+
+        case Request::SearchByPattern:
+        {
+            QString pattern;
+            in >> pattern;
+            jmdict_protocol::writeVector(out, dict.searchByPattern(pattern));
+            break;
+        }
+
+        case Request::SearchByGloss:
+        {
+            QString text;
+            bool startsWith = false;
+            bool endsWith = false;
+            in >> text >> startsWith >> endsWith;
+            jmdict_protocol::writeVector(
+                out, dict.searchByGloss(text, startsWith, endsWith));
+            break;
+        }
+
+        case Request::Tokenize:
+        {
+            QString text;
+            bool withEntries = false;
+            in >> text >> withEntries;
+            const std::vector<JMdict::Token> tokens =
+                dict.tokenize(text, withEntries);
+            out << quint32(tokens.size());
+            for (const JMdict::Token& token : tokens)
+            {
+                out << qint32(token.position) << qint32(token.length);
+                jmdict_protocol::writeVector(out, token.entries);
+            }
+            break;
+        }
+
+        default:
+            return QByteArray();
+    }
+
+    if (in.status() != QDataStream::Ok)
+        return QByteArray();
+    return replyPayload;
+}
+
+} // namespace kuu
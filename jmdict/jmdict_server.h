@@ -0,0 +1,63 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::JMdictServer class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <memory>
+#include <QtCore/QObject>
+#include "jmdict.h"
+
+namespace kuu
+{
+
+/* ---------------------------------------------------------------- *
+   A local server of the dictionary. The editors attach to the
+   server with JMdictClient so that the dictionary is loaded once
+   per user. Only the user who runs the server can connect. The
+   connections are read and written in the event loop of the thread
+   of the server and the requests are served by worker threads so
+   that a slow search does not hold up the lookups of the other
+   connections. The requests of a connection are served in order.
+   The dictionary must not be modified while it is served.
+ * ---------------------------------------------------------------- */
+class JMdictServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Constructs the server of the dictionary.
+    explicit JMdictServer(JMdictPtr dictionary, QObject* parent = nullptr);
+    // Stops the worker threads.
+    ~JMdictServer();
+
+    // Starts listening to the named local socket. Throws
+    // std::runtime_error if another server is running or the socket
+    // cannot be listened.
+    void listen(const QString& serverName);
+
+private slots:
+    void onNewConnection();
+    // Writes the replies of the worker threads.
+    void sendReplies();
+
+private:
+    // Reads the request frames of the connection.
+    void readRequests(quint64 connection);
+    // Hands the next request of the connection to the workers if
+    // the connection is not waiting for a reply.
+    void serveNext(quint64 connection);
+    // Serves the requests in a worker thread.
+    void serveRequests();
+    // Returns the reply of the request payload or an empty reply if
+    // the request is malformed.
+    QByteArray reply(const QByteArray& payload) const;
+
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace kuu
@@ -0,0 +1,859 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::JMdictTokenizer class.
+
+   See:
+   http://www.edrdg.org/jmdict/jmdict_dtd_h.html
+ * ---------------------------------------------------------------- */
+
+#include "jmdict_tokenizer.h"
+
+#include <cstring>
+#include <vector>
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QIODevice>
+
+namespace kuu
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+const int BLOCK_SIZE = 1 << 20;
+
+/* ---------------------------------------------------------------- *
+   Returns true if the byte is an XML whitespace.
+ * ---------------------------------------------------------------- */
+inline bool isSpace(char c)
+{ return c == ' ' || c == '\n' || c == '\t' || c == '\r'; }
+
+/* ---------------------------------------------------------------- *
+   Returns true if the name starts with the literal.
+ * ---------------------------------------------------------------- */
+template<int N>
+inline bool equals(const char* name, const char (&literal)[N])
+{ return std::memcmp(name, literal, N - 1) == 0; }
+
+/* ---------------------------------------------------------------- *
+   Maps the tag name into tag enumeration. The name is first
+   dispatched by its length and then by its first characters so
+   that at most one string comparison is done per tag.
+ * ---------------------------------------------------------------- */
+JMdictTokenizer::Tag tagFromName(const char* n, int length)
+{
+    using Tag = JMdictTokenizer::Tag;
+    switch (length)
+    {
+        case 3:
+            switch (n[0])
+            {
+                case 'k': if (equals(n, "keb")) return Tag::KanjiPhrase;   break;
+                case 'r': if (equals(n, "reb")) return Tag::ReadingPhrase; break;
+                case 'p':
+                    if (equals(n, "pos")) return Tag::PartOfSpeech;
+                    if (equals(n, "pri")) return Tag::GlossPriority;
+                    break;
+                case 'a': if (equals(n, "ant")) return Tag::Antonym;       break;
+            }
+            break;
+
+        case 4:
+            switch (n[0])
+            {
+                case 'x': if (equals(n, "xref")) return Tag::CrossReference; break;
+                case 'm': if (equals(n, "misc")) return Tag::Misc;           break;
+                case 'd': if (equals(n, "dial")) return Tag::Dialect;        break;
+            }
+            break;
+
+        case 5:
+            switch (n[0])
+            {
+                case 'e': if (equals(n, "entry")) return Tag::Entry;              break;
+                case 'k': if (equals(n, "k_ele")) return Tag::KanjiElement;       break;
+                case 'r': if (equals(n, "r_ele")) return Tag::ReadingElement;     break;
+                case 'f': if (equals(n, "field")) return Tag::FieldOfApplication; break;
+                case 'g': if (equals(n, "gloss")) return Tag::Gloss;              break;
+                case 's':
+                    if (equals(n, "sense")) return Tag::Sense;
+                    if (equals(n, "s_inf")) return Tag::Info;
+                    if (equals(n, "stagk")) return Tag::KanjiSenseRestriction;
+                    if (equals(n, "stagr")) return Tag::ReadingSenseRestriction;
+                    break;
+            }
+            break;
+
+        case 6:
+            switch (n[0])
+            {
+                case 'J': if (equals(n, "JMdict")) return Tag::JMdict; break;
+                case 'k':
+                    if (equals(n, "ke_inf")) return Tag::KanjiInfo;
+                    if (equals(n, "ke_pri")) return Tag::KanjiPriority;
+                    break;
+                case 'r':
+                    if (equals(n, "re_inf")) return Tag::ReadingInfo;
+                    if (equals(n, "re_pri")) return Tag::ReadingPriority;
+                    break;
+            }
+            break;
+
+        case 7:
+            if (equals(n, "ent_seq")) return Tag::SequenceNumber;
+            if (equals(n, "lsource")) return Tag::LoanwordSource;
+            break;
+
+        case 8:
+            if (equals(n, "re_restr")) return Tag::ReadingRestriction;
+            break;
+
+        case 10:
+            if (equals(n, "re_nokanji")) return Tag::ReadingNoKanji;
+            break;
+    }
+
+    return Tag::Unknown;
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Private data of the tokenizer.
+
+   All the offsets used while scanning a token are relative to the
+   mark. When the scanner runs out of data the bytes starting from
+   the mark are moved to the beginning of the buffer and the next
+   block is read from the device after them.
+ * ---------------------------------------------------------------- */
+struct JMdictTokenizer::Impl
+{
+    // Sets the error and returns the invalid token.
+    Token setError(const QString& err)
+    {
+        if (error.isEmpty())
+            error = err;
+        token = Token::Invalid;
+        return token;
+    }
+
+    // Moves the data starting from the mark into beginning of the
+    // buffer and reads the next block from the device. Returns
+    // false if there is no more data.
+    bool fill()
+    {
+        if (eof)
+            return false;
+
+        if (mark > 0)
+        {
+            char* d = buffer.data();
+            std::memmove(d, d + mark, size_t(end - mark));
+            end -= mark;
+            pos -= mark;
+            mark = 0;
+        }
+
+        if (buffer.size() - end < BLOCK_SIZE)
+            buffer.resize(end + BLOCK_SIZE);
+
+        const qint64 count = device->read(buffer.data() + end,
+                                          buffer.size() - end);
+        if (count <= 0)
+        {
+            if (count < 0)
+                setError(device->errorString());
+            eof = true;
+            return false;
+        }
+
+        end += int(count);
+        return true;
+    }
+
+    // Makes sure that there are at least count bytes after the
+    // mark in the buffer.
+    bool ensure(int count)
+    {
+        while (end - mark < count)
+            if (!fill())
+                return false;
+        return true;
+    }
+
+    // Returns the byte at offset.
+    char at(int offset) const
+    { return buffer.constData()[mark + offset]; }
+
+    // Returns true if the bytes at offset are the given bytes.
+    bool startsWith(int offset, const char* bytes, int length)
+    {
+        return ensure(offset + length) &&
+               std::memcmp(buffer.constData() + mark + offset,
+                           bytes, size_t(length)) == 0;
+    }
+
+    // Returns the offset of the next byte starting from the offset
+    // or -1 if the byte was not found.
+    int find(char c, int from)
+    {
+        for (;;)
+        {
+            if (mark + from < end)
+            {
+                const char* d = buffer.constData();
+                const void* p = std::memchr(d + mark + from, c,
+                                            size_t(end - mark - from));
+                if (p)
+                    return int(static_cast<const char*>(p) - d) - mark;
+            }
+
+            from = qMax(from, end - mark);
+            if (!fill())
+                return -1;
+        }
+    }
+
+    // Returns the offset of the next byte sequence starting from
+    // the offset or -1 if the sequence was not found.
+    int find(const char* bytes, int length, int from)
+    {
+        for (;;)
+        {
+            const int i = find(bytes[0], from);
+            if (i < 0)
+                return -1;
+            if (startsWith(i, bytes, length))
+                return i;
+            if (end - mark < i + length)
+                return -1;
+            from = i + 1;
+        }
+    }
+
+    // Returns the offset of the end of markup declaration. Quoted
+    // strings may contain '>' characters.
+    int findDeclarationEnd(int from)
+    {
+        char quote = 0;
+        for (int i = from;; ++i)
+        {
+            if (!ensure(i + 1))
+                return -1;
+
+            const char c = at(i);
+            if (quote)
+            {
+                if (c == quote)
+                    quote = 0;
+            }
+            else if (c == '"' || c == '\'')
+                quote = c;
+            else if (c == '>')
+                return i;
+        }
+    }
+
+    // Appends the replacement text of the entity into string.
+    void appendEntity(QString& out, const char* name, int length)
+    {
+        if (length > 1 && name[0] == '#')
+        {
+            bool ok = false;
+            uint code = 0;
+            if (name[1] == 'x')
+                code = QByteArray(name + 2, length - 2).toUInt(&ok, 16);
+            else
+                code = QByteArray(name + 1, length - 1).toUInt(&ok, 10);
+
+            if (!ok)
+            {
+                setError("Invalid character reference");
+                return;
+            }
+
+            out += QString::fromUcs4(&code, 1);
+            return;
+        }
+
+        const QByteArray key = QByteArray::fromRawData(name, length);
+        if      (key == "lt")   out += QLatin1Char('<');
+        else if (key == "gt")   out += QLatin1Char('>');
+        else if (key == "amp")  out += QLatin1Char('&');
+        else if (key == "quot") out += QLatin1Char('"');
+        else if (key == "apos") out += QLatin1Char('\'');
+        else
+        {
+            const auto it = entityIds.constFind(key);
+            if (it == entityIds.constEnd())
+            {
+                setError(QString("Undeclared entity %1")
+                            .arg(QString::fromUtf8(name, length)));
+                return;
+            }
+            out += entityTexts[size_t(it.value())];
+        }
+    }
+
+    // Decodes UTF-8 character data and expands entity references.
+    QString decode(const char* p, int length)
+    {
+        const char* e = p + length;
+        const char* amp = static_cast<const char*>(
+            std::memchr(p, '&', size_t(length)));
+        if (!amp)
+            return QString::fromUtf8(p, length);
+
+        QString out;
+        out.reserve(length);
+        while (amp)
+        {
+            out += QString::fromUtf8(p, int(amp - p));
+
+            const char* semicolon = static_cast<const char*>(
+                std::memchr(amp, ';', size_t(e - amp)));
+            if (!semicolon)
+            {
+                setError("Unterminated entity reference");
+                return out;
+            }
+
+            appendEntity(out, amp + 1, int(semicolon - amp - 1));
+            p = semicolon + 1;
+            amp = static_cast<const char*>(
+                std::memchr(p, '&', size_t(e - p)));
+        }
+        out += QString::fromUtf8(p, int(e - p));
+        return out;
+    }
+
+    // Reads the entity declaration between the offsets.
+    void readEntityDeclaration(int from, int to)
+    {
+        const QByteArray decl(buffer.constData() + mark + from,
+                              to - from);
+        const char* d = decl.constData();
+        const int n = decl.size();
+
+        int i = 0;
+        while (i < n && isSpace(d[i]))
+            ++i;
+        if (i >= n || d[i] == '%') // parameter entity
+            return;
+
+        const int nameBegin = i;
+        while (i < n && !isSpace(d[i]))
+            ++i;
+        const QByteArray name = decl.mid(nameBegin, i - nameBegin);
+
+        while (i < n && isSpace(d[i]))
+            ++i;
+        if (i >= n || (d[i] != '"' && d[i] != '\'')) // external entity
+            return;
+
+        const int valueEnd = decl.indexOf(d[i], i + 1);
+        if (valueEnd < 0)
+            return;
+
+        if (entityIds.contains(name)) // first declaration binds
+            return;
+
+        entityIds.insert(name, int(entityNames.size()));
+        entityNames.push_back(QString::fromUtf8(name));
+        entityTexts.push_back(decode(d + i + 1, valueEnd - i - 1));
+    }
+
+    // Reads the DOCTYPE declaration and the entities of its
+    // internal DTD subset.
+    bool readDoctype()
+    {
+        int i = 9; // <!DOCTYPE
+        for (;; ++i)
+        {
+            if (!ensure(i + 1))
+                return false;
+            const char c = at(i);
+            if (c == '>')
+            {
+                pos = mark + i + 1;
+                return true;
+            }
+            if (c == '[')
+                break;
+        }
+
+        ++i;
+        for (;;)
+        {
+            if (!ensure(i + 1))
+                return false;
+
+            const char c = at(i);
+            if (isSpace(c))
+            {
+                ++i;
+                continue;
+            }
+
+            if (c == ']')
+            {
+                const int gt = find('>', i + 1);
+                if (gt < 0)
+                    return false;
+                pos = mark + gt + 1;
+                return true;
+            }
+
+            if (c == '%') // parameter entity reference
+            {
+                const int semicolon = find(';', i + 1);
+                if (semicolon < 0)
+                    return false;
+                i = semicolon + 1;
+                continue;
+            }
+
+            if (c != '<')
+                return false;
+
+            if (startsWith(i, "<!--", 4))
+            {
+                const int commentEnd = find("-->", 3, i + 4);
+                if (commentEnd < 0)
+                    return false;
+                i = commentEnd + 3;
+                continue;
+            }
+
+            const int gt = findDeclarationEnd(i + 1);
+            if (gt < 0)
+                return false;
+            if (startsWith(i, "<!ENTITY", 8))
+                readEntityDeclaration(i + 8, gt);
+            i = gt + 1;
+        }
+    }
+
+    // Skips the comment, CDATA section or DOCTYPE at the mark.
+    bool skipDeclaration()
+    {
+        if (startsWith(2, "--", 2))
+        {
+            const int i = find("-->", 3, 4);
+            if (i < 0)
+                return false;
+            pos = mark + i + 3;
+            return true;
+        }
+
+        if (startsWith(2, "[CDATA[", 7))
+        {
+            const int i = find("]]>", 3, 9);
+            if (i < 0)
+                return false;
+            pos = mark + i + 3;
+            return true;
+        }
+
+        if (startsWith(2, "DOCTYPE", 7))
+            return readDoctype();
+
+        const int i = findDeclarationEnd(2);
+        if (i < 0)
+            return false;
+        pos = mark + i + 1;
+        return true;
+    }
+
+    // Skips the processing instruction at the mark.
+    bool skipProcessingInstruction()
+    {
+        const int i = find("?>", 2, 2);
+        if (i < 0)
+            return false;
+        pos = mark + i + 2;
+        return true;
+    }
+
+    // Reads the end element at the mark.
+    Token readEndElement()
+    {
+        const int gt = find('>', 2);
+        if (gt < 0)
+            return setError("Premature end of document");
+
+        const char* d = buffer.constData() + mark;
+        int nameEnd = 2;
+        while (nameEnd < gt && !isSpace(d[nameEnd]))
+            ++nameEnd;
+
+        tag   = tagFromName(d + 2, nameEnd - 2);
+        pos   = mark + gt + 1;
+        token = Token::EndElement;
+        --depth;
+        return token;
+    }
+
+    // Reads the start element at the mark.
+    Token readStartElement()
+    {
+        const int gt = find('>', 1);
+        if (gt < 0)
+            return setError("Premature end of document");
+
+        const char* d = buffer.constData() + mark;
+        int nameEnd = 1;
+        while (nameEnd < gt && !isSpace(d[nameEnd]) && d[nameEnd] != '/')
+            ++nameEnd;
+
+        tag = tagFromName(d + 1, nameEnd - 1);
+        emptyElement = d[gt - 1] == '/';
+
+        const int attributesEnd = emptyElement ? gt - 1 : gt;
+        if (attributesEnd > nameEnd)
+            attributes = QByteArray(d + nameEnd, attributesEnd - nameEnd);
+        else
+            attributes.clear();
+
+        pos   = mark + gt + 1;
+        token = Token::StartElement;
+        if (!emptyElement)
+            ++depth;
+        return token;
+    }
+
+    // Reads the next token.
+    Token next()
+    {
+        if (token == Token::EndDocument || !error.isEmpty())
+            return token;
+
+        if (emptyElement)
+        {
+            emptyElement = false;
+            token = Token::EndElement;
+            return token;
+        }
+
+        for (;;)
+        {
+            mark = pos;
+            const int lt = find('<', 0);
+            if (lt < 0)
+            {
+                if (!error.isEmpty() || depth > 0)
+                    return setError("Premature end of document");
+                token = Token::EndDocument;
+                return token;
+            }
+
+            mark += lt;
+            pos = mark;
+            if (!ensure(2))
+                return setError("Premature end of document");
+
+            switch (at(1))
+            {
+                case '/':
+                    return readEndElement();
+
+                case '!':
+                    if (!skipDeclaration())
+                        return setError("Invalid markup declaration");
+                    break;
+
+                case '?':
+                    if (!skipProcessingInstruction())
+                        return setError("Invalid processing instruction");
+                    break;
+
+                default:
+                    return readStartElement();
+            }
+        }
+    }
+
+    // Reads the text of the current start element.
+    QString readElementText()
+    {
+        if (token != Token::StartElement)
+            return QString();
+
+        if (emptyElement)
+        {
+            emptyElement = false;
+            token = Token::EndElement;
+            return QString();
+        }
+
+        QString out;
+        int level = 0;
+        for (;;)
+        {
+            mark = pos;
+            const int lt = find('<', 0);
+            if (lt < 0)
+            {
+                setError("Premature end of document");
+                return out;
+            }
+
+            if (lt > 0)
+            {
+                if (out.isEmpty())
+                    out = decode(buffer.constData() + mark, lt);
+                else
+                    out += decode(buffer.constData() + mark, lt);
+            }
+
+            mark += lt;
+            pos = mark;
+            if (!ensure(2))
+            {
+                setError("Premature end of document");
+                return out;
+            }
+
+            const char c = at(1);
+            if (c == '/')
+            {
+                if (readEndElement() == Token::Invalid || level == 0)
+                    return out;
+                --level;
+            }
+            else if (c == '!')
+            {
+                if (startsWith(2, "[CDATA[", 7))
+                {
+                    const int i = find("]]>", 3, 9);
+                    if (i < 0)
+                    {
+                        setError("Unterminated CDATA section");
+                        return out;
+                    }
+                    out += QString::fromUtf8(
+                        buffer.constData() + mark + 9, i - 9);
+                    pos = mark + i + 3;
+                }
+                else if (!skipDeclaration())
+                {
+                    setError("Invalid markup declaration");
+                    return out;
+                }
+            }
+            else if (c == '?')
+            {
+                if (!skipProcessingInstruction())
+                {
+                    setError("Invalid processing instruction");
+                    return out;
+                }
+            }
+            else
+            {
+                if (readStartElement() == Token::Invalid)
+                    return out;
+                if (emptyElement)
+                    emptyElement = false;
+                else
+                    ++level;
+            }
+        }
+    }
+
+    // Reads the text of the current start element as an entity ID.
+    int readElementEntity()
+    {
+        if (token != Token::StartElement || emptyElement)
+            return internText(readElementText());
+
+        // Fast path: <pos>&v5k;</pos>
+        mark = pos;
+        const int lt = find('<', 0);
+        if (lt > 2 && at(0) == '&' && at(lt - 1) == ';' &&
+            startsWith(lt, "</", 2))
+        {
+            const char* name = buffer.constData() + mark + 1;
+            const QByteArray key = QByteArray::fromRawData(name, lt - 2);
+            const auto it = entityIds.constFind(key);
+            if (it != entityIds.constEnd() &&
+                !std::memchr(name, '&', size_t(lt - 2)))
+            {
+                const int id = it.value();
+                mark += lt;
+                pos = mark;
+                readEndElement();
+                return id;
+            }
+        }
+
+        return internText(readElementText());
+    }
+
+    // Returns the ID of text that is not an entity reference.
+    int internText(const QString& text)
+    {
+        const auto it = textIds.constFind(text);
+        if (it != textIds.constEnd())
+            return it.value();
+
+        const int id = int(entityNames.size());
+        textIds.insert(text, id);
+        entityNames.push_back(text);
+        entityTexts.push_back(text);
+        return id;
+    }
+
+    // Returns the value of the attribute of the current element.
+    QString attribute(const char* name)
+    {
+        const int nameLength = int(std::strlen(name));
+        const char* d = attributes.constData();
+        const int n = attributes.size();
+
+        int i = 0;
+        while (i < n)
+        {
+            while (i < n && isSpace(d[i]))
+                ++i;
+            const int nameBegin = i;
+            while (i < n && d[i] != '=' && !isSpace(d[i]))
+                ++i;
+            const int nameEnd = i;
+            while (i < n && d[i] != '"' && d[i] != '\'')
+                ++i;
+            if (i >= n)
+                break;
+
+            const char quote = d[i++];
+            const int valueBegin = i;
+            while (i < n && d[i] != quote)
+                ++i;
+
+            if (nameEnd - nameBegin == nameLength &&
+                std::memcmp(d + nameBegin, name, size_t(nameLength)) == 0)
+            {
+                return decode(d + valueBegin, i - valueBegin);
+            }
+            ++i;
+        }
+
+        return QString();
+    }
+
+    QIODevice* device = nullptr;
+
+    QByteArray buffer;
+    int mark = 0;
+    int pos  = 0;
+    int end  = 0;
+    bool eof = false;
+
+    Token token = Token::Invalid;
+    Tag tag = Tag::Unknown;
+    QByteArray attributes;
+    bool emptyElement = false;
+    int depth = 0;
+
+    QHash<QByteArray, int> entityIds;
+    QHash<QString, int> textIds;
+    std::vector<QString> entityNames;
+    std::vector<QString> entityTexts;
+    QString error;
+};
+
+/* ---------------------------------------------------------------- *
+   Constructs the tokenizer.
+ * ---------------------------------------------------------------- */
+JMdictTokenizer::JMdictTokenizer(QIODevice* device)
+    : impl(std::make_shared<Impl>())
+{
+    impl->device = device;
+    impl->buffer.resize(2 * BLOCK_SIZE);
+
+    // Skip the UTF-8 byte order mark.
+    if (impl->startsWith(0, "\xEF\xBB\xBF", 3))
+        impl->pos = 3;
+}
+
+/* ---------------------------------------------------------------- *
+   Reads the next token.
+ * ---------------------------------------------------------------- */
+JMdictTokenizer::Token JMdictTokenizer::next()
+{ return impl->next(); }
+
+/* ---------------------------------------------------------------- *
+   Returns the current token.
+ * ---------------------------------------------------------------- */
+JMdictTokenizer::Token JMdictTokenizer::token() const
+{ return impl->token; }
+
+/* ---------------------------------------------------------------- *
+   Returns the current tag.
+ * ---------------------------------------------------------------- */
+JMdictTokenizer::Tag JMdictTokenizer::tag() const
+{ return impl->tag; }
+
+/* ---------------------------------------------------------------- *
+   Reads the text of the current start element.
+ * ---------------------------------------------------------------- */
+QString JMdictTokenizer::readElementText()
+{ return impl->readElementText(); }
+
+/* ---------------------------------------------------------------- *
+   Reads the text of the current start element as an entity ID.
+ * ---------------------------------------------------------------- */
+int JMdictTokenizer::readElementEntity()
+{ return impl->readElementEntity(); }
+
+/* ---------------------------------------------------------------- *
+   Returns the number of entities.
+ * ---------------------------------------------------------------- */
+int JMdictTokenizer::entityCount() const
+{ return int(impl->entityNames.size()); }
+
+/* ---------------------------------------------------------------- *
+   Returns the name of the entity.
+ * ---------------------------------------------------------------- */
+QString JMdictTokenizer::entityName(int id) const
+{ return impl->entityNames[size_t(id)]; }
+
+/* ---------------------------------------------------------------- *
+   Returns the replacement text of the entity.
+ * ---------------------------------------------------------------- */
+QString JMdictTokenizer::entityText(int id) const
+{ return impl->entityTexts[size_t(id)]; }
+
+/* ---------------------------------------------------------------- *
+   Returns the value of the attribute of the current element.
+ * ---------------------------------------------------------------- */
+QString JMdictTokenizer::attribute(const char* name) const
+{ return impl->attribute(name); }
+
+/* ---------------------------------------------------------------- *
+   Returns true if the end of the document is reached or an
+   error has occurred.
+ * ---------------------------------------------------------------- */
+bool JMdictTokenizer::atEnd() const
+{
+    return impl->token == Token::EndDocument ||
+           !impl->error.isEmpty();
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if an error has occurred.
+ * ---------------------------------------------------------------- */
+bool JMdictTokenizer::hasError() const
+{ return !impl->error.isEmpty(); }
+
+/* ---------------------------------------------------------------- *
+   Returns the error description.
+ * ---------------------------------------------------------------- */
+QString JMdictTokenizer::errorString() const
+{ return impl->error; }
+
+} // namespace kuu
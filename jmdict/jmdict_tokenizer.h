@@ -0,0 +1,124 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::JMdictTokenizer class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <memory>
+#include <QtCore/QString>
+
+class QIODevice;
+
+namespace kuu
+{
+
+/* ---------------------------------------------------------------- *
+   A streaming tokenizer for the XML subset used by JMdict files.
+
+   The tokenizer reads raw UTF-8 bytes from the device in large
+   blocks and splits them into start and end element tokens. Tag
+   names are mapped into Tag enumeration with a switch so that the
+   parser never needs to compare strings. Character data between
+   the elements is skipped unless it is read with readElementText()
+   in which case it is decoded directly from the byte buffer.
+
+   The entities declared in the internal DTD subset of the
+   DOCTYPE are numbered in the declaration order. Coded elements
+   can be read as entity IDs with readElementEntity() so that the
+   entity is never expanded into its declared value.
+ * ---------------------------------------------------------------- */
+class JMdictTokenizer
+{
+public:
+    // Token types.
+    enum class Token
+    {
+        StartElement,
+        EndElement,
+        EndDocument,
+        Invalid
+    };
+
+    // Element tags of the JMdict DTD.
+    enum class Tag
+    {
+        Unknown,
+        JMdict,
+        Entry,                   // entry
+        SequenceNumber,          // ent_seq
+        KanjiElement,            // k_ele
+        KanjiPhrase,             // keb
+        KanjiInfo,               // ke_inf
+        KanjiPriority,           // ke_pri
+        ReadingElement,          // r_ele
+        ReadingPhrase,           // reb
+        ReadingNoKanji,          // re_nokanji
+        ReadingRestriction,      // re_restr
+        ReadingInfo,             // re_inf
+        ReadingPriority,         // re_pri
+        Sense,                   // sense
+        KanjiSenseRestriction,   // stagk
+        ReadingSenseRestriction, // stagr
+        CrossReference,          // xref
+        Antonym,                 // ant
+        PartOfSpeech,            // pos
+        FieldOfApplication,      // field
+        Misc,                    // misc
+        LoanwordSource,          // lsource
+        Dialect,                 // dial
+        Gloss,                   // gloss
+        GlossPriority,           // pri
+        Info,                    // s_inf
+    };
+
+    // Constructs the tokenizer. The device needs to be open and
+    // it must stay alive while the tokenizer is used.
+    explicit JMdictTokenizer(QIODevice* device);
+
+    // Reads the next token.
+    Token next();
+
+    // Returns the current token and tag.
+    Token token() const;
+    Tag tag() const;
+
+    // Reads the text of the current start element and moves to
+    // the matching end element. Entities are expanded.
+    QString readElementText();
+
+    // Reads the text of the current start element as an entity ID
+    // and moves to the matching end element. If the text is a
+    // single entity reference the ID of the entity is returned.
+    // Any other text is interned into a new ID.
+    int readElementEntity();
+
+    // Returns the number of entities.
+    int entityCount() const;
+    // Returns the name of the entity.
+    QString entityName(int id) const;
+    // Returns the replacement text of the entity.
+    QString entityText(int id) const;
+
+    // Returns the value of the attribute of the current start
+    // element or a null string if the element has no such
+    // attribute. Call before readElementText().
+    QString attribute(const char* name) const;
+
+    // Returns true if the end of the document is reached or an
+    // error has occurred.
+    bool atEnd() const;
+
+    // Returns true if an error has occurred.
+    bool hasError() const;
+    // Returns the error description.
+    QString errorString() const;
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace kuu
@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui printsupport
+QT       += core gui printsupport network
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -24,33 +24,87 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# Compressed dictionary input. zlib is always required, xz support
+# is enabled with "qmake CONFIG+=jpad_xz".
+LIBS += -lz
+jpad_xz {
+    DEFINES += JPAD_WITH_LZMA
+    LIBS += -llzma
+}
+
 macx:ICON = $${PWD}/resource/icons/jpad.png.icns
 
 SOURCES += \
         main.cpp \
     jmdict/jmdict_parser.cpp \
     jmdict/jmdict.cpp \
+    jmdict/jmdict_decompressor.cpp \
+    jmdict/jmdict_form_index.cpp \
+    jmdict/jmdict_client.cpp \
+    jmdict/jmdict_protocol.cpp \
+    jmdict/jmdict_reading_trie.cpp \
+    jmdict/jmdict_server.cpp \
+    jmdict/jmdict_tokenizer.cpp \
     ui/text_editor.cpp \
+    ui/text_editor_block_data.cpp \
+    ui/text_editor_candidate_prefetcher.cpp \
+    ui/text_editor_highlighter.cpp \
+    ui/text_editor_search_index.cpp \
+    ui/text_file_reader.cpp \
+    ui/text_file_writer.cpp \
+    ui/text_replacer.cpp \
     ui/text_editor_key_converter.cpp \
+    ui/kana_conversion.cpp \
     ui/main_window.cpp \
+    ui/piece_table.cpp \
+    ui/piece_table_indexer.cpp \
+    ui/suffix_array.cpp \
     ui/text_editor_side_area.cpp \
     ui/text_editor_reading_to_kanji_area.cpp \
     ui/dictionary_dialog.cpp \
+    ui/find_bar.cpp \
+    ui/furigana_annotator.cpp \
+    ui/document_journal.cpp \
     ui/preferences_dialog.cpp \
     ui/about_dialog.cpp \
+    ui/vocabulary_exporter.cpp \
+    ui/conversion_history.cpp \
     settings.cpp
 
 HEADERS += \
     jmdict/jmdict_parser.h \
     jmdict/jmdict.h \
+    jmdict/jmdict_decompressor.h \
+    jmdict/jmdict_form_index.h \
+    jmdict/jmdict_client.h \
+    jmdict/jmdict_protocol.h \
+    jmdict/jmdict_reading_trie.h \
+    jmdict/jmdict_server.h \
+    jmdict/jmdict_tokenizer.h \
     ui/text_editor.h \
+    ui/text_editor_block_data.h \
+    ui/text_editor_candidate_prefetcher.h \
+    ui/text_editor_highlighter.h \
+    ui/text_editor_search_index.h \
+    ui/text_file_reader.h \
+    ui/text_file_writer.h \
+    ui/text_replacer.h \
     ui/text_editor_key_converter.h \
+    ui/kana_conversion.h \
     ui/main_window.h \
+    ui/piece_table.h \
+    ui/piece_table_indexer.h \
+    ui/suffix_array.h \
     ui/text_editor_side_area.h \
     ui/text_editor_reading_to_kanji_area.h \
     ui/dictionary_dialog.h \
+    ui/find_bar.h \
+    ui/furigana_annotator.h \
+    ui/document_journal.h \
     ui/preferences_dialog.h \
     ui/about_dialog.h \
+    ui/vocabulary_exporter.h \
+    ui/conversion_history.h \
     settings.h
 
 FORMS += \
@@ -5,23 +5,236 @@
    The main entry point of D-PAD application.
  * ---------------------------------------------------------------- */
 
+#include <cstdio>
 #include <iostream>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QFile>
 #include <QtWidgets/QApplication>
+#include "jmdict/jmdict_client.h"
 #include "jmdict/jmdict_parser.h"
+#include "jmdict/jmdict_protocol.h"
+#include "jmdict/jmdict_server.h"
+#include "ui/furigana_annotator.h"
 #include "ui/main_window.h"
 #include "ui/text_editor.h"
+#include "ui/vocabulary_exporter.h"
 #include "settings.h"
 
+namespace
+{
+
+using kuu::JMdictPtr;
+using kuu::jpad::FuriganaAnnotator;
+using kuu::jpad::VocabularyExporter;
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+const QString DICTIONARY_PATH = "/users/kuumies/Downloads/JMdict_e";
+//const QString DICTIONARY_PATH = "C:/Users/Antti Jumpponen/Dropbox/projects/jpad/resource/JMdict_e";
+
+// Options that run a command without the main window.
+const char* const COMMAND_OPTIONS[] = { "--furigana", "--vocabulary",
+                                        "--update", "--serve",
+                                        "--help", "-h", "-?" };
+
+/* ---------------------------------------------------------------- *
+   Creates a core application if a command is given and a GUI
+   application otherwise.
+ * ---------------------------------------------------------------- */
+QCoreApplication* createApplication(int& argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i)
+        for (const char* option : COMMAND_OPTIONS)
+            if (QByteArray(argv[i]).split('=').front() == option)
+                return new QCoreApplication(argc, argv);
+    return new QApplication(argc, argv);
+}
+
+/* ---------------------------------------------------------------- *
+   Opens the file or the standard stream if the path is "-". Throws
+   std::runtime_error if the file cannot be opened.
+ * ---------------------------------------------------------------- */
+void openFile(QFile& file, const QString& path, QIODevice::OpenMode mode)
+{
+    bool ok = false;
+    if (path == "-")
+        ok = file.open(mode & QIODevice::ReadOnly ? stdin : stdout, mode);
+    else
+    {
+        file.setFileName(path);
+        ok = file.open(mode);
+    }
+    if (!ok)
+        throw std::runtime_error(
+            QString("Failed to open %1: %2")
+                .arg(path, file.errorString()).toStdString());
+}
+
+/* ---------------------------------------------------------------- *
+   Annotates the input file with furigana into the output file.
+ * ---------------------------------------------------------------- */
+void annotateFurigana(JMdictPtr dictionary,
+                      const QString& inputPath,
+                      const QString& outputPath,
+                      const QString& format)
+{
+    if (format != "html" && format != "aozora")
+        throw std::runtime_error("Unknown format " + format.toStdString());
+
+    QFile in, out;
+    openFile(in,  inputPath,  QIODevice::ReadOnly);
+    openFile(out, outputPath, QIODevice::WriteOnly);
+
+    const FuriganaAnnotator annotator(
+        dictionary,
+        format == "html" ? FuriganaAnnotator::Format::Html
+                         : FuriganaAnnotator::Format::Aozora);
+    annotator.annotate(in, out);
+}
+
+/* ---------------------------------------------------------------- *
+   Exports the vocabulary of the input file into the output file.
+ * ---------------------------------------------------------------- */
+void exportVocabulary(JMdictPtr dictionary,
+                      const QString& inputPath,
+                      const QString& outputPath)
+{
+    if (outputPath == "-")
+        throw std::runtime_error("The vocabulary needs an output file");
+
+    QFile in;
+    openFile(in, inputPath, QIODevice::ReadOnly);
+    std::vector<QString> lines;
+    for (QByteArray line = in.readLine();
+         !line.isEmpty();
+         line = in.readLine())
+    {
+        lines.push_back(QString::fromUtf8(line).trimmed());
+    }
+
+    QString error;
+    VocabularyExporter exporter(dictionary, lines, outputPath);
+    QObject::connect(&exporter, &VocabularyExporter::failed,
+                     &exporter, [&error](const QString& e) { error = e; },
+                     Qt::DirectConnection);
+    exporter.start();
+    exporter.wait();
+    if (!error.isEmpty())
+        throw std::runtime_error(error.toStdString());
+}
+
+/* ---------------------------------------------------------------- *
+   Updates the dictionary from the newer release and writes the
+   changes into the output file. The dictionary is patched in
+   memory only, it is not written back into the dictionary file.
+ * ---------------------------------------------------------------- */
+void updateDictionary(JMdictPtr dictionary,
+                      const QString& releasePath,
+                      const QString& outputPath)
+{
+    const kuu::jmdict_parser::UpdateReport report =
+        kuu::jmdict_parser::update(*dictionary, releasePath);
+
+    QString text;
+    QDebug(&text) << report;
+
+    QFile out;
+    openFile(out, outputPath, QIODevice::WriteOnly);
+    out.write(text.toUtf8() + "\n");
+}
+
+} // anonymous namespace
+
 int main(int argc, char *argv[])
 {
     using namespace kuu;
     using namespace kuu::jpad;
-    const QString path = "/users/kuumies/Downloads/JMdict_e";
-    //const QString path = "C:/Users/Antti Jumpponen/Dropbox/projects/jpad/resource/JMdict_e";
+
+    QScopedPointer<QCoreApplication> a(createApplication(argc, argv));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("J-PAD Japanese text editor");
+    parser.addHelpOption();
+    const QCommandLineOption dictionaryOption(
+        "dictionary", "Read the JMdict dictionary from <file>.",
+        "file", DICTIONARY_PATH);
+    const QCommandLineOption furiganaOption(
+        "furigana", "Annotate the kanji words of <file> with readings. "
+        "Use - for the standard input.", "file");
+    const QCommandLineOption formatOption(
+        "format", "Furigana markup <format>: html or aozora.",
+        "format", "html");
+    const QCommandLineOption vocabularyOption(
+        "vocabulary", "Export the vocabulary of <file> as a table. "
+        "The output file suffix .csv selects CSV, otherwise TSV.", "file");
+    const QCommandLineOption updateOption(
+        "update", "Update the dictionary from a newer JMdict release "
+        "<file> and list the added, removed and changed entries. With "
+        "--serve the updated dictionary is served, otherwise the "
+        "changes are only listed.", "file");
+    const QCommandLineOption outputOption(
+        "output", "Write the command output into <file>.", "file", "-");
+    const QCommandLineOption serveOption(
+        "serve", "Serve the dictionary to the editors of the current "
+        "user. The editors attach to a running server instead of "
+        "reading the dictionary.");
+    parser.addOption(dictionaryOption);
+    parser.addOption(furiganaOption);
+    parser.addOption(formatOption);
+    parser.addOption(vocabularyOption);
+    parser.addOption(updateOption);
+    parser.addOption(outputOption);
+    parser.addOption(serveOption);
+    parser.process(*a);
+
+    const QString serverName = jmdict_protocol::serverName();
     JMdictPtr jmDict;
     try
     {
-        jmDict = jmdict_parser::read(path);
+        if (parser.isSet(serveOption))
+        {
+            jmDict = jmdict_parser::read(parser.value(dictionaryOption));
+            if (parser.isSet(updateOption))
+                updateDictionary(jmDict,
+                                 parser.value(updateOption),
+                                 parser.value(outputOption));
+            JMdictServer server(jmDict);
+            server.listen(serverName);
+            std::cerr << "Serving the dictionary as "
+                      << serverName.toStdString() << std::endl;
+            return a->exec();
+        }
+
+        if (parser.isSet(updateOption))
+        {
+            jmDict = jmdict_parser::read(parser.value(dictionaryOption));
+            updateDictionary(jmDict,
+                             parser.value(updateOption),
+                             parser.value(outputOption));
+            return EXIT_SUCCESS;
+        }
+
+        if (parser.isSet(furiganaOption) || parser.isSet(vocabularyOption))
+            jmDict = jmdict_parser::read(parser.value(dictionaryOption));
+        else if (!(jmDict = JMdictClient::connect(serverName)))
+            jmDict = jmdict_parser::read(parser.value(dictionaryOption));
+
+        if (parser.isSet(furiganaOption))
+        {
+            annotateFurigana(jmDict,
+                             parser.value(furiganaOption),
+                             parser.value(outputOption),
+                             parser.value(formatOption));
+            return EXIT_SUCCESS;
+        }
+        if (parser.isSet(vocabularyOption))
+        {
+            exportVocabulary(jmDict,
+                             parser.value(vocabularyOption),
+                             parser.value(outputOption));
+            return EXIT_SUCCESS;
+        }
     }
     catch(const std::runtime_error& err)
     {
@@ -29,8 +242,6 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    QApplication a(argc, argv);
-
     SettingsPtr settings = std::make_shared<Settings>();
 
     TextEditor* textEditor = new TextEditor();
@@ -60,5 +271,5 @@ int main(int argc, char *argv[])
         &mainWindow,
         &MainWindow::onTextEditorSelectionChanged);
 
-    return a.exec();
+    return a->exec();
 }
@@ -0,0 +1,287 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::jpad::ConversionHistory class.
+ * ---------------------------------------------------------------- */
+
+#include "conversion_history.h"
+#include <algorithm>
+#include <vector>
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QSaveFile>
+
+namespace kuu
+{
+namespace jpad
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+const quint32 MAGIC = 0x4a50434b; // JPCH
+const int MIN_COMPACT_RECORDS = 1024;
+// Maximum count of the choices in the history. The least recently
+// used choices are evicted in a batch down to EVICTED_CHOICES so
+// that the file is not compacted on every conversion.
+const int MAX_CHOICES     = 20000;
+const int EVICTED_CHOICES = MAX_CHOICES - MAX_CHOICES / 8;
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Private data of the conversion history.
+ * ---------------------------------------------------------------- */
+struct ConversionHistory::Impl
+{
+    // A chosen candidate of a reading.
+    struct Choice
+    {
+        QString candidate;
+        quint32 count;
+        quint64 lastUsed;
+    };
+
+    // Adds the choice into history.
+    void add(const QString& reading,
+             const QString& candidate,
+             quint32 count,
+             quint64 used)
+    {
+        std::vector<Choice>& choices = history[reading];
+        auto it = std::find_if(choices.begin(), choices.end(),
+            [&candidate](const Choice& c)
+        {
+            return c.candidate == candidate;
+        });
+
+        if (it == choices.end())
+        {
+            choices.push_back({ candidate, count, used });
+            ++choiceCount;
+        }
+        else
+        {
+            it->count   += count;
+            it->lastUsed = qMax(it->lastUsed, used);
+        }
+        clock = qMax(clock, used);
+    }
+
+    // Writes a record into stream.
+    static void write(QDataStream& stream,
+                      const QString& reading,
+                      const QString& candidate,
+                      quint32 count,
+                      quint64 used)
+    {
+        stream << reading << candidate << count << used;
+    }
+
+    // Removes the least recently used choices until the history has
+    // the given count of choices.
+    void evict(int count)
+    {
+        if (choiceCount <= count)
+            return;
+
+        std::vector<quint64> used;
+        used.reserve(size_t(choiceCount));
+        for (auto it = history.constBegin(); it != history.constEnd(); ++it)
+            for (const Choice& c : it.value())
+                used.push_back(c.lastUsed);
+
+        // The choices used at or before the threshold are evicted.
+        const size_t evicted = size_t(choiceCount - count);
+        std::nth_element(used.begin(), used.begin() + (evicted - 1),
+                         used.end());
+        const quint64 threshold = used[evicted - 1];
+
+        for (auto it = history.begin(); it != history.end();)
+        {
+            std::vector<Choice>& choices = it.value();
+            auto end = std::remove_if(choices.begin(), choices.end(),
+                [threshold](const Choice& c)
+            {
+                return c.lastUsed <= threshold;
+            });
+            choiceCount -= int(choices.end() - end);
+            choices.erase(end, choices.end());
+
+            if (choices.empty())
+                it = history.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    // Rewrites the file with one record per choice.
+    void compact()
+    {
+        file.close();
+
+        QSaveFile out(filePath);
+        if (out.open(QIODevice::WriteOnly))
+        {
+            QDataStream stream(&out);
+            stream << MAGIC;
+            for (auto it = history.constBegin(); it != history.constEnd(); ++it)
+                for (const Choice& c : it.value())
+                    write(stream, it.key(), c.candidate, c.count, c.lastUsed);
+            if (!out.commit())
+                qWarning() << "Failed to write conversion history" << filePath;
+        }
+        recordCount = choiceCount;
+    }
+
+    QString filePath;
+    QFile file;
+    QHash<QString, std::vector<Choice>> history;
+    quint64 clock = 0;      // the latest use
+    int choiceCount = 0;
+    int recordCount = 0;    // records in the file
+};
+
+/* ---------------------------------------------------------------- *
+   Constructs an empty history.
+ * ---------------------------------------------------------------- */
+ConversionHistory::ConversionHistory()
+    : impl(std::make_shared<Impl>())
+{}
+
+/* ---------------------------------------------------------------- *
+   Reads the history from the file.
+ * ---------------------------------------------------------------- */
+void ConversionHistory::open(const QString& filePath)
+{
+    impl->filePath = filePath;
+    impl->history.clear();
+    impl->file.close();
+    impl->file.setFileName(filePath);
+    impl->clock = 0;
+    impl->choiceCount = 0;
+    impl->recordCount = 0;
+
+    bool valid = false;
+    qint64 validEnd = 0;
+    if (impl->file.open(QIODevice::ReadOnly) && impl->file.size() > 0)
+    {
+        const qint64 size = impl->file.size();
+        uchar* data = impl->file.map(0, size);
+        if (data)
+        {
+            const QByteArray bytes = QByteArray::fromRawData(
+                reinterpret_cast<const char*>(data), int(size));
+            QDataStream stream(bytes);
+
+            quint32 magic = 0;
+            stream >> magic;
+            valid = magic == MAGIC;
+            validEnd = stream.device()->pos();
+            while (valid && !stream.atEnd())
+            {
+                QString reading, candidate;
+                quint32 count;
+                quint64 used;
+                stream >> reading >> candidate >> count >> used;
+
+                // A torn record at the end.
+                if (stream.status() != QDataStream::Ok)
+                    break;
+
+                impl->add(reading, candidate, count, used);
+                ++impl->recordCount;
+                validEnd = stream.device()->pos();
+            }
+            impl->file.unmap(data);
+        }
+    }
+    const qint64 fileSize = impl->file.size();
+    impl->file.close();
+
+    // The evicted choices are dropped from the file by compacting.
+    const bool evicted = impl->choiceCount > MAX_CHOICES;
+    if (evicted)
+        impl->evict(EVICTED_CHOICES);
+
+    if (!valid || evicted ||
+        (impl->recordCount > MIN_COMPACT_RECORDS &&
+         impl->recordCount > 2 * impl->choiceCount))
+    {
+        impl->compact();
+    }
+    else if (validEnd < fileSize)
+    {
+        // New records must not be appended after a torn record.
+        impl->file.resize(validEnd);
+    }
+
+    impl->file.open(QIODevice::WriteOnly | QIODevice::Append);
+}
+
+/* ---------------------------------------------------------------- *
+   Ranks the candidates of the reading.
+ * ---------------------------------------------------------------- */
+void ConversionHistory::rank(const QString& reading,
+                             QStringList& candidates) const
+{
+    auto it = impl->history.constFind(reading);
+    if (it == impl->history.constEnd())
+        return;
+
+    std::vector<Impl::Choice> choices = it.value();
+    std::sort(choices.begin(), choices.end(),
+        [](const Impl::Choice& a, const Impl::Choice& b)
+    {
+        if (a.count != b.count)
+            return a.count > b.count;
+        return a.lastUsed > b.lastUsed;
+    });
+
+    QStringList ranked;
+    for (const Impl::Choice& c : choices)
+        if (candidates.contains(c.candidate))
+            ranked << c.candidate;
+    for (const QString& candidate : candidates)
+        if (!ranked.contains(candidate))
+            ranked << candidate;
+    candidates = ranked;
+}
+
+/* ---------------------------------------------------------------- *
+   Records that the candidate was chosen for the reading.
+ * ---------------------------------------------------------------- */
+void ConversionHistory::record(const QString& reading,
+                               const QString& candidate)
+{
+    if (reading.isEmpty() || candidate.isEmpty())
+        return;
+
+    const quint64 used = impl->clock + 1;
+    impl->add(reading, candidate, 1, used);
+
+    if (!impl->file.isOpen())
+        return;
+
+    // The evicted choices are dropped from the file as well.
+    if (impl->choiceCount > MAX_CHOICES)
+    {
+        impl->evict(EVICTED_CHOICES);
+        impl->compact();
+        impl->file.open(QIODevice::WriteOnly | QIODevice::Append);
+        return;
+    }
+
+    QDataStream stream(&impl->file);
+    Impl::write(stream, reading, candidate, 1, used);
+    impl->file.flush();
+    ++impl->recordCount;
+}
+
+} // namespace jpad
+} // namespace kuu
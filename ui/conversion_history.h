@@ -0,0 +1,56 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::jpad::ConversionHistory class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <memory>
+#include <QtCore/QStringList>
+
+namespace kuu
+{
+namespace jpad
+{
+
+/* ---------------------------------------------------------------- *
+   A history of the reading-to-kanji conversions made by the user.
+
+   For each reading the history knows how many times each candidate
+   has been chosen and how recently. The candidates of a reading
+   are ranked by the count and then by the recency. The history has
+   a capacity, the least recently used choices are evicted when it
+   is exceeded.
+
+   The history is persisted into an append-only file, one record per
+   conversion. The file is memory-mapped and read on open and it is
+   compacted into one record per reading and candidate when it has
+   grown much larger than the history.
+ * ---------------------------------------------------------------- */
+class ConversionHistory
+{
+public:
+    // Constructs an empty history.
+    ConversionHistory();
+
+    // Reads the history from the file. New conversions are appended
+    // into the file.
+    void open(const QString& filePath);
+
+    // Ranks the candidates of the reading. The chosen candidates
+    // are moved to front in their rank order, the rest of the
+    // candidates keep their order.
+    void rank(const QString& reading, QStringList& candidates) const;
+
+    // Records that the candidate was chosen for the reading.
+    void record(const QString& reading, const QString& candidate);
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace jpad
+} // namespace kuu
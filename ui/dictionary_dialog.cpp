@@ -30,6 +30,8 @@ DictionaryDialog::DictionaryDialog(QWidget* parent)
     , impl(std::make_shared<Impl>())
 {
     impl->ui.setupUi(this);
+    impl->ui.searchLineEdit->setPlaceholderText(QString::fromUtf8(
+        "Gloss, reading or pattern such as *食* or た?る"));
     QFont font = impl->ui.textEdit->font();
     font.setPointSize(16);
     impl->ui.textEdit->setFont(font);
@@ -50,31 +52,27 @@ void DictionaryDialog::on_searchButton_clicked()
     const bool startsWith = impl->ui.startsWithCheckBox->isChecked();
     const bool endsWith = impl->ui.endsWithCheckBox->isChecked();
 
+    // A text with wildcards is a pattern of the kanji and reading
+    // forms. Otherwise the text is tried as a reading if no gloss
+    // matches and as a similar reading if no reading matches.
+    QString str;
     std::vector<JMdict::Entry> results;
-    for (const JMdict::Entry& entry : impl->dictionary->entries)
+    JMdict& dict = *impl->dictionary;
+    if (JMdictFormIndex::isPattern(text))
+        results = dict.searchByPattern(text);
+    else
     {
-        for (const JMdict::Sense& sense : entry.senses)
+        results = dict.searchByGloss(text, startsWith, endsWith);
+        if (results.empty())
+            results = dict.searchByReading(text);
+        if (results.empty())
         {
-            for (const QString& gloss : sense.glosses)
-            {
-                if (startsWith)
-                    if (!gloss.startsWith(text))
-                        continue;
-                if (endsWith)
-                    if (!gloss.endsWith(text))
-                        continue;
-
-                if (!startsWith && !endsWith)
-                    if (gloss != text)
-                        continue;
-
-                results.push_back(entry);
-                break;
-            }
+            results = dict.searchByReadingFuzzy(text);
+            if (!results.empty())
+                str = "No exact matches, similar readings:\n\n";
         }
     }
 
-    QString str;
     QDebug dbg(&str);
     dbg.noquote();
     for (const JMdict::Entry& entry : results)
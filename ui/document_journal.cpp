@@ -0,0 +1,431 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::jpad::DocumentJournal class.
+ * ---------------------------------------------------------------- */
+
+#include "document_journal.h"
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSaveFile>
+#include <QtCore/QTextCodec>
+#include <QtCore/QTextDecoder>
+#include <QtCore/QTimer>
+#include <QtGui/QTextCursor>
+#include <QtGui/QTextDocument>
+#include "text_editor_highlighter.h"
+
+namespace kuu
+{
+namespace jpad
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+const QByteArray MAGIC          = "JPJ1";
+const int FLUSH_INTERVAL        = 300;
+const qint64 MIN_COMPACT_SIZE   = 4 * 1024 * 1024;
+
+// Record types.
+const char RECORD_BASE     = 'B'; // current file, source file
+const char RECORD_SNAPSHOT = 'S'; // document text
+const char RECORD_CHANGE   = 'C'; // position, removed, added text
+
+// Record header: type, payload size, payload checksum.
+const int RECORD_HEADER_SIZE = 1 + 4 + 2;
+
+/* ---------------------------------------------------------------- *
+   Returns a journal record.
+ * ---------------------------------------------------------------- */
+QByteArray record(char type, const QByteArray& payload)
+{
+    QByteArray out;
+    {
+        QDataStream stream(&out, QIODevice::WriteOnly);
+        stream << quint8(type)
+               << quint32(payload.size())
+               << quint16(qChecksum(payload.constData(),
+                                    uint(payload.size())));
+    }
+    out.append(payload);
+    return out;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns a base record of the source file.
+ * ---------------------------------------------------------------- */
+QByteArray baseRecord(const QString& currentFile,
+                      const QString& sourcePath)
+{
+    qint64 size = 0;
+    qint64 modified = 0;
+    if (!sourcePath.isEmpty())
+    {
+        const QFileInfo fi(sourcePath);
+        size     = fi.size();
+        modified = fi.lastModified().toMSecsSinceEpoch();
+    }
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream << currentFile << sourcePath << size << modified;
+    return record(RECORD_BASE, payload);
+}
+
+/* ---------------------------------------------------------------- *
+   Loads the UTF-8 text of source file the same way as it is loaded
+   into the editor.
+ * ---------------------------------------------------------------- */
+bool loadSource(const QString& filePath, QString& text)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    std::unique_ptr<QTextDecoder> decoder(
+        QTextCodec::codecForName("UTF-8")->makeDecoder());
+    text = decoder->toUnicode(file.readAll());
+    return true;
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Private data of the journal.
+ * ---------------------------------------------------------------- */
+struct DocumentJournal::Impl
+{
+    // Writes a new journal file that begins with the given records.
+    void rewrite(const QByteArray& records)
+    {
+        file.close();
+        pending.clear();
+
+        QSaveFile out(filePath);
+        if (!out.open(QIODevice::WriteOnly)  ||
+            out.write(MAGIC) != MAGIC.size() ||
+            out.write(records) != records.size() ||
+            !out.commit())
+        {
+            qWarning() << "Failed to write journal" << filePath;
+        }
+
+        file.open(QIODevice::WriteOnly | QIODevice::Append);
+    }
+
+    // Appends the pending records into the journal file.
+    void append()
+    {
+        if (pending.isEmpty())
+            return;
+
+        if (!file.isOpen())
+            file.open(QIODevice::WriteOnly | QIODevice::Append);
+        file.write(pending);
+        file.flush();
+        pending.clear();
+    }
+
+    // Returns the document text length.
+    int documentLength() const
+    { return document->characterCount() - 1; }
+
+    // Returns the document text in the given range. Paragraph
+    // separators are returned as line feeds.
+    QString documentText(int position, int count) const
+    {
+        QTextCursor tc(document);
+        tc.setPosition(position);
+        tc.setPosition(position + count, QTextCursor::KeepAnchor);
+        QString text = tc.selectedText();
+        text.replace(QChar::ParagraphSeparator, QLatin1Char('\n'));
+        return text;
+    }
+
+    // Writes the document text as a snapshot.
+    void compact()
+    {
+        QByteArray payload;
+        {
+            QDataStream stream(&payload, QIODevice::WriteOnly);
+            stream << documentText(0, documentLength());
+        }
+
+        rewrite(baseRecord(currentFile, QString()) +
+                record(RECORD_SNAPSHOT, payload));
+        collecting = false;
+        collected.clear();
+    }
+
+    QString filePath;
+    QTextDocument* document = nullptr;
+    QString currentFile;
+    QFile file;
+    QTimer flushTimer;
+    QByteArray pending;
+    bool recording = false;
+    int length = 0;
+
+    // Records after beginSave().
+    bool collecting = false;
+    QByteArray collected;
+};
+
+/* ---------------------------------------------------------------- *
+   Constructs the journal of the document.
+ * ---------------------------------------------------------------- */
+DocumentJournal::DocumentJournal(const QString& filePath,
+                                 QTextDocument* document,
+                                 QObject* parent)
+    : QObject(parent)
+    , impl(std::make_shared<Impl>())
+{
+    impl->filePath = filePath;
+    impl->document = document;
+    impl->file.setFileName(filePath);
+
+    impl->flushTimer.setSingleShot(true);
+    impl->flushTimer.setInterval(FLUSH_INTERVAL);
+    connect(&impl->flushTimer, &QTimer::timeout,
+            this, &DocumentJournal::flush);
+
+    connect(document, &QTextDocument::contentsChange,
+            this, &DocumentJournal::onContentsChange);
+}
+
+/* ---------------------------------------------------------------- *
+   Appends the pending records. The document might be already
+   destroyed so the journal is not compacted.
+ * ---------------------------------------------------------------- */
+DocumentJournal::~DocumentJournal()
+{ impl->append(); }
+
+/* ---------------------------------------------------------------- *
+   Starts a new journal.
+ * ---------------------------------------------------------------- */
+void DocumentJournal::start(const QString& currentFile,
+                            const QString& sourcePath)
+{
+    impl->currentFile = currentFile;
+    impl->length      = impl->documentLength();
+    impl->recording   = true;
+
+    if (sourcePath.isEmpty())
+    {
+        impl->compact();
+        return;
+    }
+
+    impl->rewrite(baseRecord(currentFile, sourcePath));
+    impl->collecting = false;
+    impl->collected.clear();
+}
+
+/* ---------------------------------------------------------------- *
+   Stops recording.
+ * ---------------------------------------------------------------- */
+void DocumentJournal::stop()
+{
+    flush();
+    impl->recording = false;
+}
+
+/* ---------------------------------------------------------------- *
+   Starts collecting the edits made while the document is saved.
+ * ---------------------------------------------------------------- */
+void DocumentJournal::beginSave()
+{
+    impl->collecting = impl->recording;
+    impl->collected.clear();
+}
+
+/* ---------------------------------------------------------------- *
+   Rebases the journal on the saved file. The edits made after
+   the document text was passed to the file writer are kept.
+ * ---------------------------------------------------------------- */
+void DocumentJournal::endSave(const QString& filePath,
+                              const QString& currentFile)
+{
+    // The journal was compacted or restarted during the save.
+    if (!impl->collecting)
+        return;
+
+    impl->currentFile = currentFile;
+    impl->rewrite(baseRecord(currentFile, filePath) + impl->collected);
+    impl->collecting = false;
+    impl->collected.clear();
+}
+
+/* ---------------------------------------------------------------- *
+   Appends the pending records into the journal file.
+ * ---------------------------------------------------------------- */
+void DocumentJournal::flush()
+{
+    impl->flushTimer.stop();
+    if (impl->pending.isEmpty())
+        return;
+    impl->append();
+
+    // Writing the snapshot costs as much as the document size so
+    // it is only done when the change records exceed it clearly.
+    const qint64 size = impl->file.size();
+    if (size > MIN_COMPACT_SIZE && size > 4 * qint64(impl->length))
+        impl->compact();
+}
+
+/* ---------------------------------------------------------------- *
+   Stops recording and removes the journal file.
+ * ---------------------------------------------------------------- */
+void DocumentJournal::remove()
+{
+    impl->flushTimer.stop();
+    impl->recording = false;
+    impl->collecting = false;
+    impl->pending.clear();
+    impl->collected.clear();
+    impl->file.close();
+    QFile::remove(impl->filePath);
+}
+
+/* ---------------------------------------------------------------- *
+   Replays the journal from the file.
+ * ---------------------------------------------------------------- */
+bool DocumentJournal::recover(const QString& filePath,
+                              QString& text,
+                              QString& currentFile)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    const QByteArray data = file.readAll();
+    if (!data.startsWith(MAGIC))
+        return false;
+
+    bool hasBase = false;
+    int pos = MAGIC.size();
+    while (data.size() - pos >= RECORD_HEADER_SIZE)
+    {
+        quint8 type;
+        quint32 size;
+        quint16 checksum;
+        {
+            QDataStream stream(data.mid(pos, RECORD_HEADER_SIZE));
+            stream >> type >> size >> checksum;
+        }
+
+        pos += RECORD_HEADER_SIZE;
+        if (quint32(data.size() - pos) < size)
+            break;
+
+        const QByteArray payload = data.mid(pos, int(size));
+        pos += int(size);
+        if (qChecksum(payload.constData(), uint(payload.size())) != checksum)
+            break;
+
+        QDataStream stream(payload);
+        switch (type)
+        {
+            case RECORD_BASE:
+            {
+                QString sourcePath;
+                qint64 sourceSize, sourceModified;
+                stream >> currentFile >> sourcePath
+                       >> sourceSize >> sourceModified;
+
+                text.clear();
+                if (!sourcePath.isEmpty())
+                {
+                    const QFileInfo fi(sourcePath);
+                    if (fi.size() != sourceSize ||
+                        fi.lastModified().toMSecsSinceEpoch() != sourceModified ||
+                        !loadSource(sourcePath, text))
+                    {
+                        qWarning() << "Journal source file has changed"
+                                   << sourcePath;
+                        return false;
+                    }
+                }
+                hasBase = true;
+                break;
+            }
+
+            case RECORD_SNAPSHOT:
+                stream >> text;
+                break;
+
+            case RECORD_CHANGE:
+            {
+                qint32 position, removed;
+                QString added;
+                stream >> position >> removed >> added;
+                if (!hasBase || position < 0 || removed < 0 ||
+                    position + removed > text.size())
+                {
+                    qWarning() << "Invalid journal record" << filePath;
+                    return false;
+                }
+                text.replace(position, removed, added);
+                break;
+            }
+
+            default:
+                return false;
+        }
+    }
+
+    return hasBase;
+}
+
+/* ---------------------------------------------------------------- *
+   Records a change of the document contents.
+ * ---------------------------------------------------------------- */
+void DocumentJournal::onContentsChange(int position,
+                                       int removed,
+                                       int added)
+{
+    if (!impl->recording ||
+        TextEditorHighlighter::isReformatting(impl->document))
+    {
+        return;
+    }
+
+    // The counts reported for the whole document changes include
+    // the last paragraph separator that is not a part of the text.
+    // The added count is derived from the length change instead.
+    const int oldLength = impl->length;
+    impl->length = impl->documentLength();
+    position = qMin(position, oldLength);
+    removed  = qMin(removed, oldLength - position);
+    added    = impl->length - (oldLength - removed);
+
+    // Format-only change.
+    if (removed == 0 && added == 0)
+        return;
+
+    QByteArray payload;
+    {
+        QDataStream stream(&payload, QIODevice::WriteOnly);
+        stream << qint32(position)
+               << qint32(removed)
+               << impl->documentText(position, added);
+    }
+
+    const QByteArray change = record(RECORD_CHANGE, payload);
+    impl->pending.append(change);
+    if (impl->collecting)
+        impl->collected.append(change);
+
+    if (!impl->flushTimer.isActive())
+        impl->flushTimer.start();
+}
+
+} // namespace jpad
+} // namespace kuu
@@ -0,0 +1,86 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::jpad::DocumentJournal class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <memory>
+#include <QtCore/QObject>
+
+class QTextDocument;
+
+namespace kuu
+{
+namespace jpad
+{
+
+/* ---------------------------------------------------------------- *
+   An append-only journal of document edits for crash recovery.
+
+   The journal starts from a base: either the text file the
+   document was loaded from or a snapshot of the document text.
+   Every content change of the document is appended after the base
+   as a (position, removed count, added text) record. Records are
+   batched in memory and appended into the journal file a few times
+   in a second so the cost follows the edit rate instead of the
+   document size.
+
+   The journal is compacted into a snapshot when it has grown large
+   compared to the document. A successful save of the document
+   rebases the journal on the saved file.
+
+   A torn or a corrupted record at the end of the journal ends the
+   replay; the edits before it are recovered.
+ * ---------------------------------------------------------------- */
+class DocumentJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Constructs the journal of the document. The journal is
+    // written into the given file. Call start() to start recording.
+    DocumentJournal(const QString& filePath,
+                    QTextDocument* document,
+                    QObject* parent = nullptr);
+    // Appends the pending records.
+    ~DocumentJournal();
+
+    // Starts a new journal. The current document text must be
+    // the contents of the source file. If the source file path is
+    // empty then the document text is written as a snapshot.
+    void start(const QString& currentFile,
+               const QString& sourcePath = QString());
+    // Stops recording. The journal file is kept.
+    void stop();
+
+    // Marks that the document text has been passed into a file
+    // writer. The edits after this are kept until endSave().
+    void beginSave();
+    // Rebases the journal on the file that was saved after the
+    // last beginSave().
+    void endSave(const QString& filePath, const QString& currentFile);
+
+    // Appends the pending records into the journal file.
+    void flush();
+    // Stops recording and removes the journal file.
+    void remove();
+
+    // Replays the journal from the file. Returns false if there
+    // is no journal or if its base file has changed.
+    static bool recover(const QString& filePath,
+                        QString& text,
+                        QString& currentFile);
+
+private slots:
+    void onContentsChange(int position, int removed, int added);
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace jpad
+} // namespace kuu
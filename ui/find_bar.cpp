@@ -0,0 +1,341 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::jpad::FindBar class.
+ * ---------------------------------------------------------------- */
+
+#include "find_bar.h"
+#include <QtGui/QKeyEvent>
+#include <QtGui/QTextBlock>
+#include <QtGui/QTextDocument>
+#include <QtWidgets/QApplication>
+#include <QtWidgets/QGridLayout>
+#include <QtWidgets/QLabel>
+#include <QtWidgets/QLineEdit>
+#include <QtWidgets/QListWidget>
+#include <QtWidgets/QPushButton>
+#include <QtWidgets/QToolButton>
+#include "text_editor.h"
+#include "text_editor_highlighter.h"
+
+namespace kuu
+{
+namespace jpad
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+// Count of characters around the match in a concordance line.
+const int CONCORDANCE_CONTEXT = 20;
+// Maximum count of concordance lines.
+const size_t CONCORDANCE_LINES = 10000;
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Private data of the find bar.
+ * ---------------------------------------------------------------- */
+struct FindBar::Impl
+{
+    // Constructs the private data.
+    Impl(FindBar* self)
+        : findLabel("Find:", self)
+        , findEdit(self)
+        , previousButton("Previous", self)
+        , nextButton("Next", self)
+        , findAllButton("Find All", self)
+        , replaceLabel("Replace:", self)
+        , replaceEdit(self)
+        , replaceButton("Replace", self)
+        , replaceAllButton("Replace All", self)
+        , statusLabel(self)
+        , closeButton(self)
+        , concordance(self)
+    {}
+
+    TextEditor* editor = nullptr;
+    QLabel findLabel;
+    QLineEdit findEdit;
+    QPushButton previousButton;
+    QPushButton nextButton;
+    QPushButton findAllButton;
+    QLabel replaceLabel;
+    QLineEdit replaceEdit;
+    QPushButton replaceButton;
+    QPushButton replaceAllButton;
+    QLabel statusLabel;
+    QToolButton closeButton;
+    QListWidget concordance;
+    int concordanceLength = 0;  // length of the listed matches
+    bool replaceEnabled = true;
+    bool replacingAll = false;
+};
+
+/* ---------------------------------------------------------------- *
+   Constructs the find bar.
+ * ---------------------------------------------------------------- */
+FindBar::FindBar(TextEditor* editor, QWidget* parent)
+    : QWidget(parent)
+    , impl(std::make_shared<Impl>(this))
+{
+    impl->editor = editor;
+    impl->closeButton.setText(QString::fromUtf8("×"));
+    impl->closeButton.setAutoRaise(true);
+    impl->findEdit.setToolTip(QString::fromUtf8(
+        "Katakana matches hiragana and full-width matches ASCII.\n"
+        "Half-width katakana with a voicing mark, e.g. ｶﾞ, does not "
+        "match the composed kana."));
+
+    QGridLayout* layout = new QGridLayout(this);
+    layout->setContentsMargins(5, 3, 5, 3);
+    layout->addWidget(&impl->findLabel,        0, 0);
+    layout->addWidget(&impl->findEdit,         0, 1);
+    layout->addWidget(&impl->previousButton,   0, 2);
+    layout->addWidget(&impl->nextButton,       0, 3);
+    layout->addWidget(&impl->statusLabel,      0, 5);
+    layout->addWidget(&impl->closeButton,      0, 6);
+    layout->addWidget(&impl->replaceLabel,     1, 0);
+    layout->addWidget(&impl->replaceEdit,      1, 1);
+    layout->addWidget(&impl->replaceButton,    1, 2);
+    layout->addWidget(&impl->findAllButton,    0, 4);
+    layout->addWidget(&impl->replaceAllButton, 1, 3);
+    layout->addWidget(&impl->concordance,      2, 0, 1, 7);
+    layout->setColumnStretch(1, 1);
+    layout->setColumnStretch(5, 1);
+
+    impl->concordance.setMaximumHeight(150);
+    impl->concordance.hide();
+
+    connect(&impl->findEdit, &QLineEdit::returnPressed,
+            this, [this]()
+    {
+        if (QApplication::keyboardModifiers() & Qt::ShiftModifier)
+            findPrevious();
+        else
+            findNext();
+    });
+    connect(&impl->replaceEdit, &QLineEdit::returnPressed,
+            this, &FindBar::replace);
+    connect(&impl->previousButton, &QPushButton::clicked,
+            this, &FindBar::findPrevious);
+    connect(&impl->nextButton, &QPushButton::clicked,
+            this, &FindBar::findNext);
+    connect(&impl->findAllButton, &QPushButton::clicked,
+            this, &FindBar::findAll);
+    connect(&impl->concordance, &QListWidget::itemActivated,
+            this, &FindBar::onConcordanceActivated);
+    connect(editor->document(), &QTextDocument::contentsChange,
+            this, &FindBar::onContentsChange);
+    connect(&impl->replaceButton, &QPushButton::clicked,
+            this, &FindBar::replace);
+    connect(&impl->replaceAllButton, &QPushButton::clicked,
+            this, &FindBar::replaceAll);
+    connect(&impl->closeButton, &QToolButton::clicked,
+            this, &FindBar::hide);
+    connect(editor, &TextEditor::replaceAllFinished,
+            this, &FindBar::onReplaceAllFinished);
+}
+
+/* ---------------------------------------------------------------- *
+   Shows the bar and focuses the find text.
+ * ---------------------------------------------------------------- */
+void FindBar::activate()
+{
+    const QString selected = impl->editor->textCursor().selectedText();
+    if (!selected.isEmpty() && !selected.contains(QChar::ParagraphSeparator))
+        impl->findEdit.setText(selected);
+
+    impl->statusLabel.clear();
+    show();
+    impl->findEdit.setFocus();
+    impl->findEdit.selectAll();
+}
+
+/* ---------------------------------------------------------------- *
+   Enables or disables replacing.
+ * ---------------------------------------------------------------- */
+void FindBar::setReplaceEnabled(bool enabled)
+{
+    impl->replaceEnabled = enabled;
+    updateReplaceButtons();
+}
+
+/* ---------------------------------------------------------------- *
+   Escape hides the bar and returns the focus to the editor.
+ * ---------------------------------------------------------------- */
+void FindBar::keyPressEvent(QKeyEvent* event)
+{
+    if (event->key() == Qt::Key_Escape)
+    {
+        hide();
+        impl->editor->setFocus();
+        event->accept();
+        return;
+    }
+    QWidget::keyPressEvent(event);
+}
+
+/* ---------------------------------------------------------------- *
+   Finds the next match.
+ * ---------------------------------------------------------------- */
+void FindBar::findNext()
+{
+    const bool found = impl->editor->find(impl->findEdit.text());
+    showMatchCount(found);
+}
+
+/* ---------------------------------------------------------------- *
+   Finds the previous match.
+ * ---------------------------------------------------------------- */
+void FindBar::findPrevious()
+{
+    const bool found = impl->editor->find(impl->findEdit.text(), true);
+    showMatchCount(found);
+}
+
+/* ---------------------------------------------------------------- *
+   Lists all matches with their context. The line number is
+   followed by the text around the match.
+ * ---------------------------------------------------------------- */
+void FindBar::findAll()
+{
+    const QString text = impl->findEdit.text();
+    impl->concordance.clear();
+    if (text.isEmpty())
+    {
+        impl->concordance.hide();
+        return;
+    }
+
+    const std::vector<int> matches = impl->editor->findAll(text);
+    const QTextDocument* doc = impl->editor->document();
+    impl->concordanceLength = text.size();
+    impl->concordance.setUpdatesEnabled(false);
+    for (size_t i = 0; i < matches.size() && i < CONCORDANCE_LINES; ++i)
+    {
+        const int position = matches[i];
+        const QTextBlock block = doc->findBlock(position);
+        const QString blockText = block.text();
+        const int column = position - block.position();
+        const int left   = qMax(0, column - CONCORDANCE_CONTEXT);
+
+        const QString line =
+            QString::number(impl->editor->firstLineNumber() +
+                            block.blockNumber() + 1) + ": " +
+            blockText.mid(left, column - left) +
+            QString::fromUtf8("【") +
+            blockText.mid(column, text.size()) +
+            QString::fromUtf8("】") +
+            blockText.mid(column + text.size(), CONCORDANCE_CONTEXT);
+
+        QListWidgetItem* item = new QListWidgetItem(line, &impl->concordance);
+        item->setData(Qt::UserRole, position);
+    }
+    impl->concordance.setUpdatesEnabled(true);
+    impl->concordance.setVisible(!matches.empty());
+
+    impl->statusLabel.setText(matches.empty()
+        ? QString("Not found")
+        : QString("%1 matches").arg(matches.size()));
+}
+
+/* ---------------------------------------------------------------- *
+   Selects the match of the concordance line.
+ * ---------------------------------------------------------------- */
+void FindBar::onConcordanceActivated(QListWidgetItem* item)
+{
+    const int position = item->data(Qt::UserRole).toInt();
+    QTextCursor tc = impl->editor->textCursor();
+    tc.setPosition(position);
+    tc.setPosition(position + impl->concordanceLength,
+                   QTextCursor::KeepAnchor);
+    impl->editor->setTextCursor(tc);
+    impl->editor->centerCursor();
+}
+
+/* ---------------------------------------------------------------- *
+   The positions of the concordance lines are not valid after an
+   edit. The concordance is cleared.
+ * ---------------------------------------------------------------- */
+void FindBar::onContentsChange(int /*position*/,
+                               int /*removed*/,
+                               int /*added*/)
+{
+    if (TextEditorHighlighter::isReformatting(impl->editor->document()))
+        return;
+
+    if (impl->concordance.count() > 0)
+    {
+        impl->concordance.clear();
+        impl->concordance.hide();
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Shows the count of matches or that the text was not found.
+ * ---------------------------------------------------------------- */
+void FindBar::showMatchCount(bool found)
+{
+    impl->statusLabel.setText(found
+        ? QString("%1 matches").arg(
+              impl->editor->matchCount(impl->findEdit.text()))
+        : QString("Not found"));
+}
+
+/* ---------------------------------------------------------------- *
+   Replaces the selected match and finds the next one.
+ * ---------------------------------------------------------------- */
+void FindBar::replace()
+{
+    if (!impl->replaceEnabled || impl->replacingAll)
+        return;
+
+    const bool found = impl->editor->replace(impl->findEdit.text(),
+                                             impl->replaceEdit.text());
+    showMatchCount(found);
+}
+
+/* ---------------------------------------------------------------- *
+   Replaces all matches.
+ * ---------------------------------------------------------------- */
+void FindBar::replaceAll()
+{
+    if (impl->findEdit.text().isEmpty() ||
+        !impl->replaceEnabled || impl->replacingAll)
+    {
+        return;
+    }
+
+    impl->replacingAll = true;
+    updateReplaceButtons();
+    impl->statusLabel.setText("Replacing...");
+    impl->editor->replaceAll(impl->findEdit.text(),
+                             impl->replaceEdit.text());
+}
+
+/* ---------------------------------------------------------------- *
+   Shows the count of replaced matches.
+ * ---------------------------------------------------------------- */
+void FindBar::onReplaceAllFinished(int count)
+{
+    impl->replacingAll = false;
+    updateReplaceButtons();
+    impl->statusLabel.setText(QString("Replaced %1").arg(count));
+}
+
+/* ---------------------------------------------------------------- *
+   Enables the replace buttons.
+ * ---------------------------------------------------------------- */
+void FindBar::updateReplaceButtons()
+{
+    const bool enabled = impl->replaceEnabled && !impl->replacingAll;
+    impl->replaceButton.setEnabled(enabled);
+    impl->replaceAllButton.setEnabled(enabled);
+}
+
+} // namespace jpad
+} // namespace kuu
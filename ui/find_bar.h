@@ -0,0 +1,67 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::jpad::FindBar class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <memory>
+#include <QtWidgets/QWidget>
+
+class QListWidgetItem;
+
+namespace kuu
+{
+namespace jpad
+{
+
+class TextEditor;
+
+/* ---------------------------------------------------------------- *
+   A find and replace bar below the text editor. Hiragana and
+   katakana and full-width and half-width forms match each other.
+   Find all lists the matches with their context.
+ * ---------------------------------------------------------------- */
+class FindBar : public QWidget
+{
+    Q_OBJECT
+
+public:
+    // Constructs the find bar of the text editor.
+    explicit FindBar(TextEditor* editor, QWidget* parent = nullptr);
+
+    // Shows the bar and focuses the find text. The selected text
+    // of the editor becomes the find text.
+    void activate();
+    // Enables or disables replacing, e.g. while the document is
+    // saved.
+    void setReplaceEnabled(bool enabled);
+
+protected:
+    void keyPressEvent(QKeyEvent* event) override;
+
+private slots:
+    void findNext();
+    void findPrevious();
+    void findAll();
+    void replace();
+    void replaceAll();
+    void onReplaceAllFinished(int count);
+    void onConcordanceActivated(QListWidgetItem* item);
+    void onContentsChange(int position, int removed, int added);
+
+private:
+    // Shows the count of matches or that the text was not found.
+    void showMatchCount(bool found);
+    // Enables the replace buttons unless replacing is disabled or a
+    // replace-all is in progress.
+    void updateReplaceButtons();
+
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace jpad
+} // namespace kuu
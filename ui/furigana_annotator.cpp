@@ -0,0 +1,336 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::jpad::FuriganaAnnotator class.
+ * ---------------------------------------------------------------- */
+
+#include "furigana_annotator.h"
+#include <stdexcept>
+#include <vector>
+#include <QtCore/QHash>
+#include <QtCore/QIODevice>
+#include "kana_conversion.h"
+
+namespace kuu
+{
+namespace jpad
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+// Maximum count of annotated words in the cache.
+const int CACHE_SIZE = 100000;
+// Maximum byte count of text that is read as one line.
+const qint64 LINE_SIZE = 1024 * 1024;
+
+// A part of an annotated word. The base text is not annotated if
+// the ruby text is empty.
+struct Part
+{
+    QString base;
+    QString ruby;
+};
+
+/* ---------------------------------------------------------------- *
+   Returns true if the character is a kanji. The characters outside
+   of the basic multilingual plane are kanji in Japanese text.
+ * ---------------------------------------------------------------- */
+bool isKanji(QChar c)
+{
+    const ushort u = c.unicode();
+    return (u >= 0x3400 && u <= 0x4DBF) ||  // CJK extension A
+           (u >= 0x4E00 && u <= 0x9FFF) ||  // CJK unified ideographs
+           (u >= 0xF900 && u <= 0xFAFF) ||  // CJK compatibility
+           u == 0x3005 ||                   // 々
+           c.isSurrogate();
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if the text contains a kanji.
+ * ---------------------------------------------------------------- */
+bool containsKanji(const QString& text)
+{
+    for (const QChar c : text)
+        if (isKanji(c))
+            return true;
+    return false;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the score of the priorities. The first half of the
+   frequency lists scores higher than the second half and the
+   wordfreq ranks nf01 to nf48 add to the score by their rank.
+ * ---------------------------------------------------------------- */
+int priorityScore(const std::vector<QString>& priorities)
+{
+    int score = 0;
+    for (const QString& priority : priorities)
+    {
+        if (priority.startsWith("nf"))
+            score += 50 - priority.mid(2).toInt();
+        else if (priority.endsWith('1'))
+            score += 40;   // news1, ichi1, spec1, gai1
+        else if (priority.endsWith('2'))
+            score += 20;   // news2, ichi2, spec2, gai2
+    }
+    return score;
+}
+
+/* ---------------------------------------------------------------- *
+   Splits the text into runs of kanji and other characters.
+ * ---------------------------------------------------------------- */
+std::vector<QString> kanjiRuns(const QString& text)
+{
+    std::vector<QString> runs;
+    int start = 0;
+    for (int i = 1; i <= text.size(); ++i)
+        if (i == text.size() || isKanji(text[i]) != isKanji(text[start]))
+        {
+            runs.push_back(text.mid(start, i - start));
+            start = i;
+        }
+    return runs;
+}
+
+/* ---------------------------------------------------------------- *
+   Aligns the runs of the word from the run with the reading from
+   the position. The kana runs must equal the reading and each
+   kanji run gets at least one character of the reading. The
+   shortest kanji readings are tried first.
+ * ---------------------------------------------------------------- */
+bool align(const std::vector<QString>& runs,
+           size_t run,
+           const QString& reading,
+           const QString& foldedReading,
+           int position,
+           std::vector<Part>& parts)
+{
+    if (run == runs.size())
+        return position == reading.size();
+
+    const QString& text = runs[run];
+    if (!isKanji(text[0]))
+    {
+        const QString folded = kana_conversion::katakanaToHiragana(text);
+        if (foldedReading.mid(position, folded.size()) != folded)
+            return false;
+
+        parts.push_back({ text, QString() });
+        if (align(runs, run + 1, reading, foldedReading,
+                  position + text.size(), parts))
+        {
+            return true;
+        }
+        parts.pop_back();
+        return false;
+    }
+
+    const int remaining = reading.size() - position;
+    if (remaining < 1)
+        return false;
+    const int first = run + 1 == runs.size() ? remaining : 1;
+    for (int length = first; length <= remaining; ++length)
+    {
+        parts.push_back({ text, reading.mid(position, length) });
+        if (align(runs, run + 1, reading, foldedReading,
+                  position + length, parts))
+        {
+            return true;
+        }
+        parts.pop_back();
+    }
+    return false;
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Private data of the furigana annotator.
+ * ---------------------------------------------------------------- */
+struct FuriganaAnnotator::Impl
+{
+    // Returns the reading with the highest priority score among the
+    // entries that have the word as a kanji form. The entries are in
+    // dictionary order and the first reading wins a tie.
+    QString reading(const QString& word) const
+    {
+        QString best;
+        int bestScore = -1;
+        for (const qint32 index : dictionary->kanjiEntries(word))
+        {
+            const JMdict::EntryPtr entry = dictionary->entry(index);
+            const JMdict::Entry& e = *entry;
+
+            int kanjiScore = 0;
+            for (const JMdict::Kanji& kanji : e.kanjis)
+                if (kanji.wordOrPhrase == word)
+                    kanjiScore = priorityScore(kanji.priorities);
+
+            for (const JMdict::Reading& r : e.readings)
+            {
+                if (!r.noKanji.isEmpty())
+                    continue;
+                if (!r.restriction.isEmpty() && r.restriction != word)
+                    continue;
+
+                const int score = kanjiScore + priorityScore(r.priorities);
+                if (score > bestScore)
+                {
+                    best = r.wordOrPhrase;
+                    bestScore = score;
+                }
+            }
+        }
+        return best;
+    }
+
+    // Returns the annotated word.
+    QString markup(const QString& word)
+    {
+        auto cached = cache.constFind(word);
+        if (cached != cache.constEnd())
+            return cached.value();
+
+        std::vector<Part> parts;
+        const QString r = reading(word);
+        if (r.isEmpty())
+            parts.push_back({ word, QString() });
+        else if (!align(kanjiRuns(word), 0, r,
+                        kana_conversion::katakanaToHiragana(r), 0, parts))
+            parts.push_back({ word, r });
+
+        QString text;
+        for (const Part& part : parts)
+        {
+            if (part.ruby.isEmpty())
+                text += escape(part.base);
+            else if (format == Format::Html)
+                text += "<ruby>" + escape(part.base) +
+                        "<rt>" + escape(part.ruby) + "</rt></ruby>";
+            else
+                text += QString::fromUtf8("｜") + part.base +
+                        QString::fromUtf8("《") + part.ruby +
+                        QString::fromUtf8("》");
+        }
+
+        if (cache.size() >= CACHE_SIZE)
+            cache.clear();
+        cache.insert(word, text);
+        return text;
+    }
+
+    // Returns the text escaped for the format.
+    QString escape(const QString& text) const
+    { return format == Format::Html ? text.toHtmlEscaped() : text; }
+
+    JMdictPtr dictionary;
+    Format format = Format::Html;
+    QHash<QString, QString> cache;
+};
+
+/* ---------------------------------------------------------------- *
+   Constructs the annotator.
+ * ---------------------------------------------------------------- */
+FuriganaAnnotator::FuriganaAnnotator(JMdictPtr dictionary, Format format)
+    : impl(std::make_shared<Impl>())
+{
+    impl->dictionary = dictionary;
+    impl->format     = format;
+}
+
+/* ---------------------------------------------------------------- *
+   Annotates the line. The words without kanji are copied as they
+   are.
+ * ---------------------------------------------------------------- */
+QString FuriganaAnnotator::annotate(const QString& text) const
+{
+    const JMdict& dict = *impl->dictionary;
+    QString out;
+    out.reserve(text.size() * 2);
+
+    int position = 0;
+    for (const JMdict::Token& token : dict.tokenize(text))
+    {
+        out += impl->escape(text.mid(position, token.position - position));
+
+        const QString word = text.mid(token.position, token.length);
+        if (containsKanji(word))
+            out += impl->markup(word);
+        else
+            out += impl->escape(word);
+        position = token.position + token.length;
+    }
+    out += impl->escape(text.mid(position));
+    return out;
+}
+
+/* ---------------------------------------------------------------- *
+   Annotates the input device line by line. A line longer than the
+   line size is annotated in parts that end at a character
+   boundary.
+ * ---------------------------------------------------------------- */
+void FuriganaAnnotator::annotate(QIODevice& in, QIODevice& out) const
+{
+    auto write = [&out](const QString& text)
+    {
+        if (out.write(text.toUtf8()) < 0)
+            throw std::runtime_error(out.errorString().toStdString());
+    };
+
+    const bool html = impl->format == Format::Html;
+    if (html)
+        write("<!DOCTYPE html>\n<html>\n<head>\n"
+              "<meta charset=\"utf-8\">\n</head>\n<body>\n");
+
+    QByteArray carry;
+    for (;;)
+    {
+        QByteArray bytes = in.readLine(LINE_SIZE);
+        const bool end = bytes.isEmpty();
+        bytes.prepend(carry);
+        carry.clear();
+        if (end && bytes.isEmpty())
+            break;
+
+        const bool newline = bytes.endsWith('\n');
+        if (newline)
+        {
+            bytes.chop(1);
+            if (bytes.endsWith('\r'))
+                bytes.chop(1);
+        }
+        else if (!end)
+        {
+            // A part of a long line, keep the last character for
+            // the next part.
+            int size = bytes.size();
+            while (size > 0 && (uchar(bytes[size - 1]) & 0xC0) == 0x80)
+                --size;
+            if (size > 0 && uchar(bytes[size - 1]) >= 0xC0)
+                --size;
+            if (size > 0)
+            {
+                carry = bytes.mid(size);
+                bytes.truncate(size);
+            }
+        }
+
+        QString line = annotate(QString::fromUtf8(bytes));
+        if (newline)
+            line += html ? "<br>\n" : "\n";
+        write(line);
+
+        if (end)
+            break;
+    }
+
+    if (html)
+        write("</body>\n</html>\n");
+}
+
+} // namespace jpad
+} // namespace kuu
@@ -0,0 +1,63 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::jpad::FuriganaAnnotator class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <memory>
+#include <QtCore/QString>
+#include "../jmdict/jmdict.h"
+
+class QIODevice;
+
+namespace kuu
+{
+namespace jpad
+{
+
+/* ---------------------------------------------------------------- *
+   Annotates kanji words of Japanese text with their readings.
+
+   The text is segmented by longest matches against the dictionary.
+   The reading of a kanji word is the reading with the highest
+   priority score among the entries that have the word as a kanji
+   form. The kana of the word that equal the kana of the reading
+   are left outside the annotation, e.g. the reading of 食べる
+   annotates only 食.
+
+   The annotation is either HTML <ruby> markup or aozora bunko
+   style ｜漢字《かんじ》 markup. The text of a device is annotated
+   line by line so the memory use does not depend on the text size.
+ * ---------------------------------------------------------------- */
+class FuriganaAnnotator
+{
+public:
+    // Annotation markup.
+    enum class Format
+    {
+        Html,   // <ruby>漢字<rt>かんじ</rt></ruby>
+        Aozora  // ｜漢字《かんじ》
+    };
+
+    // Constructs the annotator.
+    FuriganaAnnotator(JMdictPtr dictionary, Format format);
+
+    // Returns the annotated line of text. The HTML special
+    // characters of the text are escaped in the HTML format.
+    QString annotate(const QString& text) const;
+
+    // Annotates the UTF-8 text of the input device into the output
+    // device. The HTML format is written as a complete document.
+    // Throws std::runtime_error if the output cannot be written.
+    void annotate(QIODevice& in, QIODevice& out) const;
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace jpad
+} // namespace kuu
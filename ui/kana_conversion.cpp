@@ -0,0 +1,555 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::jpad::kana_conversion namespace.
+ * ---------------------------------------------------------------- */
+
+#include "kana_conversion.h"
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QRegExp>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JPAD_KANA_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace kuu
+{
+namespace jpad
+{
+namespace kana_conversion
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+// Code unit range that is shifted by the delta. The delta wraps
+// around so that it can be used to shift down too.
+struct Range
+{
+    ushort first;
+    ushort last;
+    ushort delta;
+};
+
+// Hiragana ぁ-ゖ and ゝゞ are 0x60 code points below katakana.
+const Range HIRAGANA_TO_KATAKANA[] =
+{
+    { 0x3041, 0x3096, 0x0060 },
+    { 0x309D, 0x309E, 0x0060 }
+};
+const Range KATAKANA_TO_HIRAGANA[] =
+{
+    { 0x30A1, 0x30F6, ushort(-0x0060) },
+    { 0x30FD, 0x30FE, ushort(-0x0060) }
+};
+
+// Full-width ASCII is 0xFEE0 code points above ASCII. The space is
+// the ideographic space.
+const Range ASCII_TO_FULL_WIDTH[] =
+{
+    { 0x0021, 0x007E, 0xFEE0 },
+    { 0x0020, 0x0020, 0x3000 - 0x0020 }
+};
+const Range ASCII_TO_HALF_WIDTH[] =
+{
+    { 0xFF01, 0xFF5E, ushort(-0xFEE0) },
+    { 0x3000, 0x3000, ushort(0x0020 - 0x3000) }
+};
+
+// Folding of katakana and full-width ASCII.
+const Range FOLD[] =
+{
+    { 0x30A1, 0x30F6, ushort(-0x0060) },
+    { 0x30FD, 0x30FE, ushort(-0x0060) },
+    { 0xFF01, 0xFF5E, ushort(-0xFEE0) },
+    { 0x3000, 0x3000, ushort(0x0020 - 0x3000) }
+};
+
+// Full-width forms of the half-width katakana block ｡-ﾟ.
+const ushort HALF_WIDTH_KATAKANA_FIRST = 0xFF61;
+const ushort HALF_WIDTH_KATAKANA_LAST  = 0xFF9F;
+const ushort HALF_WIDTH_VOICED         = 0xFF9E; // ﾞ
+const ushort HALF_WIDTH_SEMI_VOICED    = 0xFF9F; // ﾟ
+const ushort FULL_WIDTH_KATAKANA[] =
+{
+    0x3002, 0x300C, 0x300D, 0x3001, 0x30FB, 0x30F2, 0x30A1, 0x30A3,
+    0x30A5, 0x30A7, 0x30A9, 0x30E3, 0x30E5, 0x30E7, 0x30C3, 0x30FC,
+    0x30A2, 0x30A4, 0x30A6, 0x30A8, 0x30AA, 0x30AB, 0x30AD, 0x30AF,
+    0x30B1, 0x30B3, 0x30B5, 0x30B7, 0x30B9, 0x30BB, 0x30BD, 0x30BF,
+    0x30C1, 0x30C4, 0x30C6, 0x30C8, 0x30CA, 0x30CB, 0x30CC, 0x30CD,
+    0x30CE, 0x30CF, 0x30D2, 0x30D5, 0x30D8, 0x30DB, 0x30DE, 0x30DF,
+    0x30E0, 0x30E1, 0x30E2, 0x30E4, 0x30E6, 0x30E8, 0x30E9, 0x30EA,
+    0x30EB, 0x30EC, 0x30ED, 0x30EF, 0x30F3, 0x309B, 0x309C
+};
+const ushort KATAKANA_U  = 0x30A6; // ウ
+const ushort KATAKANA_VU = 0x30F4; // ヴ
+
+const ushort SMALL_TSU = 0x3063; // っ
+
+/* ---------------------------------------------------------------- *
+   Returns true if the katakana has a voiced form at the next code
+   point, e.g. カ and ガ.
+ * ---------------------------------------------------------------- */
+bool hasVoicedForm(ushort c)
+{
+    return (c >= 0x30AB && c <= 0x30C2 && (c - 0x30AB) % 2 == 0) ||
+           (c >= 0x30C4 && c <= 0x30C8 && (c - 0x30C4) % 2 == 0) ||
+           (c >= 0x30CF && c <= 0x30DB && (c - 0x30CF) % 3 == 0);
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if the katakana has a semi-voiced form two code
+   points after, e.g. ハ and パ.
+ * ---------------------------------------------------------------- */
+bool hasSemiVoicedForm(ushort c)
+{ return c >= 0x30CF && c <= 0x30DB && (c - 0x30CF) % 3 == 0; }
+
+/* ---------------------------------------------------------------- *
+   Shifts the code units that are within the ranges by the range
+   delta. The ranges must not overlap.
+ * ---------------------------------------------------------------- */
+template<int N>
+void shift(QString& text, const Range (&ranges)[N])
+{
+    if (text.isEmpty())
+        return;
+
+    ushort* data = reinterpret_cast<ushort*>(text.data());
+    const int size = text.size();
+    int i = 0;
+
+#ifdef JPAD_KANA_SSE2
+    // A code unit c is in range if (c - first) <= (last - first)
+    // as unsigned. The saturated subtraction of the span is zero
+    // exactly then.
+    __m128i firsts[N], spans[N], deltas[N];
+    for (int r = 0; r < N; ++r)
+    {
+        firsts[r] = _mm_set1_epi16(short(ranges[r].first));
+        spans[r]  = _mm_set1_epi16(short(ranges[r].last - ranges[r].first));
+        deltas[r] = _mm_set1_epi16(short(ranges[r].delta));
+    }
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 8 <= size; i += 8)
+    {
+        __m128i* p = reinterpret_cast<__m128i*>(data + i);
+        const __m128i v = _mm_loadu_si128(p);
+        __m128i add = zero;
+        for (int r = 0; r < N; ++r)
+        {
+            const __m128i offset  = _mm_sub_epi16(v, firsts[r]);
+            const __m128i inRange = _mm_cmpeq_epi16(
+                _mm_subs_epu16(offset, spans[r]), zero);
+            add = _mm_or_si128(add, _mm_and_si128(inRange, deltas[r]));
+        }
+        _mm_storeu_si128(p, _mm_add_epi16(v, add));
+    }
+#endif
+
+    for (; i < size; ++i)
+    {
+        for (int r = 0; r < N; ++r)
+        {
+            if (data[i] >= ranges[r].first && data[i] <= ranges[r].last)
+            {
+                data[i] = ushort(data[i] + ranges[r].delta);
+                break;
+            }
+        }
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Romaji key sequences of the hiragana input.
+ * ---------------------------------------------------------------- */
+struct RomajiTable
+{
+    // Reads the key sequences from the resource file.
+    RomajiTable()
+    {
+        QFile file(":/hiragana_keys.txt");
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+            return;
+
+        QTextStream ts(&file);
+        while (!ts.atEnd())
+        {
+            const QString line = ts.readLine().trimmed();
+            if (line.startsWith(";") || line.isEmpty())
+                continue;
+
+            const QStringList splits =
+                line.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+            if (splits.size() != 2)
+                continue;
+
+            const QString romaji = splits[0].toLower();
+            QString hiragana;
+            for (const QString& part : splits[1].split(","))
+            {
+                bool ok = false;
+                const ushort c = part.toUShort(&ok, 16);
+                if (ok)
+                    hiragana += QChar(c);
+            }
+            if (hiragana.isEmpty())
+                continue;
+
+            // The doubled consonants are derived from the next key
+            // sequence.
+            if (hiragana[0].unicode() == SMALL_TSU)
+                continue;
+
+            if (!toHiragana.contains(romaji))
+            {
+                toHiragana.insert(romaji, hiragana);
+                maxRomajiLength = qMax(maxRomajiLength, romaji.size());
+            }
+
+            auto it = toRomaji.find(hiragana);
+            if (it == toRomaji.end() || it.value().size() > romaji.size())
+            {
+                toRomaji.insert(hiragana, romaji);
+                maxKanaLength = qMax(maxKanaLength, hiragana.size());
+            }
+        }
+    }
+
+    QHash<QString, QString> toHiragana;
+    QHash<QString, QString> toRomaji;
+    int maxRomajiLength = 0;
+    int maxKanaLength = 0;
+};
+
+/* ---------------------------------------------------------------- *
+   Returns the romaji table. The table is read once.
+ * ---------------------------------------------------------------- */
+const RomajiTable& romajiTable()
+{
+    static const RomajiTable table;
+    return table;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if the character is a romaji vowel or y.
+ * ---------------------------------------------------------------- */
+bool isVowelOrY(QChar c)
+{
+    const QChar l = c.toLower();
+    return l == 'a' || l == 'i' || l == 'u' || l == 'e' || l == 'o' ||
+           l == 'y';
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if the romaji character at the index is a consonant
+   that is doubled by the next character. A doubled n is ん.
+ * ---------------------------------------------------------------- */
+bool isDoubledConsonant(const QString& romaji, int i)
+{
+    if (i + 1 >= romaji.size() || romaji[i] != romaji[i + 1])
+        return false;
+    const QChar c = romaji[i];
+    return c >= 'a' && c <= 'z' && c != 'n' && !isVowelOrY(c);
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Converts the text.
+ * ---------------------------------------------------------------- */
+QString convert(const QString& text, Conversion conversion)
+{
+    switch (conversion)
+    {
+        case Conversion::HiraganaToKatakana: return hiraganaToKatakana(text);
+        case Conversion::KatakanaToHiragana: return katakanaToHiragana(text);
+        case Conversion::ToFullWidth:        return toFullWidth(text);
+        case Conversion::ToHalfWidth:        return toHalfWidth(text);
+        case Conversion::KanaToRomaji:       return kanaToRomaji(text);
+        case Conversion::RomajiToKana:       return romajiToKana(text);
+    }
+    return text;
+}
+
+/* ---------------------------------------------------------------- *
+   Converts the hiraganas into katakanas.
+ * ---------------------------------------------------------------- */
+QString hiraganaToKatakana(const QString& text)
+{
+    QString out = text;
+    shift(out, HIRAGANA_TO_KATAKANA);
+    return out;
+}
+
+/* ---------------------------------------------------------------- *
+   Converts the katakanas into hiraganas.
+ * ---------------------------------------------------------------- */
+QString katakanaToHiragana(const QString& text)
+{
+    QString out = text;
+    shift(out, KATAKANA_TO_HIRAGANA);
+    return out;
+}
+
+/* ---------------------------------------------------------------- *
+   Converts the ASCII and the half-width katakanas into full-width
+   forms. The voiced marks are combined into the katakana.
+ * ---------------------------------------------------------------- */
+QString toFullWidth(const QString& text)
+{
+    QString out;
+    out.reserve(text.size());
+    for (int i = 0; i < text.size(); ++i)
+    {
+        const ushort c = text[i].unicode();
+        if (c < HALF_WIDTH_KATAKANA_FIRST || c > HALF_WIDTH_KATAKANA_LAST)
+        {
+            out += text[i];
+            continue;
+        }
+
+        ushort full = FULL_WIDTH_KATAKANA[c - HALF_WIDTH_KATAKANA_FIRST];
+        const ushort next = i + 1 < text.size() ? text[i + 1].unicode() : 0;
+        if (next == HALF_WIDTH_VOICED && full == KATAKANA_U)
+        {
+            full = KATAKANA_VU;
+            ++i;
+        }
+        else if (next == HALF_WIDTH_VOICED && hasVoicedForm(full))
+        {
+            full += 1;
+            ++i;
+        }
+        else if (next == HALF_WIDTH_SEMI_VOICED && hasSemiVoicedForm(full))
+        {
+            full += 2;
+            ++i;
+        }
+        out += QChar(full);
+    }
+
+    shift(out, ASCII_TO_FULL_WIDTH);
+    return out;
+}
+
+/* ---------------------------------------------------------------- *
+   Converts the full-width ASCII and the katakanas into half-width
+   forms. The voiced katakanas are followed by the voiced marks.
+ * ---------------------------------------------------------------- */
+QString toHalfWidth(const QString& text)
+{
+    // Half-width forms of the full-width katakanas and punctuation.
+    static const QHash<ushort, ushort> halfWidth = []()
+    {
+        QHash<ushort, ushort> hash;
+        const int count = HALF_WIDTH_KATAKANA_LAST -
+                          HALF_WIDTH_KATAKANA_FIRST + 1;
+        for (int i = 0; i < count; ++i)
+            hash.insert(FULL_WIDTH_KATAKANA[i],
+                        ushort(HALF_WIDTH_KATAKANA_FIRST + i));
+        return hash;
+    }();
+
+    QString out = text;
+    shift(out, ASCII_TO_HALF_WIDTH);
+
+    // Most of the text is not katakana, the string is rebuilt only
+    // if there are any.
+    int i = 0;
+    while (i < out.size() &&
+           !(out[i].unicode() >= 0x3001 && out[i].unicode() <= 0x30FE))
+    {
+        ++i;
+    }
+    if (i == out.size())
+        return out;
+
+    QString result = out.left(i);
+    result.reserve(out.size() + out.size() / 4);
+    for (; i < out.size(); ++i)
+    {
+        const ushort c = out[i].unicode();
+        auto it = halfWidth.constFind(c);
+        if (it != halfWidth.constEnd())
+        {
+            result += QChar(it.value());
+            continue;
+        }
+
+        if (c == KATAKANA_VU)
+        {
+            result += QChar(halfWidth.value(KATAKANA_U));
+            result += QChar(HALF_WIDTH_VOICED);
+            continue;
+        }
+
+        const ushort voiced = ushort(c - 1);
+        if (hasVoicedForm(voiced))
+        {
+            result += QChar(halfWidth.value(voiced));
+            result += QChar(HALF_WIDTH_VOICED);
+            continue;
+        }
+
+        const ushort semiVoiced = ushort(c - 2);
+        if (hasSemiVoicedForm(semiVoiced))
+        {
+            result += QChar(halfWidth.value(semiVoiced));
+            result += QChar(HALF_WIDTH_SEMI_VOICED);
+            continue;
+        }
+
+        result += out[i];
+    }
+    return result;
+}
+
+/* ---------------------------------------------------------------- *
+   Converts the kanas into romaji. The katakanas are converted into
+   hiraganas first. The kanas are matched longest first so that e.g.
+   きゃ is kya instead of kiゃ. A small tsu doubles the consonant of
+   the next kana.
+ * ---------------------------------------------------------------- */
+QString kanaToRomaji(const QString& text)
+{
+    const RomajiTable& table = romajiTable();
+    const QString hiragana = katakanaToHiragana(text);
+
+    QString out;
+    out.reserve(text.size() * 2);
+
+    int i = 0;
+    while (i < hiragana.size())
+    {
+        const bool doubled = hiragana[i].unicode() == SMALL_TSU;
+        const int start = doubled ? i + 1 : i;
+
+        QString romaji;
+        int length = qMin(table.maxKanaLength, hiragana.size() - start);
+        for (; length > 0; --length)
+        {
+            auto it = table.toRomaji.constFind(hiragana.mid(start, length));
+            if (it != table.toRomaji.constEnd())
+            {
+                romaji = it.value();
+                break;
+            }
+        }
+
+        if (romaji.isEmpty() || (doubled && isVowelOrY(romaji[0])))
+        {
+            out += text[i];
+            ++i;
+            continue;
+        }
+
+        if (doubled)
+            out += romaji[0];
+        out += romaji;
+        i = start + length;
+    }
+    return out;
+}
+
+/* ---------------------------------------------------------------- *
+   Converts the romaji into hiraganas. The key sequences are
+   matched longest first. A doubled consonant other than n is a
+   small tsu, e.g. gakkou is がっこう. A single n that is not
+   followed by a vowel is ん and so is the first n of nn followed
+   by a vowel, e.g. minna is みんな.
+ * ---------------------------------------------------------------- */
+QString romajiToKana(const QString& text)
+{
+    const RomajiTable& table = romajiTable();
+    const QString lower = text.toLower();
+
+    QString out;
+    out.reserve(text.size());
+
+    int i = 0;
+    while (i < lower.size())
+    {
+        if (isDoubledConsonant(lower, i))
+        {
+            out += QChar(SMALL_TSU);
+            ++i;
+            continue;
+        }
+
+        if (lower[i] == 'n' && i + 2 < lower.size() &&
+            lower[i + 1] == 'n' && isVowelOrY(lower[i + 2]))
+        {
+            out += table.toHiragana.value("nn");
+            ++i;
+            continue;
+        }
+
+        int length = qMin(table.maxRomajiLength, lower.size() - i);
+        for (; length > 0; --length)
+        {
+            auto it = table.toHiragana.constFind(lower.mid(i, length));
+            if (it != table.toHiragana.constEnd())
+            {
+                out += it.value();
+                break;
+            }
+        }
+
+        if (length > 0)
+        {
+            i += length;
+            continue;
+        }
+
+        if (lower[i] == 'n' &&
+            (i + 1 == lower.size() || !isVowelOrY(lower[i + 1])))
+        {
+            out += table.toHiragana.value("nn");
+        }
+        else
+        {
+            out += text[i];
+        }
+        ++i;
+    }
+    return out;
+}
+
+/* ---------------------------------------------------------------- *
+   Folds the text. The half-width katakanas are folded one by one
+   so a voiced half-width katakana stays as two characters.
+ * ---------------------------------------------------------------- */
+QString fold(const QString& text)
+{
+    QString out = text;
+    shift(out, FOLD);
+
+    ushort* data = reinterpret_cast<ushort*>(out.data());
+    for (int i = 0; i < out.size(); ++i)
+    {
+        if (data[i] < HALF_WIDTH_KATAKANA_FIRST ||
+            data[i] > HALF_WIDTH_KATAKANA_LAST)
+        {
+            continue;
+        }
+
+        ushort c = FULL_WIDTH_KATAKANA[data[i] - HALF_WIDTH_KATAKANA_FIRST];
+        if (c >= 0x30A1 && c <= 0x30F6)
+            c = ushort(c - 0x60);
+        data[i] = c;
+    }
+    return out;
+}
+
+} // namespace kana_conversion
+} // namespace jpad
+} // namespace kuu
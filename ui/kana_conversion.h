@@ -0,0 +1,73 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::jpad::kana_conversion namespace.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <QtCore/QString>
+
+namespace kuu
+{
+namespace jpad
+{
+namespace kana_conversion
+{
+
+/* ---------------------------------------------------------------- *
+   Bulk conversions of text. The characters that the conversion
+   does not apply to are kept as is.
+ * ---------------------------------------------------------------- */
+enum class Conversion
+{
+    HiraganaToKatakana,
+    KatakanaToHiragana,
+    ToFullWidth,   // ASCII and half-width katakana to full-width
+    ToHalfWidth,   // full-width ASCII and katakana to half-width
+    KanaToRomaji,
+    RomajiToKana
+};
+
+/* ---------------------------------------------------------------- *
+   Converts the text. The kana and the ASCII width conversions are
+   done in place with SIMD kernels when they are available.
+ * ---------------------------------------------------------------- */
+QString convert(const QString& text, Conversion conversion);
+
+/* ---------------------------------------------------------------- *
+   Converts the hiraganas into katakanas and back.
+ * ---------------------------------------------------------------- */
+QString hiraganaToKatakana(const QString& text);
+QString katakanaToHiragana(const QString& text);
+
+/* ---------------------------------------------------------------- *
+   Converts the ASCII and the katakana characters into full-width
+   and half-width forms. A voiced half-width katakana is two
+   characters, e.g. ｶﾞ is ガ.
+ * ---------------------------------------------------------------- */
+QString toFullWidth(const QString& text);
+QString toHalfWidth(const QString& text);
+
+/* ---------------------------------------------------------------- *
+   Converts the kanas into romaji and romaji into hiraganas. The
+   romaji follows the key sequences of the hiragana input, e.g.
+   こんにちは is konnnichiha.
+ * ---------------------------------------------------------------- */
+QString kanaToRomaji(const QString& text);
+QString romajiToKana(const QString& text);
+
+/* ---------------------------------------------------------------- *
+   Folds the text for kana and width insensitive matching. The
+   katakanas are folded into hiraganas and full-width ASCII into
+   ASCII. The length of the text is kept so the positions of the
+   folded text are the positions of the text. Therefore a half-width
+   katakana with a separate voicing mark, e.g. ｶﾞ, stays two
+   characters and does not match the composed が.
+ * ---------------------------------------------------------------- */
+QString fold(const QString& text);
+
+} // namespace kana_conversion
+} // namespace jpad
+} // namespace kuu
@@ -8,17 +8,28 @@
 #include "main_window.h"
 #include "ui_main_window.h"
 #include <QtCore/QFile>
+#include <QtCore/QPointer>
 #include <QtCore/QStandardPaths>
-#include <QtCore/QTextStream>
+#include <QtGui/QTextBlock>
+#include <QtGui/QTextDocument>
+#include <QtWidgets/QActionGroup>
 #include <QtWidgets/QFileDialog>
 #include <QtWidgets/QLabel>
 #include <QtWidgets/QMessageBox>
+#include <QtWidgets/QProgressBar>
+#include <QtWidgets/QToolButton>
+#include <QtWidgets/QVBoxLayout>
 #include <QPrintDialog>
 #include <QPrinter>
 #include "about_dialog.h"
 #include "dictionary_dialog.h"
+#include "document_journal.h"
+#include "find_bar.h"
 #include "preferences_dialog.h"
 #include "text_editor.h"
+#include "text_file_reader.h"
+#include "text_file_writer.h"
+#include "vocabulary_exporter.h"
 
 namespace kuu
 {
@@ -31,51 +42,23 @@ namespace
    Definitions
  * ---------------------------------------------------------------- */
 static const QString UNTITLED_FILE = "untitled";
+static const int SAVE_CHUNK_SIZE = 256 * 1024;
+// Files larger than this are opened in the large file mode.
+static const qint64 LARGE_FILE_SIZE = 64 * 1024 * 1024;
+// Suffix of the file that a large file is saved into before it
+// replaces the file.
+static const QString LARGE_FILE_SAVE_SUFFIX = ".saving";
 
 /* ---------------------------------------------------------------- *
-   Saves the text file as UTF-8 with BOM.
+   Returns the path of the edit journal file.
  * ---------------------------------------------------------------- */
-void saveFile(const QString& filePath, const QString& source)
+QString journalFilePath()
 {
-    QFileInfo fi(filePath);
-    QDir dir = fi.absoluteDir();
-    if (!dir.exists() && !dir.mkpath(dir.absolutePath()))
-        throw std::runtime_error(
-            QString("Failed to make path %1")
-                .arg(dir.absolutePath()).toStdString());
-
-    QFile file(filePath);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
-        throw std::runtime_error(
-            "Failed to create file " +
-                filePath.toStdString());
-
-    QTextStream stream(&file);
-    stream.setCodec("UTF-8");
-    stream.setGenerateByteOrderMark(true);
-    stream<< source;
-    stream.flush();
-
-    file.close();
-}
-
-/* ---------------------------------------------------------------- *
-   Loads a UTF-8 text file.
- * ---------------------------------------------------------------- */
-QString loadFile(const QString& filePath)
-{
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
-        throw std::runtime_error(
-            "Failed to load file " +
-                filePath.toStdString());
-
-    QTextStream stream(&file);
-    stream.setCodec("UTF-8");
-    QString out = stream.readAll();
-
-    file.close();
-    return out;
+    const QDir dir(QStandardPaths::writableLocation(
+        QStandardPaths::AppLocalDataLocation));
+    if (!dir.exists())
+        dir.mkpath(dir.absolutePath());
+    return dir.absoluteFilePath("edit_journal.bin");
 }
 
 } // anonymous namespace
@@ -86,8 +69,22 @@ QString loadFile(const QString& filePath)
 struct MainWindow::Impl
 {
     Ui::MainWindow ui;
+    QActionGroup* editActions; // disabled while the text is locked
     QLabel* keySequenceLabel;
+    QProgressBar* loadProgressBar;
+    QToolButton* loadCancelButton;
+    TextFileReader* reader = nullptr;
+    bool loadFailed = false;
+    QPointer<TextFileWriter> writer;
+    QTextBlock saveBlock;     // next block to save
+    bool saving = false;      // document is being saved
+    bool saveReadOnly = false;
+    int saveCount = 0;        // count of started saves
+    QString largeFileSavePath; // large file saved next to the file
+    QPointer<VocabularyExporter> exporter;
+    DocumentJournal* journal = nullptr;
     TextEditor* textEditor = nullptr;
+    FindBar* findBar = nullptr;
     QString currentFile = "untitled";
     SettingsPtr settings;
 };
@@ -102,6 +99,20 @@ MainWindow::MainWindow(QWidget* parent)
     impl->ui.setupUi(this);
     impl->ui.actionSave->setEnabled(false);
     impl->ui.actionReadingToKanji->setEnabled(false);
+
+    // The actions that edit the text or read it for saving. A
+    // disabled group keeps the enabled states of its actions.
+    impl->editActions = new QActionGroup(this);
+    impl->editActions->setExclusive(false);
+    impl->editActions->addAction(impl->ui.actionSave);
+    impl->editActions->addAction(impl->ui.actionReadingToKanji);
+    impl->editActions->addAction(impl->ui.actionHiraganaToKatakana);
+    impl->editActions->addAction(impl->ui.actionKatakanaToHiragana);
+    impl->editActions->addAction(impl->ui.actionToFullWidth);
+    impl->editActions->addAction(impl->ui.actionToHalfWidth);
+    impl->editActions->addAction(impl->ui.actionKanaToRomaji);
+    impl->editActions->addAction(impl->ui.actionRomajiToKana);
+
     impl->ui.toolBar->addAction(impl->ui.actionNewFile->icon(),
                                 impl->ui.actionNewFile->text());
     impl->ui.toolBar->addAction(impl->ui.actionOpen->icon(),
@@ -129,6 +140,20 @@ MainWindow::MainWindow(QWidget* parent)
     impl->ui.toolBar->setVisible(false);
     impl->keySequenceLabel = new QLabel;
     statusBar()->addWidget(impl->keySequenceLabel);
+
+    impl->loadProgressBar = new QProgressBar;
+    impl->loadProgressBar->setRange(0, 100);
+    impl->loadProgressBar->setMaximumWidth(200);
+    impl->loadProgressBar->hide();
+    statusBar()->addPermanentWidget(impl->loadProgressBar);
+
+    impl->loadCancelButton = new QToolButton;
+    impl->loadCancelButton->setText("Cancel");
+    impl->loadCancelButton->hide();
+    statusBar()->addPermanentWidget(impl->loadCancelButton);
+    connect(impl->loadCancelButton, &QToolButton::clicked,
+            this, &MainWindow::onLoadCancelled);
+
     updateWindowTitle();
 
 #ifdef Q_OS_MACOS
@@ -143,7 +168,20 @@ MainWindow::MainWindow(QWidget* parent)
 void MainWindow::setTextEditor(TextEditor* editor)
 {
     impl->textEditor = editor;
-    setCentralWidget(editor);
+
+    // The find bar is below the editor.
+    QWidget* central = new QWidget(this);
+    QVBoxLayout* layout = new QVBoxLayout(central);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->setSpacing(0);
+    layout->addWidget(editor);
+    impl->findBar = new FindBar(editor, central);
+    impl->findBar->hide();
+    layout->addWidget(impl->findBar);
+    setCentralWidget(central);
+
+    impl->journal = new DocumentJournal(
+        journalFilePath(), editor->document(), this);
 
     QObject::connect(
         editor, &TextEditor::copyAvailable,
@@ -166,6 +204,23 @@ void MainWindow::setTextEditor(TextEditor* editor)
     QObject::connect(
         impl->ui.actionSelectAll, &QAction::triggered,
                 editor, &TextEditor::selectAll);
+
+    QObject::connect(
+        editor, &TextEditor::replaceAllStarted,
+        this, &MainWindow::updateEditActions);
+    QObject::connect(
+        editor, &TextEditor::replaceAllFinished,
+        this, &MainWindow::updateEditActions);
+
+    QObject::connect(
+        editor, &TextEditor::largeFileIndexProgressChanged,
+        impl->loadProgressBar, &QProgressBar::setValue);
+    QObject::connect(
+        editor, &TextEditor::largeFileIndexed,
+        impl->loadProgressBar, &QProgressBar::hide);
+    QObject::connect(
+        editor, &TextEditor::largeFileIndexed,
+        impl->loadCancelButton, &QToolButton::hide);
 }
 
 /* ---------------------------------------------------------------- *
@@ -175,15 +230,27 @@ void MainWindow::setSettings(SettingsPtr settings)
 {
     impl->settings = settings;
 
+    // Edits that were not saved on the last run.
+    QString text, currentFile;
+    if (DocumentJournal::recover(journalFilePath(), text, currentFile))
+    {
+        impl->textEditor->setPlainText(text);
+        impl->journal->start(currentFile);
+        impl->currentFile = currentFile;
+        impl->ui.actionSave->setEnabled(currentFile != UNTITLED_FILE);
+        impl->textEditor->document()->setModified(true);
+        updateWindowTitle();
+        return;
+    }
+
     if (!impl->settings->textBuffer.path.isEmpty() &&
         QFile::exists(impl->settings->textBuffer.path))
     {
-        QString source = loadFile(impl->settings->textBuffer.path);
-        impl->textEditor->setPlainText(source);
-        impl->currentFile = UNTITLED_FILE;
-        impl->ui.actionSave->setEnabled(true);
-        setWindowModified(false);
-        updateWindowTitle();
+        loadFile(impl->settings->textBuffer.path, UNTITLED_FILE);
+    }
+    else
+    {
+        impl->journal->start(UNTITLED_FILE);
     }
 }
 
@@ -210,21 +277,25 @@ void MainWindow::onTextEditorSelectionChanged()
  * ---------------------------------------------------------------- */
 void MainWindow::closeEvent(QCloseEvent* event)
 {
-    if (!isWindowModified())
-        return;
+    cancelLoading();
+    if (impl->exporter)
+        impl->exporter->cancel();
 
+    // The temporary buffer is restored from the journal on the
+    // next start.
     if (impl->settings->textBuffer.temp)
     {
-        QString appDataDir =
-            QStandardPaths::writableLocation(
-                QStandardPaths::AppLocalDataLocation);
-        QString tempFilePath  =
-            QDir(appDataDir).absoluteFilePath("temp_buffer.txt");
-        saveFile(tempFilePath, impl->textEditor->toPlainText());
-        impl->settings->textBuffer.path = tempFilePath;
+        impl->journal->flush();
+        impl->settings->textBuffer.path = "";
         return QMainWindow::closeEvent(event);
     }
 
+    if (!isWindowModified())
+    {
+        impl->journal->remove();
+        return;
+    }
+
     QMessageBox msgBox(this);
     msgBox.setIconPixmap(style()->standardPixmap(QStyle::SP_MessageBoxQuestion));
     msgBox.setWindowTitle("Save changes.");
@@ -233,8 +304,32 @@ void MainWindow::closeEvent(QCloseEvent* event)
     msgBox.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
 
     const int answer = msgBox.exec();
-    if (answer == QMessageBox::Save)
-        on_actionSave_triggered();
+    if (answer == QMessageBox::Yes)
+    {
+        // Save As might be cancelled without starting a save.
+        const int saveCount = impl->saveCount;
+        if (impl->currentFile.isEmpty() ||
+            impl->currentFile == UNTITLED_FILE)
+        {
+            on_actionSaveAs_triggered();
+        }
+        else
+            on_actionSave_triggered();
+        waitSaving();
+
+        // The journal is the only copy of the changes until the
+        // file has been saved. The window stays open to show the
+        // error.
+        if (saveCount == impl->saveCount ||
+            !impl->writer || !impl->writer->isSaved() ||
+            impl->textEditor->document()->isModified())
+        {
+            impl->journal->flush();
+            event->ignore();
+            return;
+        }
+    }
+    impl->journal->remove();
 
     QMainWindow::closeEvent(event);
 }
@@ -247,10 +342,16 @@ void MainWindow::on_actionNewFile_triggered()
     if (isWindowModified())
         askChangesSave();
 
+    cancelLoading();
+    waitSaving();
+    impl->textEditor->cancelReplaceAll();
     impl->settings->textBuffer.path = "";
     impl->settings->textBuffer.temp = true;
     impl->currentFile = UNTITLED_FILE;
+    impl->journal->stop();
+    impl->textEditor->closeLargeFile();
     impl->textEditor->setPlainText("");
+    impl->journal->start(UNTITLED_FILE);
     impl->ui.actionSave->setEnabled(false);
     setWindowModified(false);
     updateWindowTitle();
@@ -278,24 +379,7 @@ void MainWindow::on_actionOpen_triggered()
     if (isWindowModified())
         askChangesSave();
 
-    try
-    {
-        QString source = loadFile(fileName);
-        impl->textEditor->setPlainText(source);
-        impl->currentFile = fileName;
-        impl->ui.actionSave->setEnabled(true);
-        impl->settings->textBuffer.path = fileName;
-        impl->settings->textBuffer.temp = false;
-        setWindowModified(false);
-        updateWindowTitle();
-    }
-    catch(const std::runtime_error& ex)
-    {
-        QMessageBox::critical(
-            this,
-            "Save failed",
-            ex.what());
-    }
+    loadFile(fileName, fileName);
 }
 
 /* ---------------------------------------------------------------- *
@@ -303,20 +387,9 @@ void MainWindow::on_actionOpen_triggered()
  * ---------------------------------------------------------------- */
 void MainWindow::on_actionSave_triggered()
 {
-    try
-    {
-        saveFile(impl->currentFile, impl->textEditor->toPlainText());
-        impl->ui.actionSave->setEnabled(true);
-        setWindowModified(false);
-        updateWindowTitle();
-    }
-    catch(const std::runtime_error& ex)
-    {
-        QMessageBox::critical(
-            this,
-            "Save failed",
-            ex.what());
-    }
+    saveFile(impl->currentFile);
+    impl->ui.actionSave->setEnabled(true);
+    updateWindowTitle();
 }
 
 /* ---------------------------------------------------------------- *
@@ -338,23 +411,12 @@ void MainWindow::on_actionSaveAs_triggered()
     if (fileName.isEmpty())
         return;
 
-    try
-    {
-        saveFile(fileName, impl->textEditor->toPlainText());
-        impl->currentFile = fileName;
-        impl->ui.actionSave->setEnabled(true);
-        impl->settings->textBuffer.path = fileName;
-        impl->settings->textBuffer.temp = false;
-        setWindowModified(false);
-        updateWindowTitle();
-    }
-    catch(const std::runtime_error& ex)
-    {
-        QMessageBox::critical(
-            this,
-            "Save failed",
-            ex.what());
-    }
+    saveFile(fileName);
+    impl->currentFile = fileName;
+    impl->ui.actionSave->setEnabled(true);
+    impl->settings->textBuffer.path = fileName;
+    impl->settings->textBuffer.temp = false;
+    updateWindowTitle();
 }
 
 /* ---------------------------------------------------------------- *
@@ -380,6 +442,54 @@ void MainWindow::on_actionReadingToKanji_triggered()
     impl->textEditor->readingToKanji();
 }
 
+/* ---------------------------------------------------------------- *
+   Show the find bar.
+ * ---------------------------------------------------------------- */
+void MainWindow::on_actionFind_triggered()
+{
+    if (impl->findBar)
+        impl->findBar->activate();
+}
+
+/* ---------------------------------------------------------------- *
+   Convert the selected text or the whole document.
+ * ---------------------------------------------------------------- */
+void MainWindow::on_actionHiraganaToKatakana_triggered()
+{
+    impl->textEditor->convertText(
+        kana_conversion::Conversion::HiraganaToKatakana);
+}
+
+void MainWindow::on_actionKatakanaToHiragana_triggered()
+{
+    impl->textEditor->convertText(
+        kana_conversion::Conversion::KatakanaToHiragana);
+}
+
+void MainWindow::on_actionToFullWidth_triggered()
+{
+    impl->textEditor->convertText(
+        kana_conversion::Conversion::ToFullWidth);
+}
+
+void MainWindow::on_actionToHalfWidth_triggered()
+{
+    impl->textEditor->convertText(
+        kana_conversion::Conversion::ToHalfWidth);
+}
+
+void MainWindow::on_actionKanaToRomaji_triggered()
+{
+    impl->textEditor->convertText(
+        kana_conversion::Conversion::KanaToRomaji);
+}
+
+void MainWindow::on_actionRomajiToKana_triggered()
+{
+    impl->textEditor->convertText(
+        kana_conversion::Conversion::RomajiToKana);
+}
+
 /* ---------------------------------------------------------------- *
    Use hiragana/katakana input.
  * ---------------------------------------------------------------- */
@@ -424,6 +534,79 @@ void MainWindow::on_actionDictionary_triggered()
     dictionaryDlg.exec();
 }
 
+/* ---------------------------------------------------------------- *
+   Export the vocabulary of the document into a CSV or a TSV file.
+   The words are counted in the background.
+ * ---------------------------------------------------------------- */
+void MainWindow::on_actionExportVocabulary_triggered()
+{
+    if (impl->exporter)
+        return;
+
+    JMdictPtr dictionary = impl->textEditor->dictionary();
+    if (!dictionary)
+    {
+        QMessageBox::information(this, "Export Vocabulary",
+                                 "The dictionary has not been loaded.");
+        return;
+    }
+
+    QString currentDir = QDir::currentPath();
+    if (!impl->currentFile.isEmpty())
+        currentDir = QFileInfo(impl->currentFile)
+            .absoluteDir()
+            .absolutePath();
+
+    const QString csvFilter = "CSV files (*.csv)";
+    QString selectedFilter;
+    QString fileName =
+        QFileDialog::getSaveFileName(
+            this,
+            "Export Vocabulary",
+            currentDir,
+            "TSV files (*.tsv);;" + csvFilter,
+            &selectedFilter);
+    if (fileName.isEmpty())
+        return;
+    if (QFileInfo(fileName).suffix().isEmpty())
+        fileName += selectedFilter == csvFilter ? ".csv" : ".tsv";
+
+    VocabularyExporter* exporter = nullptr;
+    if (impl->textEditor->isLargeFileMode())
+    {
+        exporter = new VocabularyExporter(
+            dictionary, impl->textEditor->largeFileText(), fileName, this);
+    }
+    else
+    {
+        QTextDocument* doc = impl->textEditor->document();
+        std::vector<QString> blocks;
+        blocks.reserve(size_t(doc->blockCount()));
+        for (QTextBlock block = doc->begin(); block.isValid(); block = block.next())
+            blocks.push_back(block.text());
+        exporter = new VocabularyExporter(dictionary, blocks, fileName, this);
+    }
+    impl->exporter = exporter;
+
+    connect(exporter, &VocabularyExporter::finished,
+            exporter, &QObject::deleteLater);
+    connect(exporter, &VocabularyExporter::exported,
+            this, [this](int wordCount)
+    {
+        statusBar()->showMessage(
+            QString("Exported %1 words").arg(wordCount), 5000);
+    });
+    connect(exporter, &VocabularyExporter::failed,
+            this, [this](const QString& error)
+    {
+        statusBar()->clearMessage();
+        QMessageBox::critical(this, "Export failed", error);
+    });
+
+    statusBar()->showMessage("Exporting vocabulary...");
+    exporter->start();
+}
+
 /* ---------------------------------------------------------------- *
    Show preferences dialog.
  * ---------------------------------------------------------------- */
@@ -451,6 +634,349 @@ void MainWindow::on_actionAbout_triggered()
     aboutDlg.exec();
 }
 
+/* ---------------------------------------------------------------- *
+   User has cancelled loading a file. Start from an empty file.
+ * ---------------------------------------------------------------- */
+void MainWindow::onLoadCancelled()
+{
+    cancelLoading();
+    impl->textEditor->cancelReplaceAll();
+
+    impl->currentFile = UNTITLED_FILE;
+    impl->journal->stop();
+    impl->textEditor->closeLargeFile();
+    impl->textEditor->setPlainText("");
+    impl->journal->start(UNTITLED_FILE);
+    impl->ui.actionSave->setEnabled(false);
+    setWindowModified(false);
+    updateWindowTitle();
+}
+
+/* ---------------------------------------------------------------- *
+   Starts loading a UTF-8 text file in the background. The text is
+   inserted into the editor in chunks while the file is read. The
+   current file is set to be the given in file when the whole
+   file has been loaded.
+ * ---------------------------------------------------------------- */
+void MainWindow::loadFile(const QString& filePath,
+                          const QString& currentFile)
+{
+    cancelLoading();
+    waitSaving();
+    impl->journal->stop();
+
+    TextEditor* editor = impl->textEditor;
+    editor->cancelReplaceAll();
+    if (QFileInfo(filePath).size() >= LARGE_FILE_SIZE)
+    {
+        try
+        {
+            editor->openLargeFile(filePath);
+            setLoadedFile(filePath, currentFile);
+
+            // The lines are indexed in the background.
+            impl->loadProgressBar->setValue(0);
+            impl->loadProgressBar->show();
+            impl->loadCancelButton->show();
+        }
+        catch (const std::runtime_error& ex)
+        {
+            QMessageBox::critical(this, "Open failed", ex.what());
+            onLoadCancelled();
+        }
+        return;
+    }
+
+    editor->closeLargeFile();
+    editor->setPlainText("");
+    editor->setReadOnly(true);
+    editor->document()->setUndoRedoEnabled(false);
+
+    TextFileReader* reader = new TextFileReader(filePath, this);
+    impl->reader = reader;
+    impl->loadFailed = false;
+
+    // The reader might have been cancelled while its chunks were
+    // still queued. Those chunks are ignored.
+    connect(reader, &TextFileReader::chunkRead,
+            this, [this, reader](const QString& text)
+    {
+        if (reader != impl->reader)
+            return;
+
+        QTextCursor tc(impl->textEditor->document());
+        tc.movePosition(QTextCursor::End);
+        tc.insertText(text);
+        reader->chunkConsumed();
+    });
+
+    connect(reader, &TextFileReader::progressChanged,
+            this, [this, reader](int percent)
+    {
+        if (reader == impl->reader)
+            impl->loadProgressBar->setValue(percent);
+    });
+
+    connect(reader, &TextFileReader::failed,
+            this, [this, reader](const QString& error)
+    {
+        if (reader != impl->reader)
+            return;
+
+        impl->loadFailed = true;
+        QMessageBox::critical(this, "Open failed", error);
+    });
+
+    connect(reader, &TextFileReader::finished,
+            this, [this, reader, filePath, currentFile]()
+    {
+        reader->deleteLater();
+        if (reader != impl->reader)
+            return;
+
+        const bool failed = impl->loadFailed;
+        cancelLoading();
+        if (failed)
+            onLoadCancelled();
+        else
+            setLoadedFile(filePath, currentFile);
+    });
+
+    impl->loadProgressBar->setValue(0);
+    impl->loadProgressBar->show();
+    impl->loadCancelButton->show();
+    reader->start();
+}
+
+/* ---------------------------------------------------------------- *
+   The file has been loaded into the editor. The journal is not
+   used in the large file mode.
+ * ---------------------------------------------------------------- */
+void MainWindow::setLoadedFile(const QString& filePath,
+                               const QString& currentFile)
+{
+    impl->textEditor->document()->setModified(false);
+    if (!impl->textEditor->isLargeFileMode())
+        impl->journal->start(currentFile, filePath);
+    impl->currentFile = currentFile;
+    impl->ui.actionSave->setEnabled(true);
+    if (currentFile != UNTITLED_FILE)
+    {
+        impl->settings->textBuffer.path = filePath;
+        impl->settings->textBuffer.temp = false;
+    }
+    setWindowModified(false);
+    updateWindowTitle();
+}
+
+/* ---------------------------------------------------------------- *
+   Starts saving the document into a UTF-8 text file with BOM. The
+   text of document blocks is passed to a background writer in
+   chunks from the event loop each time the writer has written a
+   chunk, so that neither the document is copied nor the GUI is
+   blocked. The editor is read-only until all of the blocks have
+   been passed. The encoding and the disk writes are done by the
+   writer. The document is marked as unmodified immediately and
+   again as modified if the saving fails. In the large file mode the
+   piece table is written as it is.
+ * ---------------------------------------------------------------- */
+void MainWindow::saveFile(const QString& filePath)
+{
+    // Saves are written in order.
+    waitSaving();
+
+    // The editor maps a large file. A large file that is saved in
+    // place is written next to the file and replaces it afterwards.
+    TextEditor* editor = impl->textEditor;
+    editor->waitReplaceAll();
+    editor->endComposition();
+
+    QString writePath = filePath;
+    if (editor->isLargeFileMode())
+    {
+        editor->waitLargeFileIndexed();
+        if (QFileInfo(editor->largeFileText().fileName()) ==
+            QFileInfo(filePath))
+        {
+            writePath = filePath + LARGE_FILE_SAVE_SUFFIX;
+            impl->largeFileSavePath = writePath;
+        }
+    }
+
+    TextFileWriter* writer = new TextFileWriter(writePath, this);
+    impl->writer = writer;
+    ++impl->saveCount;
+
+    connect(writer, &TextFileWriter::finished,
+            writer, &QObject::deleteLater);
+    connect(writer, &TextFileWriter::finished,
+            this, [this, writer]()
+    {
+        if (writer == impl->writer)
+            endSaving();
+    });
+    connect(writer, &TextFileWriter::chunkWritten,
+            this, [this, writer]()
+    {
+        if (writer == impl->writer)
+            feedSaving(false);
+    });
+    connect(writer, &TextFileWriter::saved,
+            this, [this, filePath]()
+    {
+        impl->journal->endSave(filePath, impl->currentFile);
+    });
+    connect(writer, &TextFileWriter::failed,
+            this, [this](const QString& error)
+    {
+        impl->textEditor->document()->setModified(true);
+        QMessageBox::critical(this, "Save failed", error);
+    });
+
+    impl->journal->beginSave();
+    writer->start();
+
+    // The editor is read-only until the blocks have been passed to
+    // the writer or, in the large file mode, until the file has
+    // been written.
+    QTextDocument* doc = editor->document();
+    impl->saving       = true;
+    impl->saveReadOnly = editor->isReadOnly();
+    editor->setReadOnly(true);
+    updateEditActions();
+
+    if (editor->isLargeFileMode())
+    {
+        writer->write(editor->largeFileText());
+        writer->finish();
+        doc->setModified(false);
+        return;
+    }
+
+    impl->saveBlock = doc->begin();
+    feedSaving(false);
+
+    doc->setModified(false);
+}
+
+/* ---------------------------------------------------------------- *
+   Passes the next chunks of blocks to the writer while its queue
+   has room, or all of the remaining blocks if asked. The end of
+   text is marked after the last block.
+ * ---------------------------------------------------------------- */
+void MainWindow::feedSaving(bool all)
+{
+    TextFileWriter* writer = impl->writer;
+    if (!writer || !impl->saving || !impl->saveBlock.isValid())
+        return;
+
+    while (impl->saveBlock.isValid() && (all || !writer->isQueueFull()))
+    {
+        QString chunk;
+        chunk.reserve(SAVE_CHUNK_SIZE);
+        while (impl->saveBlock.isValid() && chunk.size() < SAVE_CHUNK_SIZE)
+        {
+            chunk += impl->saveBlock.text();
+            impl->saveBlock = impl->saveBlock.next();
+            if (impl->saveBlock.isValid())
+                chunk += QLatin1Char('\n');
+        }
+        writer->write(chunk);
+    }
+
+    if (!impl->saveBlock.isValid())
+    {
+        writer->finish();
+        endSaving();
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   All of the blocks have been passed to the writer or the writer
+   has stopped. The editor is made editable again.
+ * ---------------------------------------------------------------- */
+void MainWindow::endSaving()
+{
+    if (!impl->saving)
+        return;
+
+    impl->saving = false;
+    impl->saveBlock = QTextBlock();
+    replaceSavedLargeFile();
+    impl->textEditor->setReadOnly(impl->saveReadOnly);
+    updateEditActions();
+}
+
+/* ---------------------------------------------------------------- *
+   Disables the save and the conversion actions while the document
+   is saved or replaced and the replace of the find bar while the
+   document is saved.
+ * ---------------------------------------------------------------- */
+void MainWindow::updateEditActions()
+{
+    impl->editActions->setEnabled(!impl->saving &&
+                                  !impl->textEditor->isReplacingAll());
+    impl->findBar->setReplaceEnabled(!impl->saving);
+}
+
+/* ---------------------------------------------------------------- *
+   The large file that has been saved next to the file replaces the
+   file. A failed save leaves the file as it is.
+ * ---------------------------------------------------------------- */
+void MainWindow::replaceSavedLargeFile()
+{
+    const QString savedPath = impl->largeFileSavePath;
+    impl->largeFileSavePath.clear();
+    if (savedPath.isEmpty())
+        return;
+
+    if (!impl->writer || !impl->writer->isSaved())
+    {
+        QFile::remove(savedPath);
+        return;
+    }
+
+    try
+    {
+        impl->textEditor->replaceLargeFile(savedPath);
+    }
+    catch (const std::runtime_error& ex)
+    {
+        impl->textEditor->document()->setModified(true);
+        QMessageBox::critical(this, "Save failed", ex.what());
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Waits until the file that is being saved has been written. The
+   remaining blocks are passed to the writer first.
+ * ---------------------------------------------------------------- */
+void MainWindow::waitSaving()
+{
+    feedSaving(true);
+    if (impl->writer)
+        impl->writer->wait();
+    endSaving();
+}
+
+/* ---------------------------------------------------------------- *
+   Stops loading the file if it is loaded and makes the editor
+   editable again.
+ * ---------------------------------------------------------------- */
+void MainWindow::cancelLoading()
+{
+    impl->loadProgressBar->hide();
+    impl->loadCancelButton->hide();
+    if (!impl->reader)
+        return;
+
+    impl->reader->cancel();
+    impl->reader = nullptr;
+
+    impl->textEditor->document()->setUndoRedoEnabled(true);
+    impl->textEditor->setReadOnly(false);
+}
+
 /* ---------------------------------------------------------------- *
    Updates the window title to reflect the current file name.
  * ---------------------------------------------------------------- */
@@ -50,15 +50,33 @@ private slots:
     void on_actionSaveAs_triggered();
     void on_actionPrint_triggered();
     void on_actionReadingToKanji_triggered();
+    void on_actionFind_triggered();
+    void on_actionHiraganaToKatakana_triggered();
+    void on_actionKatakanaToHiragana_triggered();
+    void on_actionToFullWidth_triggered();
+    void on_actionToHalfWidth_triggered();
+    void on_actionKanaToRomaji_triggered();
+    void on_actionRomajiToKana_triggered();
     void on_actionHiragana_toggled(bool checked);
     void on_actionSystem_toggled(bool checked);
     void on_actionDictionary_triggered();
+    void on_actionExportVocabulary_triggered();
     void on_actionPreferences_triggered();
     void on_actionAbout_triggered();
+    void onLoadCancelled();
+    void updateEditActions();
 
 private:
     void updateWindowTitle();
     void askChangesSave();
+    void loadFile(const QString& filePath, const QString& currentFile);
+    void cancelLoading();
+    void setLoadedFile(const QString& filePath, const QString& currentFile);
+    void saveFile(const QString& filePath);
+    void feedSaving(bool all);
+    void endSaving();
+    void replaceSavedLargeFile();
+    void waitSaving();
 
 private:
     struct Impl;
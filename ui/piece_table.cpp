@@ -0,0 +1,516 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::jpad::PieceTable class.
+ * ---------------------------------------------------------------- */
+
+#include "piece_table.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <QtCore/QFile>
+
+namespace kuu
+{
+namespace jpad
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+const qint64 LINES_PER_CHECKPOINT = 4096;
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Constructs an empty table.
+ * ---------------------------------------------------------------- */
+PieceTable::PieceTable()
+{
+    checkpoints.push_back({ 0, 0 });
+}
+
+/* ---------------------------------------------------------------- *
+   Maps the file.
+ * ---------------------------------------------------------------- */
+void PieceTable::open(const QString& filePath)
+{
+    mapFile(std::make_shared<QFile>(filePath));
+
+    const qint64 size = file->size();
+    textSize = size;
+    added.clear();
+    pieces.clear();
+    if (size > 0)
+        pieces.push_back({ true, 0, size });
+
+    checkpoints.clear();
+    checkpoints.push_back({ 0, 0 });
+    newlineCount = 0;
+    indexedSize  = 0;
+    indexed      = size == 0;
+    crlf         = false;
+}
+
+/* ---------------------------------------------------------------- *
+   Builds the line checkpoints of the next bytes of the file. The
+   table has not been edited so the text is the original file.
+ * ---------------------------------------------------------------- */
+qint64 PieceTable::indexLines(qint64 count)
+{
+    const char* data = originalData;
+    const char* p    = data + indexedSize;
+    const char* end  = data + qMin(textSize, indexedSize + count);
+    while (p < end)
+    {
+        p = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+        if (!p)
+            break;
+
+        if (newlineCount == 0)
+            crlf = p > data && p[-1] == '\r';
+
+        ++p;
+        ++newlineCount;
+        if (newlineCount % LINES_PER_CHECKPOINT == 0)
+            checkpoints.push_back({ newlineCount, p - data });
+    }
+
+    indexedSize = end - data;
+    indexed     = indexedSize == textSize;
+    return textSize - indexedSize;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if the file has been indexed.
+ * ---------------------------------------------------------------- */
+bool PieceTable::isIndexed() const
+{ return indexed; }
+
+/* ---------------------------------------------------------------- *
+   Replaces the file with the saved file. The saved file is kept if
+   the file cannot be removed. If the saved file cannot be renamed
+   after the file has been removed the saved file is mapped instead
+   as it has the same text.
+ * ---------------------------------------------------------------- */
+void PieceTable::replaceFile(const QString& savedPath)
+{
+    const QString filePath = fileName();
+
+    // Closing the file unmaps it.
+    if (file.use_count() == 1)
+        file->close();
+
+    QFile target(filePath);
+    if (!target.remove())
+    {
+        if (!file->isOpen())
+            mapFile(file);
+        throw std::runtime_error(
+            "Failed to replace file " + filePath.toStdString() + ": " +
+                target.errorString().toStdString() + ". The text is " +
+                "saved in " + savedPath.toStdString());
+    }
+
+    QFile saved(savedPath);
+    const bool renamed = saved.rename(filePath);
+    mapFile(std::make_shared<QFile>(renamed ? filePath : savedPath));
+    added.clear();
+    pieces.clear();
+    if (textSize > 0)
+        pieces.push_back({ true, 0, textSize });
+
+    if (!renamed)
+        throw std::runtime_error(
+            "Failed to rename " + savedPath.toStdString() + " to " +
+                filePath.toStdString() + ": " +
+                saved.errorString().toStdString());
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if the table has a file.
+ * ---------------------------------------------------------------- */
+bool PieceTable::isOpen() const
+{ return bool(file); }
+
+/* ---------------------------------------------------------------- *
+   Returns the path of the file.
+ * ---------------------------------------------------------------- */
+QString PieceTable::fileName() const
+{ return file ? file->fileName() : QString(); }
+
+/* ---------------------------------------------------------------- *
+   Returns the text size in bytes.
+ * ---------------------------------------------------------------- */
+qint64 PieceTable::size() const
+{ return textSize; }
+
+/* ---------------------------------------------------------------- *
+   Returns the line count.
+ * ---------------------------------------------------------------- */
+qint64 PieceTable::lineCount() const
+{ return newlineCount + 1; }
+
+/* ---------------------------------------------------------------- *
+   Returns true if the lines end with CR LF.
+ * ---------------------------------------------------------------- */
+bool PieceTable::hasCrLf() const
+{ return crlf; }
+
+/* ---------------------------------------------------------------- *
+   Returns the byte offset of the line start. The nearest
+   checkpoint before the line is looked up and the rest of the
+   lines are scanned.
+ * ---------------------------------------------------------------- */
+qint64 PieceTable::lineOffset(qint64 line) const
+{
+    line = qBound(qint64(0), line, lineCount() - 1);
+
+    auto it = std::upper_bound(
+        checkpoints.begin(), checkpoints.end(), line,
+        [](qint64 l, const Checkpoint& c) { return l < c.line; });
+    --it;
+
+    qint64 remaining = line - it->line;
+    qint64 offset    = it->offset;
+    if (remaining == 0)
+        return offset;
+
+    qint64 pieceStart = 0;
+    for (const Piece& piece : pieces)
+    {
+        const qint64 pieceEnd = pieceStart + piece.length;
+        if (pieceEnd > offset)
+        {
+            const char* data = pieceData(piece);
+            const char* p    = data + (offset - pieceStart);
+            const char* end  = data + piece.length;
+            while (p < end)
+            {
+                p = static_cast<const char*>(
+                    std::memchr(p, '\n', size_t(end - p)));
+                if (!p)
+                    break;
+                ++p;
+                if (--remaining == 0)
+                    return pieceStart + (p - data);
+            }
+            offset = pieceEnd;
+        }
+        pieceStart = pieceEnd;
+    }
+
+    return textSize;
+}
+
+/* ---------------------------------------------------------------- *
+   Reads bytes from the text.
+ * ---------------------------------------------------------------- */
+QByteArray PieceTable::read(qint64 pos, qint64 count) const
+{
+    pos   = qBound(qint64(0), pos, textSize);
+    count = qBound(qint64(0), count, textSize - pos);
+
+    QByteArray out;
+    out.reserve(int(count));
+
+    qint64 pieceStart = 0;
+    for (const Piece& piece : pieces)
+    {
+        if (count == 0)
+            break;
+
+        const qint64 pieceEnd = pieceStart + piece.length;
+        if (pieceEnd > pos)
+        {
+            const qint64 skip = pos - pieceStart;
+            const qint64 n    = qMin(count, piece.length - skip);
+            out.append(pieceData(piece) + skip, int(n));
+            pos   += n;
+            count -= n;
+        }
+        pieceStart = pieceEnd;
+    }
+
+    return out;
+}
+
+/* ---------------------------------------------------------------- *
+   Replaces the removed count of bytes with the text.
+ * ---------------------------------------------------------------- */
+void PieceTable::replace(qint64 pos,
+                         qint64 removed,
+                         const QByteArray& text)
+{
+    pos     = qBound(qint64(0), pos, textSize);
+    removed = qBound(qint64(0), removed, textSize - pos);
+    if (removed == 0 && text.isEmpty())
+        return;
+
+    const qint64 lineDelta = text.count('\n') - countLines(pos, removed);
+    const qint64 sizeDelta = text.size() - removed;
+
+    size_t first, last;
+    splitAt(pos, first);
+    splitAt(pos + removed, last);
+    pieces.erase(pieces.begin() + first, pieces.begin() + last);
+
+    if (!text.isEmpty())
+    {
+        // Typing appends to the end of the add buffer so the
+        // previous piece can usually be extended.
+        if (first > 0 &&
+            !pieces[first - 1].original &&
+            pieces[first - 1].start + pieces[first - 1].length == added.size())
+        {
+            pieces[first - 1].length += text.size();
+        }
+        else
+        {
+            pieces.insert(pieces.begin() + first,
+                          { false, qint64(added.size()), qint64(text.size()) });
+        }
+        added.append(text);
+    }
+
+    // The checkpoints inside the removed bytes lost their line
+    // feed, the ones after them are moved.
+    std::vector<Checkpoint> moved;
+    moved.reserve(checkpoints.size());
+    for (const Checkpoint& c : checkpoints)
+    {
+        if (c.offset <= pos)
+            moved.push_back(c);
+        else if (c.offset > pos + removed)
+            moved.push_back({ c.line + lineDelta, c.offset + sizeDelta });
+    }
+    checkpoints.swap(moved);
+
+    textSize     += sizeDelta;
+    newlineCount += lineDelta;
+}
+
+/* ---------------------------------------------------------------- *
+   Replaces the edits. The pieces are walked once: the bytes between
+   the edits are kept and the line feeds of the removed bytes are
+   counted. The checkpoints are then moved by the edits before them.
+ * ---------------------------------------------------------------- */
+void PieceTable::replace(const std::vector<Edit>& edits)
+{
+    if (edits.empty())
+        return;
+
+    std::vector<Piece> result;
+    result.reserve(pieces.size() + 2 * edits.size());
+
+    size_t index      = 0; // current piece
+    qint64 pieceStart = 0; // text offset of the current piece
+    qint64 pos        = 0; // text offset of the walk
+
+    // Walks the pieces until the offset. Returns the count of line
+    // feeds of the walked bytes if they are not kept.
+    auto walk = [&](qint64 to, bool keep)
+    {
+        qint64 lines = 0;
+        while (pos < to && index < pieces.size())
+        {
+            const Piece& piece    = pieces[index];
+            const qint64 pieceEnd = pieceStart + piece.length;
+            const qint64 end      = qMin(to, pieceEnd);
+            const qint64 skip     = pos - pieceStart;
+
+            if (keep)
+            {
+                result.push_back({ piece.original,
+                                   piece.start + skip,
+                                   end - pos });
+            }
+            else
+            {
+                const char* p = pieceData(piece) + skip;
+                const char* e = p + (end - pos);
+                while (p < e)
+                {
+                    p = static_cast<const char*>(
+                        std::memchr(p, '\n', size_t(e - p)));
+                    if (!p)
+                        break;
+                    ++p;
+                    ++lines;
+                }
+            }
+
+            pos = end;
+            if (end == pieceEnd)
+            {
+                pieceStart = pieceEnd;
+                ++index;
+            }
+        }
+        return lines;
+    };
+
+    std::vector<qint64> lineDeltas(edits.size());
+    qint64 lineDelta = 0;
+    qint64 sizeDelta = 0;
+    for (size_t i = 0; i < edits.size(); ++i)
+    {
+        const Edit& edit = edits[i];
+        walk(edit.pos, true);
+        const qint64 removedLines = walk(edit.pos + edit.removed, false);
+        if (!edit.text.isEmpty())
+        {
+            result.push_back({ false,
+                               qint64(added.size()),
+                               qint64(edit.text.size()) });
+            added.append(edit.text);
+        }
+
+        lineDeltas[i] = edit.text.count('\n') - removedLines;
+        lineDelta += lineDeltas[i];
+        sizeDelta += edit.text.size() - edit.removed;
+    }
+    walk(textSize, true);
+    pieces.swap(result);
+
+    // The checkpoints inside the removed bytes lost their line
+    // feed, the ones after edits are moved.
+    std::vector<Checkpoint> moved;
+    moved.reserve(checkpoints.size());
+    size_t e = 0;
+    qint64 lines = 0;
+    qint64 bytes = 0;
+    for (const Checkpoint& c : checkpoints)
+    {
+        while (e < edits.size() &&
+               edits[e].pos + edits[e].removed < c.offset)
+        {
+            lines += lineDeltas[e];
+            bytes += edits[e].text.size() - edits[e].removed;
+            ++e;
+        }
+        if (e < edits.size() && edits[e].pos < c.offset)
+            continue;
+        moved.push_back({ c.line + lines, c.offset + bytes });
+    }
+    checkpoints.swap(moved);
+
+    textSize     += sizeDelta;
+    newlineCount += lineDelta;
+}
+
+/* ---------------------------------------------------------------- *
+   Writes the text into device.
+ * ---------------------------------------------------------------- */
+bool PieceTable::write(QIODevice& device) const
+{
+    for (const Piece& piece : pieces)
+        if (device.write(pieceData(piece), piece.length) != piece.length)
+            return false;
+    return true;
+}
+
+/* ---------------------------------------------------------------- *
+   Opens the file if it is not open and maps the whole file.
+ * ---------------------------------------------------------------- */
+void PieceTable::mapFile(std::shared_ptr<QFile> f)
+{
+    if (!f->isOpen() && !f->open(QIODevice::ReadOnly))
+        throw std::runtime_error(
+            "Failed to open file " +
+                f->fileName().toStdString());
+
+    const qint64 size = f->size();
+    const char* data = nullptr;
+    if (size > 0)
+    {
+        data = reinterpret_cast<const char*>(f->map(0, size));
+        if (!data)
+            throw std::runtime_error(
+                "Failed to map file " +
+                    f->fileName().toStdString());
+    }
+
+    file         = f;
+    originalData = data;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the data of the piece.
+ * ---------------------------------------------------------------- */
+const char* PieceTable::pieceData(const Piece& piece) const
+{
+    return piece.original ? originalData + piece.start
+                          : added.constData() + piece.start;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the count of line feeds in the range.
+ * ---------------------------------------------------------------- */
+qint64 PieceTable::countLines(qint64 pos, qint64 count) const
+{
+    qint64 lines = 0;
+    qint64 pieceStart = 0;
+    for (const Piece& piece : pieces)
+    {
+        if (count == 0)
+            break;
+
+        const qint64 pieceEnd = pieceStart + piece.length;
+        if (pieceEnd > pos)
+        {
+            const qint64 skip = pos - pieceStart;
+            const qint64 n    = qMin(count, piece.length - skip);
+            const char* p     = pieceData(piece) + skip;
+            const char* end   = p + n;
+            while (p < end)
+            {
+                p = static_cast<const char*>(
+                    std::memchr(p, '\n', size_t(end - p)));
+                if (!p)
+                    break;
+                ++p;
+                ++lines;
+            }
+            pos   += n;
+            count -= n;
+        }
+        pieceStart = pieceEnd;
+    }
+    return lines;
+}
+
+/* ---------------------------------------------------------------- *
+   Splits the piece at the position. Returns the index of the piece
+   that starts at the position.
+ * ---------------------------------------------------------------- */
+void PieceTable::splitAt(qint64 pos, size_t& index)
+{
+    qint64 pieceStart = 0;
+    for (index = 0; index < pieces.size(); ++index)
+    {
+        Piece& piece = pieces[index];
+        if (pos == pieceStart)
+            return;
+
+        const qint64 pieceEnd = pieceStart + piece.length;
+        if (pos < pieceEnd)
+        {
+            const qint64 head = pos - pieceStart;
+            Piece tail = { piece.original,
+                           piece.start + head,
+                           piece.length - head };
+            piece.length = head;
+            pieces.insert(pieces.begin() + index + 1, tail);
+            ++index;
+            return;
+        }
+        pieceStart = pieceEnd;
+    }
+}
+
+} // namespace jpad
+} // namespace kuu
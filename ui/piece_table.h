@@ -0,0 +1,134 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::jpad::PieceTable class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <QtCore/QByteArray>
+
+class QFile;
+class QIODevice;
+
+namespace kuu
+{
+namespace jpad
+{
+
+/* ---------------------------------------------------------------- *
+   A piece table of UTF-8 text over a memory-mapped file.
+
+   The original file is never modified nor loaded into memory. The
+   inserted text is appended into an add buffer and the text is
+   described by pieces that refer either to the original file or to
+   the add buffer.
+
+   Lines are found with sparse line checkpoints. A checkpoint
+   holds the byte offset of every Nth line start, the lines between
+   the checkpoints are found by scanning the text for line feeds.
+   The checkpoints are built by indexLines() a part at a time so
+   that a copy of the table can be indexed in a worker thread.
+
+   The table is a value: a copy of the table is a snapshot that
+   shares the mapped file and stays valid while the original table
+   is edited.
+ * ---------------------------------------------------------------- */
+class PieceTable
+{
+public:
+    // A replacement of bytes.
+    struct Edit
+    {
+        qint64 pos;
+        qint64 removed;
+        QByteArray text;
+    };
+
+    // Constructs an empty table.
+    PieceTable();
+
+    // Maps the file. The lines are not known until the file has
+    // been indexed. Throws std::runtime_error if the file cannot be
+    // mapped.
+    void open(const QString& filePath);
+    // Returns true if the table has a file.
+    bool isOpen() const;
+    // Returns the path of the file.
+    QString fileName() const;
+
+    // Builds the line checkpoints of at most the count of bytes
+    // more of the file. Returns the count of bytes left to index.
+    // Call before the table is edited.
+    qint64 indexLines(qint64 count);
+    // Returns true if the whole file has been indexed.
+    bool isIndexed() const;
+
+    // Replaces the file with the saved file that has the text of
+    // the table, e.g. when the file is saved in place. The pieces
+    // then refer to the saved file and the line checkpoints are
+    // kept. The file is unmapped before it is replaced unless a
+    // copy of the table still maps it, which prevents replacing a
+    // mapped file on Windows. Throws std::runtime_error if the file
+    // cannot be replaced.
+    void replaceFile(const QString& savedPath);
+
+    // Returns the text size in bytes.
+    qint64 size() const;
+    // Returns the line count.
+    qint64 lineCount() const;
+    // Returns true if the lines of the original file end with
+    // a carriage return and a line feed.
+    bool hasCrLf() const;
+
+    // Returns the byte offset of the line start.
+    qint64 lineOffset(qint64 line) const;
+    // Reads bytes from the text.
+    QByteArray read(qint64 pos, qint64 count) const;
+    // Replaces the removed count of bytes with the text.
+    void replace(qint64 pos, qint64 removed, const QByteArray& text);
+    // Replaces the edits in one pass over the pieces. The edits
+    // must be sorted by position and must not overlap.
+    void replace(const std::vector<Edit>& edits);
+
+    // Writes the text into device. Returns false if writing fails.
+    bool write(QIODevice& device) const;
+
+private:
+    // A span of bytes in the original file or in the add buffer.
+    struct Piece
+    {
+        bool original;
+        qint64 start;
+        qint64 length;
+    };
+
+    // The offset of the start of a line.
+    struct Checkpoint
+    {
+        qint64 line;
+        qint64 offset;
+    };
+
+    void mapFile(std::shared_ptr<QFile> f);
+    const char* pieceData(const Piece& piece) const;
+    qint64 countLines(qint64 pos, qint64 count) const;
+    void splitAt(qint64 pos, size_t& index);
+
+    std::shared_ptr<QFile> file;
+    const char* originalData = nullptr;
+    QByteArray added;
+    std::vector<Piece> pieces;
+    std::vector<Checkpoint> checkpoints;
+    qint64 textSize = 0;
+    qint64 newlineCount = 0;
+    qint64 indexedSize = 0;
+    bool indexed = true;
+    bool crlf = false;
+};
+
+} // namespace jpad
+} // namespace kuu
@@ -0,0 +1,89 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::jpad::PieceTableIndexer class.
+ * ---------------------------------------------------------------- */
+
+#include "piece_table_indexer.h"
+
+namespace kuu
+{
+namespace jpad
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+// Size of the file that is indexed between the progress updates.
+const qint64 CHUNK_SIZE = 16 * 1024 * 1024;
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Private data of the indexer.
+ * ---------------------------------------------------------------- */
+struct PieceTableIndexer::Impl
+{
+    PieceTable table;
+};
+
+/* ---------------------------------------------------------------- *
+   Constructs the indexer.
+ * ---------------------------------------------------------------- */
+PieceTableIndexer::PieceTableIndexer(const PieceTable& table,
+                                     QObject* parent)
+    : QThread(parent)
+    , impl(std::make_shared<Impl>())
+{
+    impl->table = table;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the indexed table and releases the copy.
+ * ---------------------------------------------------------------- */
+PieceTable PieceTableIndexer::takeIndexedTable()
+{
+    PieceTable table = impl->table;
+    impl->table = PieceTable();
+    return table;
+}
+
+/* ---------------------------------------------------------------- *
+   Stops indexing and waits for the thread to finish.
+ * ---------------------------------------------------------------- */
+void PieceTableIndexer::cancel()
+{
+    requestInterruption();
+    wait();
+    impl->table = PieceTable();
+}
+
+/* ---------------------------------------------------------------- *
+   Indexes the lines a chunk at a time.
+ * ---------------------------------------------------------------- */
+void PieceTableIndexer::run()
+{
+    PieceTable& table = impl->table;
+    const qint64 size = table.size();
+
+    int percent = -1;
+    while (!table.isIndexed())
+    {
+        if (isInterruptionRequested())
+            return;
+
+        const qint64 left = table.indexLines(CHUNK_SIZE);
+        const int p = int(100 * (size - left) / size);
+        if (p != percent)
+        {
+            percent = p;
+            emit progressChanged(percent);
+        }
+    }
+}
+
+} // namespace jpad
+} // namespace kuu
@@ -0,0 +1,55 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::jpad::PieceTableIndexer class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <memory>
+#include <QtCore/QThread>
+#include "piece_table.h"
+
+namespace kuu
+{
+namespace jpad
+{
+
+/* ---------------------------------------------------------------- *
+   Builds the line checkpoints of a large file in a worker thread.
+   The lines of an opened piece table are indexed in a copy of the
+   table so the file is scanned without blocking the user interface.
+ * ---------------------------------------------------------------- */
+class PieceTableIndexer : public QThread
+{
+    Q_OBJECT
+
+public:
+    // Constructs the indexer of the opened table. Call start() to
+    // start indexing.
+    explicit PieceTableIndexer(const PieceTable& table,
+                               QObject* parent = nullptr);
+
+    // Returns the indexed table. The indexer releases its copy of
+    // the table so that the table holds the only mapping.
+    PieceTable takeIndexedTable();
+
+    // Stops indexing and waits for the thread to finish. The copy of
+    // the table is released.
+    void cancel();
+
+signals:
+    // Indexing progress in range of [0, 100] has changed.
+    void progressChanged(int percent);
+
+protected:
+    void run() override;
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace jpad
+} // namespace kuu
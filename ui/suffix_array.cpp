@@ -0,0 +1,263 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::jpad::SuffixArray class.
+ * ---------------------------------------------------------------- */
+
+#include "suffix_array.h"
+#include <algorithm>
+
+namespace kuu
+{
+namespace jpad
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+// Alphabet of the UTF-16 text shifted by one to leave 0 for the
+// sentinel.
+const int ALPHABET_SIZE = 0x10000 + 1;
+
+/* ---------------------------------------------------------------- *
+   Computes the start or the end of each character bucket.
+ * ---------------------------------------------------------------- */
+void getBuckets(const int* s, int n, int k,
+                std::vector<int>& buckets, bool end)
+{
+    buckets.assign(size_t(k), 0);
+    for (int i = 0; i < n; ++i)
+        ++buckets[size_t(s[i])];
+
+    int sum = 0;
+    for (int i = 0; i < k; ++i)
+    {
+        sum += buckets[size_t(i)];
+        buckets[size_t(i)] = end ? sum : sum - buckets[size_t(i)];
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if the suffix is the leftmost S-type suffix of a
+   run of S-type suffixes.
+ * ---------------------------------------------------------------- */
+bool isLms(const std::vector<bool>& types, int i)
+{ return i > 0 && types[size_t(i)] && !types[size_t(i - 1)]; }
+
+/* ---------------------------------------------------------------- *
+   Induces the L-type suffixes from the sorted LMS suffixes and
+   then the S-type suffixes from the L-type suffixes.
+ * ---------------------------------------------------------------- */
+void induce(const int* s, int* sa, int n, int k,
+            const std::vector<bool>& types,
+            std::vector<int>& buckets)
+{
+    getBuckets(s, n, k, buckets, false);
+    for (int i = 0; i < n; ++i)
+    {
+        const int j = sa[i] - 1;
+        if (sa[i] > 0 && !types[size_t(j)])
+            sa[buckets[size_t(s[j])]++] = j;
+    }
+
+    getBuckets(s, n, k, buckets, true);
+    for (int i = n - 1; i >= 0; --i)
+    {
+        const int j = sa[i] - 1;
+        if (sa[i] > 0 && types[size_t(j)])
+            sa[--buckets[size_t(s[j])]] = j;
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Builds the suffix array of s with SA-IS. The last character of s
+   must be a unique sentinel that is smaller than the others and
+   the characters must be in range [0, k).
+ * ---------------------------------------------------------------- */
+void sais(const int* s, int* sa, int n, int k)
+{
+    if (n == 1)
+    {
+        sa[0] = 0;
+        return;
+    }
+
+    // Classify the suffixes into S-type (true) and L-type.
+    std::vector<bool> types(size_t(n), false);
+    types[size_t(n - 1)] = true;
+    for (int i = n - 2; i >= 0; --i)
+        types[size_t(i)] = s[i] < s[i + 1] ||
+                           (s[i] == s[i + 1] && types[size_t(i + 1)]);
+
+    // Sort the LMS substrings by inducing from the LMS suffixes in
+    // their buckets.
+    std::vector<int> buckets;
+    getBuckets(s, n, k, buckets, true);
+    std::fill(sa, sa + n, -1);
+    for (int i = 1; i < n; ++i)
+        if (isLms(types, i))
+            sa[--buckets[size_t(s[i])]] = i;
+    induce(s, sa, n, k, types, buckets);
+
+    // Move the sorted LMS substrings to the front.
+    int n1 = 0;
+    for (int i = 0; i < n; ++i)
+        if (isLms(types, sa[i]))
+            sa[n1++] = sa[i];
+
+    // Name the LMS substrings. Equal substrings share the name.
+    std::fill(sa + n1, sa + n, -1);
+    int name = 0;
+    int previous = -1;
+    for (int i = 0; i < n1; ++i)
+    {
+        const int pos = sa[i];
+        bool different = false;
+        for (int d = 0; d < n; ++d)
+        {
+            if (previous == -1 ||
+                s[pos + d] != s[previous + d] ||
+                types[size_t(pos + d)] != types[size_t(previous + d)])
+            {
+                different = true;
+                break;
+            }
+            if (d > 0 && (isLms(types, pos + d) ||
+                          isLms(types, previous + d)))
+            {
+                break;
+            }
+        }
+
+        if (different)
+        {
+            ++name;
+            previous = pos;
+        }
+        sa[n1 + pos / 2] = name - 1;
+    }
+    for (int i = n - 1, j = n - 1; i >= n1; --i)
+        if (sa[i] >= 0)
+            sa[j--] = sa[i];
+
+    // Sort the LMS suffixes. The names are unique if the
+    // substrings are, otherwise recurse into the reduced string.
+    int* s1  = sa + n - n1;
+    int* sa1 = sa;
+    if (name < n1)
+        sais(s1, sa1, n1, name);
+    else
+        for (int i = 0; i < n1; ++i)
+            sa1[s1[i]] = i;
+
+    // Induce the suffix array from the sorted LMS suffixes.
+    for (int i = 1, j = 0; i < n; ++i)
+        if (isLms(types, i))
+            s1[j++] = i;
+    for (int i = 0; i < n1; ++i)
+        sa1[i] = s1[sa1[i]];
+    std::fill(sa + n1, sa + n, -1);
+
+    getBuckets(s, n, k, buckets, true);
+    for (int i = n1 - 1; i >= 0; --i)
+    {
+        const int j = sa[i];
+        sa[i] = -1;
+        sa[--buckets[size_t(s[j])]] = j;
+    }
+    induce(s, sa, n, k, types, buckets);
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Constructs an empty suffix array.
+ * ---------------------------------------------------------------- */
+SuffixArray::SuffixArray()
+{}
+
+/* ---------------------------------------------------------------- *
+   Builds the suffix array of the text. The sentinel suffix is
+   dropped from the array.
+ * ---------------------------------------------------------------- */
+SuffixArray::SuffixArray(const QString& text)
+    : suffixText(text)
+{
+    const int n = text.size() + 1;
+    std::vector<int> s(static_cast<size_t>(n));
+    for (int i = 0; i < text.size(); ++i)
+        s[size_t(i)] = int(text[i].unicode()) + 1;
+    s[size_t(n - 1)] = 0;
+
+    std::vector<int> full(static_cast<size_t>(n));
+    sais(s.data(), full.data(), n, ALPHABET_SIZE);
+    sa.assign(full.begin() + 1, full.end());
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the text.
+ * ---------------------------------------------------------------- */
+const QString& SuffixArray::text() const
+{ return suffixText; }
+
+/* ---------------------------------------------------------------- *
+   Returns the count of occurrences of the pattern.
+ * ---------------------------------------------------------------- */
+int SuffixArray::count(const QString& pattern) const
+{
+    const std::pair<int, int> r = range(pattern);
+    return r.second - r.first;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the text positions of the occurrences of the pattern.
+ * ---------------------------------------------------------------- */
+std::vector<int> SuffixArray::positions(const QString& pattern) const
+{
+    const std::pair<int, int> r = range(pattern);
+    std::vector<int> out(sa.begin() + r.first, sa.begin() + r.second);
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the range of suffixes that start with the pattern. The
+   suffixes are compared only up to the pattern length.
+ * ---------------------------------------------------------------- */
+std::pair<int, int> SuffixArray::range(const QString& pattern) const
+{
+    if (pattern.isEmpty() || sa.empty())
+        return std::make_pair(0, 0);
+
+    const QChar* text = suffixText.constData();
+    const int size    = suffixText.size();
+    const int length  = pattern.size();
+
+    // Compares the suffix prefix to the pattern.
+    auto compare = [&](int suffix) -> int
+    {
+        const int n = std::min(length, size - suffix);
+        for (int i = 0; i < n; ++i)
+        {
+            const ushort a = text[suffix + i].unicode();
+            const ushort b = pattern[i].unicode();
+            if (a != b)
+                return a < b ? -1 : 1;
+        }
+        return n < length ? -1 : 0;
+    };
+
+    auto first = std::partition_point(sa.begin(), sa.end(),
+        [&](int suffix) { return compare(suffix) < 0; });
+    auto last  = std::partition_point(first, sa.end(),
+        [&](int suffix) { return compare(suffix) == 0; });
+
+    return std::make_pair(int(first - sa.begin()),
+                          int(last  - sa.begin()));
+}
+
+} // namespace jpad
+} // namespace kuu
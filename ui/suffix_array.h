@@ -0,0 +1,50 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::jpad::SuffixArray class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <utility>
+#include <vector>
+#include <QtCore/QString>
+
+namespace kuu
+{
+namespace jpad
+{
+
+/* ---------------------------------------------------------------- *
+   A suffix array of UTF-16 text. The array is built in linear time
+   with the SA-IS algorithm and the occurrences of a pattern are
+   found with a binary search in O(m log n) time.
+ * ---------------------------------------------------------------- */
+class SuffixArray
+{
+public:
+    // Constructs an empty suffix array.
+    SuffixArray();
+    // Builds the suffix array of the text.
+    explicit SuffixArray(const QString& text);
+
+    // Returns the text.
+    const QString& text() const;
+
+    // Returns the count of occurrences of the pattern.
+    int count(const QString& pattern) const;
+    // Returns the text positions of the occurrences of the pattern
+    // in ascending order.
+    std::vector<int> positions(const QString& pattern) const;
+
+private:
+    // Returns the range of suffixes that start with the pattern.
+    std::pair<int, int> range(const QString& pattern) const;
+
+    QString suffixText;
+    std::vector<int> sa;
+};
+
+} // namespace jpad
+} // namespace kuu
@@ -6,16 +6,131 @@
  * ---------------------------------------------------------------- */
 
 #include "text_editor.h"
+#include <algorithm>
+#include <climits>
+#include <QtCore/QDir>
+#include <QtCore/QPointer>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QStringMatcher>
+#include <QtCore/QTimer>
+#include <QtGui/QHelpEvent>
 #include <QtGui/QKeyEvent>
 #include <QtGui/QTextBlock>
+#include <QtWidgets/QScrollBar>
+#include <QtWidgets/QToolTip>
+#include "conversion_history.h"
+#include "text_editor_block_data.h"
+#include "text_editor_candidate_prefetcher.h"
+#include "text_editor_highlighter.h"
 #include "text_editor_key_converter.h"
 #include "text_editor_reading_to_kanji_area.h"
+#include "text_editor_search_index.h"
 #include "text_editor_side_area.h"
+#include "piece_table_indexer.h"
+#include "text_replacer.h"
 
 namespace kuu
 {
 namespace jpad
 {
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+// Count of lines in the document in the large file mode.
+const qint64 WINDOW_LINES  = 4000;
+// The window is moved when the view is closer to its edge.
+const int WINDOW_MARGIN    = 500;
+// Count of entries and senses per entry shown in the word tooltip.
+const size_t TOOLTIP_ENTRIES = 3;
+const size_t TOOLTIP_SENSES  = 4;
+// Delay in milliseconds before the visible blocks are segmented
+// for highlighting.
+const int HIGHLIGHT_DELAY = 50;
+// Character count of the document from which on the search index is
+// built.
+const int SEARCH_INDEX_SIZE = 1 << 20;
+
+/* ---------------------------------------------------------------- *
+   Returns the document text. Blocks are separated with line feeds.
+ * ---------------------------------------------------------------- */
+QString documentText(const QTextDocument* doc)
+{
+    QString text;
+    for (QTextBlock block = doc->begin(); block.isValid();)
+    {
+        text += block.text();
+        block = block.next();
+        if (block.isValid())
+            text += QLatin1Char('\n');
+    }
+    return text;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if the character is a hiragana or a katakana.
+ * ---------------------------------------------------------------- */
+bool isKana(QChar c)
+{ return c.unicode() >= 0x3041 && c.unicode() <= 0x30FF; }
+
+/* ---------------------------------------------------------------- *
+   Returns the tooltip text of the dictionary entries. The kanji
+   and reading forms are followed by the numbered senses.
+ * ---------------------------------------------------------------- */
+QString tooltipText(const JMdict& dict,
+                    const std::vector<qint32>& entryIndices)
+{
+    QString text;
+    for (size_t i = 0;
+         i < entryIndices.size() && i < TOOLTIP_ENTRIES;
+         ++i)
+    {
+        const JMdict::EntryPtr entry = dict.entry(entryIndices[i]);
+        const JMdict::Entry& e = *entry;
+
+        QStringList kanjis;
+        for (const JMdict::Kanji& kanji : e.kanjis)
+            kanjis << kanji.wordOrPhrase.toHtmlEscaped();
+        QStringList readings;
+        for (const JMdict::Reading& reading : e.readings)
+            readings << reading.wordOrPhrase.toHtmlEscaped();
+
+        if (i > 0)
+            text += "<hr>";
+        if (kanjis.isEmpty())
+            text += "<b>" + readings.join(QString::fromUtf8("、")) + "</b>";
+        else
+            text += "<b>" + kanjis.join(QString::fromUtf8("、")) + "</b> "
+                 +  QString::fromUtf8("【")
+                 +  readings.join(QString::fromUtf8("、"))
+                 +  QString::fromUtf8("】");
+
+        text += "<ol style=\"margin: 0px\">";
+        for (size_t s = 0; s < e.senses.size() && s < TOOLTIP_SENSES; ++s)
+        {
+            const JMdict::Sense& sense = e.senses[s];
+
+            QStringList partOfSpeeches;
+            for (const JMdict::TagId id : sense.partOfSpeeches)
+                if (id < dict.tags.size())
+                    partOfSpeeches << dict.tags[id].name.toHtmlEscaped();
+            QStringList glosses;
+            for (const QString& gloss : sense.glosses)
+                glosses << gloss.toHtmlEscaped();
+
+            text += "<li>";
+            if (!partOfSpeeches.isEmpty())
+                text += "<i>" + partOfSpeeches.join(", ") + "</i> ";
+            text += glosses.join("; ") + "</li>";
+        }
+        text += "</ol>";
+    }
+    return text;
+}
+
+} // anonymous namespace
 
 /* ---------------------------------------------------------------- *
    Private data of TextEditor
@@ -26,14 +141,77 @@ struct TextEditor::Impl
     Impl(TextEditor* self)
         : sideArea(self)
         , readingToKanjiArea(self)
+        , largeFileScrollBar(Qt::Vertical, self)
+        , highlighter(self->document())
+        , searchIndex(self->document())
     {}
 
+    // Stops the replace-all and the indexing before the editor is
+    // destroyed.
+    ~Impl()
+    {
+        if (replacer)
+            replacer->cancel();
+        if (indexer)
+            indexer->cancel();
+    }
+
     TextEditorKeyConverter keyConverter;
     TextEditorSideArea sideArea;
     TextEditorReadingToKanjiArea readingToKanjiArea;
 
     JMdictPtr dictionary;
     std::vector<JMdict::Entry> readingSearchResults;
+    TextEditorCandidatePrefetcher prefetcher;
+    ConversionHistory conversionHistory;
+    QString conversionReading;
+
+    // Large file mode. The document holds a window of lines of the
+    // large file.
+    PieceTable largeFile;
+    QScrollBar largeFileScrollBar;
+    qint64 windowLine = 0;        // first line of the window
+    qint64 windowLineCount = 0;   // line count in the piece table
+    qint64 windowOffset = 0;      // byte offset in the piece table
+    qint64 windowSize = 0;        // byte size in the piece table
+    bool windowEndsWithNewline = false;
+    bool windowEdited = false;
+    bool windowLoading = false;
+    bool recenterPending = false;
+
+    // Indexing of the large file lines in progress.
+    QPointer<PieceTableIndexer> indexer;
+    bool indexReadOnly = false;  // read-only state before
+
+    // Frequency band highlighting of the visible blocks.
+    TextEditorHighlighter highlighter;
+    QTimer highlightTimer;
+
+    // Suffix array index of large documents.
+    TextEditorSearchIndex searchIndex;
+
+    // Replace-all in progress.
+    QPointer<TextReplacer> replacer;
+    QString replacement;
+    bool replaceReadOnly = false;  // read-only state before
+    int replaceGeneration = 0;     // document generation at start
+    int replaceRevision = 0;       // text revision at start
+
+    // Generation of the document. Increased when the document is
+    // replaced, e.g. by opening a file.
+    int documentGeneration = 0;
+    // Revision of the text. Increased on each edit of the text but
+    // not when the blocks are reformatted or a window of the large
+    // file is loaded, unlike the revision of the document.
+    int textRevision = 0;
+
+    // Composition session of converted input. The converted text is
+    // inserted once per event loop iteration and consecutive
+    // insertions share one undo step.
+    QString compositionText;     // text waiting to be inserted
+    bool compositionPending = false;
+    bool composing = false;
+    int compositionEnd = 0;      // cursor position after insertion
 };
 
 /* ---------------------------------------------------------------- *
@@ -44,6 +222,14 @@ TextEditor::TextEditor()
 {
     impl->keyConverter.setMode(TextEditorKeyConverter::Mode::HiraganaKatakana);
     impl->readingToKanjiArea.hide();
+    impl->largeFileScrollBar.hide();
+
+    const QDir dataDir(QStandardPaths::writableLocation(
+        QStandardPaths::AppLocalDataLocation));
+    if (!dataDir.exists())
+        dataDir.mkpath(dataDir.absolutePath());
+    impl->conversionHistory.open(
+        dataDir.absoluteFilePath("conversion_history.bin"));
 
     connect(this, &TextEditor::blockCountChanged,
             this, &TextEditor::onBlockCountChanged);
@@ -51,6 +237,20 @@ TextEditor::TextEditor()
     connect(this, &TextEditor::updateRequest,
             this, &TextEditor::onUpdateRequest);
 
+    connect(document(), &QTextDocument::contentsChange,
+            this, &TextEditor::onContentsChange);
+
+    connect(verticalScrollBar(), &QScrollBar::valueChanged,
+            this, &TextEditor::onWindowScrolled);
+
+    connect(&impl->largeFileScrollBar, &QScrollBar::valueChanged,
+            this, &TextEditor::onLargeFileScrolled);
+
+    impl->highlightTimer.setSingleShot(true);
+    impl->highlightTimer.setInterval(HIGHLIGHT_DELAY);
+    connect(&impl->highlightTimer, &QTimer::timeout,
+            this, &TextEditor::segmentVisibleBlocks);
+
     connect(&impl->readingToKanjiArea,
             &TextEditorReadingToKanjiArea::selectedKanjisChanged,
             this,
@@ -64,13 +264,19 @@ TextEditor::TextEditor()
     onBlockCountChanged(0);
 
     setTextCharFormatFont(QFont("Arial", 14));
+    updateMarginGeometry();
 }
 
 /* ---------------------------------------------------------------- *
    Sets the dictionary.
  * ---------------------------------------------------------------- */
 void TextEditor::setDictionary(JMdictPtr dictionary)
-{ impl->dictionary = dictionary; }
+{
+    impl->dictionary = dictionary;
+    impl->prefetcher.setDictionary(dictionary);
+    impl->highlighter.setDictionary(dictionary);
+    impl->highlightTimer.start();
+}
 
 /* ---------------------------------------------------------------- *
    Returns the dictionary.
@@ -79,29 +285,162 @@ JMdictPtr TextEditor::dictionary() const
 { return impl->dictionary; }
 
 /* ---------------------------------------------------------------- *
-   Sets the text char format font.
+   Sets the text char format font. The font is set as the widget
+   font which is the default font of the document. The text has no
+   font of its own so changing the default font only clears the
+   block layouts in one pass and the blocks are laid out again when
+   they are shown. No undoable edits are made.
  * ---------------------------------------------------------------- */
 void TextEditor::setTextCharFormatFont(const QFont& font)
 {
-    QTextCharFormat fmt;
-    fmt.setFont(font);
-    setCurrentCharFormat(fmt);
+    setCurrentCharFormat(QTextCharFormat());
+    setFont(font);
 
-    QTextBlock block =  document()->findBlockByNumber(0);
-    if(!block.isValid())
-        return;
-    QTextCursor cursor(block);
+    // Side area follows the editor font.
+    onBlockCountChanged(blockCount());
+}
+
+/* ---------------------------------------------------------------- *
+   Opens the file in the large file mode. The file is mapped into
+   a piece table and only a window of its lines is in the document.
+   The window follows the view.
+ * ---------------------------------------------------------------- */
+void TextEditor::openLargeFile(const QString& filePath)
+{
+    PieceTable table;
+    table.open(filePath);
+    cancelReplaceAll();
+    cancelIndexing();
+    impl->searchIndex.setEnabled(false);
+
+    impl->windowEdited = false;
+    impl->largeFile = table;
+    setLineWrapMode(QPlainTextEdit::NoWrap);
+    setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 
-    // Set font to all of the blocks.
-    for (QTextBlock::iterator it = cursor.block().begin(); !(it.atEnd()); ++it)
     {
-        QTextCursor tempCursor = cursor;
-        tempCursor.setPosition(it.fragment().position());
-        tempCursor.setPosition(it.fragment().position()
-                                + it.fragment().length(),
-                               QTextCursor::KeepAnchor);
-        tempCursor.setCharFormat(fmt);
+        QSignalBlocker blocker(&impl->largeFileScrollBar);
+        impl->largeFileScrollBar.setRange(0, 0);
+        impl->largeFileScrollBar.setValue(0);
     }
+    impl->largeFileScrollBar.show();
+
+    // The window is loaded when the lines are known.
+    impl->windowLine            = 0;
+    impl->windowLineCount       = 0;
+    impl->windowOffset          = 0;
+    impl->windowSize            = 0;
+    impl->windowEndsWithNewline = false;
+    impl->windowLoading = true;
+    setPlainText(QString());
+    impl->windowLoading = false;
+    document()->setModified(false);
+    updateMarginGeometry();
+
+    PieceTableIndexer* indexer = new PieceTableIndexer(table, this);
+    impl->indexer       = indexer;
+    impl->indexReadOnly = isReadOnly();
+    setReadOnly(true);
+
+    connect(indexer, &PieceTableIndexer::progressChanged,
+            this, &TextEditor::largeFileIndexProgressChanged);
+    connect(indexer, &QThread::finished, this, [this, indexer]()
+    {
+        if (indexer == impl->indexer)
+            onLargeFileIndexed();
+    });
+    indexer->start();
+}
+
+/* ---------------------------------------------------------------- *
+   Waits until the lines of the large file have been indexed.
+ * ---------------------------------------------------------------- */
+void TextEditor::waitLargeFileIndexed()
+{
+    if (!impl->indexer)
+        return;
+    impl->indexer->wait();
+    onLargeFileIndexed();
+}
+
+/* ---------------------------------------------------------------- *
+   Stops indexing the large file lines.
+ * ---------------------------------------------------------------- */
+void TextEditor::cancelIndexing()
+{
+    PieceTableIndexer* indexer = impl->indexer;
+    impl->indexer = nullptr;
+    if (!indexer)
+        return;
+    indexer->cancel();
+    indexer->deleteLater();
+    setReadOnly(impl->indexReadOnly);
+}
+
+/* ---------------------------------------------------------------- *
+   Leaves the large file mode. The document text is kept.
+ * ---------------------------------------------------------------- */
+void TextEditor::closeLargeFile()
+{
+    if (!isLargeFileMode())
+        return;
+    cancelReplaceAll();
+    cancelIndexing();
+
+    impl->largeFile = PieceTable();
+    impl->windowLine = 0;
+    impl->windowEdited = false;
+    impl->largeFileScrollBar.hide();
+
+    setLineWrapMode(QPlainTextEdit::WidgetWidth);
+    setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
+    onBlockCountChanged(blockCount());
+    updateMarginGeometry();
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if a large file is opened.
+ * ---------------------------------------------------------------- */
+bool TextEditor::isLargeFileMode() const
+{ return impl->largeFile.isOpen(); }
+
+/* ---------------------------------------------------------------- *
+   Returns the large file text including the edits of the window.
+ * ---------------------------------------------------------------- */
+PieceTable TextEditor::largeFileText()
+{
+    commitWindow();
+    return impl->largeFile;
+}
+
+/* ---------------------------------------------------------------- *
+   Replaces the large file with the saved file. The running
+   replace-all and indexing hold copies of the table that keep the
+   file mapped so they are finished first.
+ * ---------------------------------------------------------------- */
+void TextEditor::replaceLargeFile(const QString& savedPath)
+{
+    cancelReplaceAll();
+    waitLargeFileIndexed();
+    impl->largeFile.replaceFile(savedPath);
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the line number of the first document block.
+ * ---------------------------------------------------------------- */
+qint64 TextEditor::firstLineNumber() const
+{ return impl->windowLine; }
+
+/* ---------------------------------------------------------------- *
+   Returns the line count of the text.
+ * ---------------------------------------------------------------- */
+qint64 TextEditor::lineCount() const
+{
+    if (!isLargeFileMode())
+        return blockCount();
+    return impl->largeFile.lineCount()
+         - impl->windowLineCount
+         + blockCount();
 }
 
 /* ---------------------------------------------------------------- *
@@ -112,23 +451,299 @@ void TextEditor::setInputMode(TextEditorKeyConverter::Mode mode)
     impl->keyConverter.setMode(mode);
 }
 
+/* ---------------------------------------------------------------- *
+   Converts the selected text or the whole document. Only the range
+   between the first and the last changed character is replaced.
+ * ---------------------------------------------------------------- */
+void TextEditor::convertText(kana_conversion::Conversion conversion)
+{
+    if (!isEditable())
+        return;
+    endComposition();
+
+    QTextCursor tc = textCursor();
+    const bool hasSelection = tc.hasSelection();
+    if (!hasSelection)
+        tc.select(QTextCursor::Document);
+
+    const int start = tc.selectionStart();
+    const QString text = tc.selectedText();
+    const QString converted = kana_conversion::convert(text, conversion);
+    if (converted == text)
+        return;
+
+    // Unchanged prefix and suffix.
+    const int size = qMin(text.size(), converted.size());
+    int prefix = 0;
+    while (prefix < size && text[prefix] == converted[prefix])
+        ++prefix;
+    int suffix = 0;
+    while (suffix < size - prefix &&
+           text[text.size() - 1 - suffix] ==
+           converted[converted.size() - 1 - suffix])
+    {
+        ++suffix;
+    }
+
+    tc.beginEditBlock();
+    tc.setPosition(start + prefix);
+    tc.setPosition(start + text.size() - suffix, QTextCursor::KeepAnchor);
+    tc.insertText(converted.mid(prefix,
+                                converted.size() - prefix - suffix));
+    tc.endEditBlock();
+
+    if (hasSelection)
+    {
+        tc.setPosition(start);
+        tc.setPosition(start + converted.size(), QTextCursor::KeepAnchor);
+        setTextCursor(tc);
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Finds the next or the previous match of the text. The match is
+   looked up from the matches of the search index if the index is
+   enabled. Otherwise the folded texts of the blocks are searched
+   starting from the block of the text cursor.
+ * ---------------------------------------------------------------- */
+bool TextEditor::find(const QString& text, bool backward)
+{
+    if (text.isEmpty())
+        return false;
+    endComposition();
+
+    const QString folded = kana_conversion::fold(text);
+    QTextCursor tc = textCursor();
+
+    if (impl->searchIndex.isEnabled())
+    {
+        const std::vector<int>& matches = impl->searchIndex.matches(folded);
+        if (matches.empty())
+            return false;
+
+        auto it = matches.end();
+        if (backward)
+        {
+            it = std::upper_bound(matches.begin(), matches.end(),
+                                  tc.selectionStart() - folded.size());
+            if (it == matches.begin())
+                it = matches.end();
+            --it;
+        }
+        else
+        {
+            it = std::lower_bound(matches.begin(), matches.end(),
+                                  tc.selectionEnd());
+            if (it == matches.end())
+                it = matches.begin();
+        }
+
+        tc.setPosition(*it);
+        tc.setPosition(*it + folded.size(), QTextCursor::KeepAnchor);
+        setTextCursor(tc);
+        return true;
+    }
+
+    const QStringMatcher matcher(folded);
+    QTextBlock block = tc.block();
+    int from = backward
+             ? tc.selectionStart() - block.position() - folded.size()
+             : tc.selectionEnd()   - block.position();
+
+    // The block of the cursor is searched again at the end of the
+    // wrap around.
+    for (int i = 0; i <= blockCount(); ++i)
+    {
+        const QString blockText = TextEditorBlockData::foldedText(block);
+        int index = -1;
+        if (!backward)
+            index = matcher.indexIn(blockText, from);
+        else if (from >= 0)
+            index = blockText.lastIndexOf(folded, from);
+
+        if (index >= 0)
+        {
+            tc.setPosition(block.position() + index);
+            tc.setPosition(block.position() + index + folded.size(),
+                           QTextCursor::KeepAnchor);
+            setTextCursor(tc);
+            return true;
+        }
+
+        if (backward)
+        {
+            block = block.previous();
+            if (!block.isValid())
+                block = document()->lastBlock();
+            from = block.length() - 1 - folded.size();
+        }
+        else
+        {
+            block = block.next();
+            if (!block.isValid())
+                block = document()->firstBlock();
+            from = 0;
+        }
+    }
+    return false;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the count of matches of the text.
+ * ---------------------------------------------------------------- */
+int TextEditor::matchCount(const QString& text)
+{ return impl->searchIndex.count(kana_conversion::fold(text)); }
+
+/* ---------------------------------------------------------------- *
+   Returns the positions of all matches of the text.
+ * ---------------------------------------------------------------- */
+std::vector<int> TextEditor::findAll(const QString& text)
+{ return impl->searchIndex.matches(kana_conversion::fold(text)); }
+
+/* ---------------------------------------------------------------- *
+   Replaces the selected match of the text.
+ * ---------------------------------------------------------------- */
+bool TextEditor::replace(const QString& text, const QString& replacement)
+{
+    if (text.isEmpty() || !isEditable())
+        return false;
+    endComposition();
+
+    QTextCursor tc = textCursor();
+    if (tc.hasSelection() &&
+        kana_conversion::fold(tc.selectedText()) ==
+        kana_conversion::fold(text))
+    {
+        tc.insertText(replacement);
+        setTextCursor(tc);
+    }
+    return find(text);
+}
+
+/* ---------------------------------------------------------------- *
+   Replaces all matches of the text. The folded block texts are
+   collected for the worker. The unchanged blocks share the folded
+   text of the block data. In the large file mode the worker
+   replaces the matches in a copy of the piece table.
+ * ---------------------------------------------------------------- */
+void TextEditor::replaceAll(const QString& text, const QString& replacement)
+{
+    if (text.isEmpty() || impl->replacer)
+        return;
+    if (!isEditable())
+    {
+        emit replaceAllFinished(0);
+        return;
+    }
+    endComposition();
+
+    TextReplacer* replacer = nullptr;
+    if (isLargeFileMode())
+    {
+        replacer = new TextReplacer(largeFileText(), text, replacement, this);
+    }
+    else
+    {
+        std::vector<QString> blocks;
+        std::vector<int> positions;
+        blocks.reserve(size_t(blockCount()));
+        positions.reserve(size_t(blockCount()));
+        for (QTextBlock block = document()->begin();
+             block.isValid();
+             block = block.next())
+        {
+            blocks.push_back(TextEditorBlockData::foldedText(block));
+            positions.push_back(block.position());
+        }
+        replacer = new TextReplacer(blocks, positions, text, this);
+    }
+
+    impl->replacer = replacer;
+    impl->replacement = replacement;
+    impl->replaceReadOnly = isReadOnly();
+    impl->replaceGeneration = impl->documentGeneration;
+    impl->replaceRevision = impl->textRevision;
+    setReadOnly(true);
+
+    connect(replacer, &QThread::finished,
+            this, &TextEditor::onReplaceAllFinished);
+    replacer->start();
+    emit replaceAllStarted();
+}
+
+/* ---------------------------------------------------------------- *
+   Waits until the replace-all has finished and its matches have
+   been replaced.
+ * ---------------------------------------------------------------- */
+void TextEditor::waitReplaceAll()
+{
+    if (!impl->replacer)
+        return;
+    impl->replacer->wait();
+    onReplaceAllFinished();
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if a replace-all is in progress.
+ * ---------------------------------------------------------------- */
+bool TextEditor::isReplacingAll() const
+{ return impl->replacer; }
+
+/* ---------------------------------------------------------------- *
+   Cancels the replace-all as the document is replaced. The
+   generation of the document is increased so that a replacer that
+   has already finished does not touch the new document.
+ * ---------------------------------------------------------------- */
+void TextEditor::cancelReplaceAll()
+{
+    ++impl->documentGeneration;
+
+    TextReplacer* replacer = impl->replacer;
+    impl->replacer = nullptr;
+    if (!replacer)
+        return;
+    replacer->cancel();
+    replacer->deleteLater();
+    setReadOnly(impl->replaceReadOnly);
+    emit replaceAllFinished(0);
+}
+
 /* ---------------------------------------------------------------- *
    Convert the currently selected reading into kanjis. If the
    area is already visible the select the next kanji.
  * ---------------------------------------------------------------- */
 void TextEditor::readingToKanji()
 {
-    if (impl->readingToKanjiArea.isVisible())
+    if (impl->readingToKanjiArea.isVisible() || !isEditable())
         return;
+    endComposition();
 
     const QTextCursor tc = textCursor();
     const QString searchText = tc.selectedText();
-    impl->readingSearchResults =
-        impl->dictionary->searchByReading(searchText);
+    if (!impl->prefetcher.candidates(searchText,
+                                     impl->readingSearchResults))
+    {
+        impl->readingSearchResults =
+            impl->dictionary->searchByReading(searchText);
+    }
+    // A mistyped reading gives the candidates of similar readings.
+    if (impl->readingSearchResults.empty())
+        impl->readingSearchResults =
+            impl->dictionary->searchByReadingFuzzy(searchText);
+
+    // Kanji candidates in dictionary order, the reading itself is
+    // the last one. The user's earlier choices are ranked first.
+    QStringList candidates;
+    for (const JMdict::Entry& entry : impl->readingSearchResults)
+        for (const JMdict::Kanji& kanji : entry.kanjis)
+            if (!candidates.contains(kanji.wordOrPhrase))
+                candidates << kanji.wordOrPhrase;
+    if (!candidates.contains(searchText))
+        candidates << searchText;
+    impl->conversionHistory.rank(searchText, candidates);
+    impl->conversionReading = searchText;
 
-    impl->readingToKanjiArea.setEntries(
-        impl->readingSearchResults,
-        searchText);
+    impl->readingToKanjiArea.setCandidates(candidates);
     impl->readingToKanjiArea.adjustSizeToTextEditor(
         size(),
         impl->sideArea.size(),
@@ -137,6 +752,49 @@ void TextEditor::readingToKanji()
     impl->readingToKanjiArea.show();
 }
 
+/* ---------------------------------------------------------------- *
+   Shows the dictionary entries of the word under the mouse in a
+   tooltip. The words of a block are looked up once per block
+   revision.
+ * ---------------------------------------------------------------- */
+bool TextEditor::viewportEvent(QEvent* event)
+{
+    if (event->type() != QEvent::ToolTip || !impl->dictionary)
+        return QPlainTextEdit::viewportEvent(event);
+
+    QHelpEvent* helpEvent = static_cast<QHelpEvent*>(event);
+    QTextCursor tc = cursorForPosition(helpEvent->pos());
+    const QTextBlock block = tc.block();
+
+    // The cursor is at the closest character edge, the character
+    // under the mouse is the one before the cursor if the mouse is
+    // on the left of the cursor.
+    int positionInBlock = tc.positionInBlock();
+    if (helpEvent->pos().x() < cursorRect(tc).left() && positionInBlock > 0)
+        --positionInBlock;
+
+    const TextEditorBlockData::Token* token =
+        TextEditorBlockData::tokenAt(block, positionInBlock,
+                                     *impl->dictionary);
+    if (!token)
+    {
+        QToolTip::hideText();
+        event->ignore();
+        return true;
+    }
+
+    tc.setPosition(block.position() + token->position);
+    QRect wordRect = cursorRect(tc);
+    tc.setPosition(block.position() + token->position + token->length);
+    wordRect = wordRect.united(cursorRect(tc));
+
+    QToolTip::showText(helpEvent->globalPos(),
+                       tooltipText(*impl->dictionary, token->entries),
+                       viewport(),
+                       wordRect);
+    return true;
+}
+
 /* ---------------------------------------------------------------- *
    Resizes the text editor - mainly settings the correction
    geometry into line number area.
@@ -144,13 +802,125 @@ void TextEditor::readingToKanji()
 void TextEditor::resizeEvent(QResizeEvent* event)
 {
     QPlainTextEdit::resizeEvent(event);
+    updateMarginGeometry();
+}
+
+/* ---------------------------------------------------------------- *
+   Updates the side area and the large file scroll bar geometries
+   and the viewport margins.
+ * ---------------------------------------------------------------- */
+void TextEditor::updateMarginGeometry()
+{
+    const int width = impl->sideArea.areaWidth();
+    const int scrollBarWidth = isLargeFileMode()
+        ? impl->largeFileScrollBar.sizeHint().width()
+        : 0;
+    setViewportMargins(width, 0, scrollBarWidth, 0);
 
-    // Update line area geometry
     QRect cr = contentsRect();
     impl->sideArea.setGeometry(
-        QRect(cr.left(), cr.top(),
-        impl->sideArea.areaWidth(),
-        cr.height()));
+        QRect(cr.left(), cr.top(), width, cr.height()));
+    impl->largeFileScrollBar.setGeometry(
+        QRect(cr.right() - scrollBarWidth + 1, cr.top(),
+              scrollBarWidth, cr.height()));
+}
+
+/* ---------------------------------------------------------------- *
+   Loads a window of lines from the large file into the document.
+   The edits of the previous window are committed first.
+ * ---------------------------------------------------------------- */
+void TextEditor::loadWindow(qint64 firstLine)
+{
+    commitWindow();
+
+    const PieceTable& table = impl->largeFile;
+    const qint64 lines = table.lineCount();
+    const qint64 start = qBound(qint64(0), firstLine,
+                                qMax(qint64(0), lines - WINDOW_LINES));
+    const qint64 end   = qMin(lines, start + WINDOW_LINES);
+
+    const qint64 startOffset = table.lineOffset(start);
+    const qint64 endOffset   = end < lines ? table.lineOffset(end)
+                                           : table.size();
+    QByteArray bytes = table.read(startOffset, endOffset - startOffset);
+
+    impl->windowLine            = start;
+    impl->windowLineCount       = end - start;
+    impl->windowOffset          = startOffset;
+    impl->windowSize            = bytes.size();
+    impl->windowEndsWithNewline = end < lines;
+
+    // The line feed of the last line is not a part of the document.
+    if (impl->windowEndsWithNewline)
+        bytes.chop(1);
+    if (table.hasCrLf())
+    {
+        if (bytes.endsWith('\r'))
+            bytes.chop(1);
+        bytes.replace("\r\n", "\n");
+    }
+
+    const bool modified = document()->isModified();
+    impl->windowLoading = true;
+    setPlainText(QString::fromUtf8(bytes));
+    impl->windowLoading = false;
+    impl->windowEdited = false;
+    document()->setModified(modified);
+
+    QSignalBlocker blocker(&impl->largeFileScrollBar);
+    impl->largeFileScrollBar.setRange(
+        0, int(qMin<qint64>(lines - 1, INT_MAX)));
+}
+
+/* ---------------------------------------------------------------- *
+   Writes the edited window back into the piece table.
+ * ---------------------------------------------------------------- */
+void TextEditor::commitWindow()
+{
+    if (!isLargeFileMode() || !impl->windowEdited)
+        return;
+
+    const bool crlf = impl->largeFile.hasCrLf();
+    QByteArray bytes = documentText(document()).toUtf8();
+    if (crlf)
+        bytes.replace("\n", "\r\n");
+    if (impl->windowEndsWithNewline)
+        bytes.append(crlf ? "\r\n" : "\n");
+
+    impl->largeFile.replace(impl->windowOffset, impl->windowSize, bytes);
+    impl->windowSize      = bytes.size();
+    impl->windowLineCount = blockCount();
+    impl->windowEdited    = false;
+}
+
+/* ---------------------------------------------------------------- *
+   Moves the window so that the view is in its middle. The first
+   visible line and the cursor are kept.
+ * ---------------------------------------------------------------- */
+void TextEditor::recenterWindow()
+{
+    impl->recenterPending = false;
+    if (!isLargeFileMode())
+        return;
+
+    const qint64 firstLine =
+        impl->windowLine + verticalScrollBar()->value();
+    const QTextCursor tc = textCursor();
+    const qint64 cursorLine = impl->windowLine + tc.blockNumber();
+    const int cursorColumn  = tc.positionInBlock();
+
+    loadWindow(firstLine - WINDOW_LINES / 2);
+
+    const QTextBlock block = document()->findBlockByNumber(
+        int(cursorLine - impl->windowLine));
+    if (cursorLine >= impl->windowLine && block.isValid())
+    {
+        QTextCursor cursor(block);
+        cursor.setPosition(block.position() +
+                           qMin(cursorColumn, block.length() - 1));
+        setTextCursor(cursor);
+    }
+    verticalScrollBar()->setValue(int(firstLine - impl->windowLine));
 }
 
 /* ---------------------------------------------------------------- *
@@ -158,6 +928,14 @@ void TextEditor::resizeEvent(QResizeEvent* event)
  * ---------------------------------------------------------------- */
 void TextEditor::keyPressEvent(QKeyEvent* event)
 {
+    // Converted keys are inserted programmatically so a read-only
+    // editor needs to bypass them.
+    if (isReadOnly())
+    {
+        QPlainTextEdit::keyPressEvent(event);
+        return;
+    }
+
     switch(event->key())
     {
         case Qt::Key_F2:
@@ -165,6 +943,7 @@ void TextEditor::keyPressEvent(QKeyEvent* event)
             return;
 
         case Qt::Key_Escape:
+            endComposition();
             clearEdit();
             return;
 
@@ -182,6 +961,8 @@ void TextEditor::keyPressEvent(QKeyEvent* event)
             break;
     }
 
+    // Any other edit ends the word.
+    endComposition();
     QPlainTextEdit::keyPressEvent(event);
 }
 
@@ -190,7 +971,76 @@ void TextEditor::keyPressEvent(QKeyEvent* event)
  * ---------------------------------------------------------------- */
 void TextEditor::onBlockCountChanged(int /*blockCount*/)
 {
-    setViewportMargins(impl->sideArea.areaWidth(), 0, 0, 0);
+    if (impl->sideArea.updateAreaWidth())
+        updateMarginGeometry();
+}
+
+/* ---------------------------------------------------------------- *
+   Marks the window edited in the large file mode. The search index
+   is enabled when the document has grown large.
+ * ---------------------------------------------------------------- */
+void TextEditor::onContentsChange(int /*position*/,
+                                  int /*removed*/,
+                                  int /*added*/)
+{
+    if (TextEditorHighlighter::isReformatting(document()))
+        return;
+
+    if (!isLargeFileMode() &&
+        !impl->searchIndex.isEnabled() &&
+        document()->characterCount() >= SEARCH_INDEX_SIZE)
+    {
+        impl->searchIndex.setEnabled(true);
+    }
+
+    if (impl->windowLoading)
+        return;
+    impl->windowEdited = true;
+    ++impl->textRevision;
+}
+
+/* ---------------------------------------------------------------- *
+   The document view has scrolled. In the large file mode the large
+   file scroll bar follows and the window is moved if the view gets
+   close to the window edge.
+ * ---------------------------------------------------------------- */
+void TextEditor::onWindowScrolled(int value)
+{
+    if (!isLargeFileMode() || impl->windowLoading)
+        return;
+
+    {
+        QSignalBlocker blocker(&impl->largeFileScrollBar);
+        impl->largeFileScrollBar.setValue(int(impl->windowLine + value));
+    }
+
+    const bool nearStart = value < WINDOW_MARGIN && impl->windowLine > 0;
+    const bool nearEnd =
+        value + verticalScrollBar()->pageStep() > blockCount() - WINDOW_MARGIN &&
+        impl->windowLine + blockCount() < lineCount();
+    if ((nearStart || nearEnd) && !impl->recenterPending)
+    {
+        impl->recenterPending = true;
+        QTimer::singleShot(0, this, &TextEditor::recenterWindow);
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   The large file scroll bar has been moved. Scrolls the view
+   within the window or loads a new window.
+ * ---------------------------------------------------------------- */
+void TextEditor::onLargeFileScrolled(int line)
+{
+    const int pageStep = verticalScrollBar()->pageStep();
+    if (line >= impl->windowLine &&
+        line + pageStep <= impl->windowLine + blockCount())
+    {
+        verticalScrollBar()->setValue(int(line - impl->windowLine));
+        return;
+    }
+
+    loadWindow(line - WINDOW_LINES / 2);
+    verticalScrollBar()->setValue(int(line - impl->windowLine));
 }
 
 /* ---------------------------------------------------------------- *
@@ -205,8 +1055,35 @@ void TextEditor::onUpdateRequest(const QRect& rect, int dy)
             0, rect.y(),
             impl->sideArea.width(), rect.height());
 
-    if (rect.contains(viewport()->rect()))
-        onBlockCountChanged(0);
+    if (!impl->highlightTimer.isActive())
+        impl->highlightTimer.start();
+}
+
+/* ---------------------------------------------------------------- *
+   Requests the visible blocks to be segmented for highlighting.
+   The block of the text cursor is segmented first. The blocks that
+   are up-to-date are skipped by the highlighter.
+ * ---------------------------------------------------------------- */
+void TextEditor::segmentVisibleBlocks()
+{
+    const QTextBlock cursorBlock = textCursor().block();
+    std::vector<QTextBlock> blocks;
+    blocks.push_back(cursorBlock);
+
+    const int bottom = viewport()->rect().bottom();
+    for (QTextBlock block = firstVisibleBlock();
+         block.isValid();
+         block = block.next())
+    {
+        const QRectF r = blockBoundingGeometry(block)
+                            .translated(contentOffset());
+        if (r.top() > bottom)
+            break;
+        if (block.isVisible() && block != cursorBlock)
+            blocks.push_back(block);
+    }
+
+    impl->highlighter.segment(blocks);
 }
 
 /* ---------------------------------------------------------------- *
@@ -218,6 +1095,78 @@ void TextEditor::onSelectedKanjisChanged(const QString& kanjis)
     replaceSelectedText(kanjis);
 }
 
+/* ---------------------------------------------------------------- *
+   The replace-all worker has finished. The matches are replaced
+   from the last one so that the positions of the earlier matches
+   stay valid. The matches are discarded if the text has been
+   edited after they were collected.
+ * ---------------------------------------------------------------- */
+void TextEditor::onReplaceAllFinished()
+{
+    TextReplacer* replacer = impl->replacer;
+    impl->replacer = nullptr;
+    if (!replacer)
+        return;
+    replacer->deleteLater();
+    setReadOnly(impl->replaceReadOnly);
+
+    // The document has been replaced, e.g. by opening a file, or
+    // edited.
+    int count = replacer->matchCount();
+    if (impl->documentGeneration != impl->replaceGeneration ||
+        impl->textRevision != impl->replaceRevision)
+    {
+        count = 0;
+    }
+
+    if (count > 0)
+    {
+        if (isLargeFileMode())
+        {
+            impl->largeFile = replacer->replacedLargeFile();
+            loadWindow(impl->windowLine);
+            document()->setModified(true);
+        }
+        else
+        {
+            const std::vector<TextReplacer::Match>& matches =
+                replacer->matches();
+
+            QTextCursor tc(document());
+            tc.beginEditBlock();
+            for (auto it = matches.rbegin(); it != matches.rend(); ++it)
+            {
+                tc.setPosition(it->position);
+                tc.setPosition(it->position + it->length,
+                               QTextCursor::KeepAnchor);
+                tc.insertText(impl->replacement);
+            }
+            tc.endEditBlock();
+        }
+    }
+
+    emit replaceAllFinished(count);
+}
+
+/* ---------------------------------------------------------------- *
+   The lines of the large file have been indexed. The editor was
+   read-only while indexing so the indexed table is the table of
+   the editor.
+ * ---------------------------------------------------------------- */
+void TextEditor::onLargeFileIndexed()
+{
+    PieceTableIndexer* indexer = impl->indexer;
+    impl->indexer = nullptr;
+    if (!indexer)
+        return;
+    indexer->deleteLater();
+    setReadOnly(impl->indexReadOnly);
+
+    impl->largeFile = indexer->takeIndexedTable();
+    loadWindow(0);
+    emit largeFileIndexed();
+}
+
 /* ---------------------------------------------------------------- *
    User has finished changing a reading to kanji. Clear the
    selection on the editor.
@@ -226,6 +1175,7 @@ void TextEditor::onSelectionFinished()
 {
     QTextCursor tc = textCursor();
     QString txt = tc.selectedText();
+    impl->conversionHistory.record(impl->conversionReading, txt);
     tc.clearSelection();
     tc.setPosition(tc.position() + txt.size());
     setTextCursor(tc);
@@ -250,6 +1200,9 @@ void TextEditor::clearEdit()
  * ---------------------------------------------------------------- */
 void TextEditor::replaceSelectedText(const QString& txt)
 {
+    if (!isEditable())
+        return;
+
     QTextCursor tc = textCursor();
     tc.removeSelectedText();
     tc.insertText(txt);
@@ -258,6 +1211,14 @@ void TextEditor::replaceSelectedText(const QString& txt)
     setTextCursor(tc);
 }
 
+/* ---------------------------------------------------------------- *
+   Returns true if the text can be edited. The text is locked while
+   the editor is read-only, e.g. while the document is saved, and
+   while a replace-all or the indexing of the large file runs.
+ * ---------------------------------------------------------------- */
+bool TextEditor::isEditable() const
+{ return !isReadOnly() && !impl->replacer && !impl->indexer; }
+
 /* ---------------------------------------------------------------- *
    Records a key.
  * ---------------------------------------------------------------- */
@@ -271,7 +1232,13 @@ bool TextEditor::recordKey(const QKeyEvent& keyEvent)
             QString text;
             if (impl->keyConverter.recordKey(keyEvent, text))
             {
-                insertPlainText(text);
+                impl->compositionText += text;
+                if (!impl->compositionPending)
+                {
+                    impl->compositionPending = true;
+                    QTimer::singleShot(0, this,
+                                       &TextEditor::flushComposition);
+                }
             }
 
             emit currentKeySequenceChanged(
@@ -284,6 +1251,60 @@ bool TextEditor::recordKey(const QKeyEvent& keyEvent)
     return false;
 }
 
+/* ---------------------------------------------------------------- *
+   Inserts the converted text that has been recorded since the last
+   event loop iteration. The text is joined into the previous undo
+   step if it continues the composed word.
+ * ---------------------------------------------------------------- */
+void TextEditor::flushComposition()
+{
+    impl->compositionPending = false;
+    if (impl->compositionText.isEmpty())
+        return;
+
+    // The text was locked after the keys were recorded.
+    if (!isEditable())
+    {
+        impl->compositionText.clear();
+        impl->composing = false;
+        return;
+    }
+
+    QTextCursor tc = textCursor();
+    const bool continues = impl->composing &&
+                           !tc.hasSelection() &&
+                           tc.position() == impl->compositionEnd;
+    if (continues)
+        tc.joinPreviousEditBlock();
+    else
+        tc.beginEditBlock();
+    tc.insertText(impl->compositionText);
+    tc.endEditBlock();
+    setTextCursor(tc);
+
+    impl->compositionText.clear();
+    impl->compositionEnd = tc.position();
+    impl->composing = true;
+
+    // The kana run before the cursor is likely to be converted
+    // next.
+    const QString blockText = tc.block().text();
+    const int end = tc.positionInBlock();
+    int start = end;
+    while (start > 0 && isKana(blockText[start - 1]))
+        --start;
+    impl->prefetcher.prefetch(blockText.mid(start, end - start));
+}
+
+/* ---------------------------------------------------------------- *
+   Inserts the pending converted text and ends the composed word.
+ * ---------------------------------------------------------------- */
+void TextEditor::endComposition()
+{
+    flushComposition();
+    impl->composing = false;
+}
+
 /* ---------------------------------------------------------------- *
    Undo recorded key if available.
  * ---------------------------------------------------------------- */
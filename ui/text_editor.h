@@ -8,8 +8,11 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include <QtWidgets/QPlainTextEdit>
 #include "../jmdict/jmdict.h"
+#include "kana_conversion.h"
+#include "piece_table.h"
 #include "text_editor_key_converter.h"
 
 namespace kuu
@@ -33,12 +36,74 @@ public:
     // Returns the dictionary.
     JMdictPtr dictionary() const;
 
-    // Sets the text char format font
+    // Sets the font of the whole text.
     void setTextCharFormatFont(const QFont& font);
 
     // Sets the input mode.
     void setInputMode(TextEditorKeyConverter::Mode mode);
 
+    // Opens the file in the large file mode. Only a window of lines
+    // around the view is kept in the document. The lines are
+    // indexed in a worker thread and the editor is empty and
+    // read-only until largeFileIndexed() is emitted. Throws
+    // std::runtime_error if the file cannot be opened.
+    void openLargeFile(const QString& filePath);
+    // Waits until the lines of the large file have been indexed.
+    void waitLargeFileIndexed();
+    // Leaves the large file mode.
+    void closeLargeFile();
+    // Returns true if a large file is opened.
+    bool isLargeFileMode() const;
+    // Returns the large file text including the edits.
+    PieceTable largeFileText();
+    // Replaces the large file with the saved file that has the text
+    // of the editor, e.g. when the file has been saved in place.
+    // Throws std::runtime_error if the file cannot be replaced.
+    void replaceLargeFile(const QString& savedPath);
+
+    // Returns the line number of the first document block.
+    qint64 firstLineNumber() const;
+    // Returns the line count of the text.
+    qint64 lineCount() const;
+
+    // Converts the selected text or the whole document if there is
+    // no selection. The conversion is one undoable edit. Nothing is
+    // converted while the text is locked, e.g. while it is saved.
+    void convertText(kana_conversion::Conversion conversion);
+    // Inserts the pending converted text and ends the composed
+    // word.
+    void endComposition();
+
+    // Finds the next or the previous match of the text from the
+    // text cursor and selects it. The text is matched kana and
+    // width insensitively. The search wraps around the document.
+    // Returns false if there is no match.
+    bool find(const QString& text, bool backward = false);
+    // Returns the count of matches of the text. The matches do not
+    // overlap, as in replaceAll(). Large documents are counted from
+    // the search index.
+    int matchCount(const QString& text);
+    // Returns the positions of all matches of the text in ascending
+    // order, e.g. for a concordance of a word.
+    std::vector<int> findAll(const QString& text);
+    // Replaces the selected match of the text and finds the next
+    // match. Nothing is replaced while the text is locked. Returns
+    // false if there is no next match.
+    bool replace(const QString& text, const QString& replacement);
+    // Replaces all matches of the text. The matches are found in a
+    // worker thread and the editor is read-only until
+    // replaceAllFinished() is emitted. The replacement is one
+    // undoable edit. The matches are not replaced if the text is
+    // edited before the worker has finished.
+    void replaceAll(const QString& text, const QString& replacement);
+    // Cancels the replace-all. Called before the document is
+    // replaced, e.g. by opening a file.
+    void cancelReplaceAll();
+    // Waits until the replace-all has finished.
+    void waitReplaceAll();
+    // Returns true if a replace-all is in progress.
+    bool isReplacingAll() const;
+
 public slots:
     void readingToKanji();
 
@@ -46,21 +111,44 @@ signals:
     // Current key sequence with is used to create a kana character
     // has changed.
     void currentKeySequenceChanged(const QString& keySequence);
+    // Replace-all has started.
+    void replaceAllStarted();
+    // Replace-all has finished.
+    void replaceAllFinished(int count);
+    // Indexing progress of the large file in range of [0, 100] has
+    // changed.
+    void largeFileIndexProgressChanged(int percent);
+    // The lines of the large file have been indexed.
+    void largeFileIndexed();
 
 protected:
     void resizeEvent(QResizeEvent* event) override;
     void keyPressEvent(QKeyEvent* event) override;
+    bool viewportEvent(QEvent* event) override;
 
 private slots:
     void onBlockCountChanged(int blockCount);
     void onUpdateRequest(const QRect& rect, int dy);
+    void onContentsChange(int position, int removed, int added);
+    void onWindowScrolled(int value);
+    void onLargeFileScrolled(int line);
+    void recenterWindow();
+    void flushComposition();
+    void segmentVisibleBlocks();
+    void onReplaceAllFinished();
+    void onLargeFileIndexed();
     void onSelectedKanjisChanged(const QString& kanjis);
     void onSelectionFinished();
 
 
 private:
+    void updateMarginGeometry();
+    void cancelIndexing();
+    void loadWindow(qint64 firstLine);
+    void commitWindow();
     void clearEdit();
     void replaceSelectedText(const QString& txt);
+    bool isEditable() const;
 
     bool recordKey(const QKeyEvent& keyEvent);
     bool recordKeyUndo();
@@ -0,0 +1,150 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::jpad::TextEditorBlockData class.
+ * ---------------------------------------------------------------- */
+
+#include "text_editor_block_data.h"
+#include <algorithm>
+#include "kana_conversion.h"
+
+namespace kuu
+{
+namespace jpad
+{
+
+/* ---------------------------------------------------------------- *
+   Tokenizes the text. The characters that do not start a word are
+   skipped.
+ * ---------------------------------------------------------------- */
+std::vector<TextEditorBlockData::Token> TextEditorBlockData::tokenize(
+    const QString& text,
+    const JMdict& dict)
+{
+    return dict.tokenize(text, true);
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the tokens of the block.
+ * ---------------------------------------------------------------- */
+const std::vector<TextEditorBlockData::Token>&
+    TextEditorBlockData::tokens(QTextBlock block, const JMdict& dict)
+{
+    TextEditorBlockData* data = TextEditorBlockData::data(block);
+    if (data->isValid(block.revision(), dict))
+        return data->blockTokens;
+
+    data->blockRevision      = block.revision();
+    data->dictionary         = &dict;
+    data->dictionaryRevision = dict.wordIndexRevision;
+    data->blockTokens        = tokenize(block.text(), dict);
+    data->blockBands.clear();
+    data->hasBands = false;
+
+    return data->blockTokens;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the token at the position in the block.
+ * ---------------------------------------------------------------- */
+const TextEditorBlockData::Token* TextEditorBlockData::tokenAt(
+    QTextBlock block,
+    int positionInBlock,
+    const JMdict& dict)
+{
+    const std::vector<Token>& blockTokens = tokens(block, dict);
+    auto it = std::upper_bound(
+        blockTokens.begin(),
+        blockTokens.end(),
+        positionInBlock,
+        [](int position, const Token& token)
+    {
+        return position < token.position;
+    });
+
+    if (it == blockTokens.begin())
+        return nullptr;
+    --it;
+    if (positionInBlock >= it->position + it->length)
+        return nullptr;
+    return &*it;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the frequency bands of the block.
+ * ---------------------------------------------------------------- */
+const std::vector<TextEditorBlockData::Band>* TextEditorBlockData::bands(
+    const QTextBlock& block,
+    const JMdict& dict)
+{
+    const TextEditorBlockData* data =
+        dynamic_cast<const TextEditorBlockData*>(block.userData());
+    if (!data || !data->hasBands || !data->isValid(block.revision(), dict))
+        return nullptr;
+    return &data->blockBands;
+}
+
+/* ---------------------------------------------------------------- *
+   Sets the tokens and the frequency bands of the block.
+ * ---------------------------------------------------------------- */
+void TextEditorBlockData::setSegments(QTextBlock block,
+                                      int blockRevision,
+                                      const JMdict& dict,
+                                      std::vector<Token> tokens,
+                                      std::vector<Band> bands)
+{
+    if (!block.isValid() || block.revision() != blockRevision)
+        return;
+
+    TextEditorBlockData* data = TextEditorBlockData::data(block);
+
+    data->blockRevision      = blockRevision;
+    data->dictionary         = &dict;
+    data->dictionaryRevision = dict.wordIndexRevision;
+    data->blockTokens        = std::move(tokens);
+    data->blockBands         = std::move(bands);
+    data->hasBands = true;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the kana and width folded text of the block.
+ * ---------------------------------------------------------------- */
+QString TextEditorBlockData::foldedText(QTextBlock block)
+{
+    TextEditorBlockData* data = TextEditorBlockData::data(block);
+    if (data->foldedRevision != block.revision())
+    {
+        data->folded = kana_conversion::fold(block.text());
+        data->foldedRevision = block.revision();
+    }
+    return data->folded;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the block data.
+ * ---------------------------------------------------------------- */
+TextEditorBlockData* TextEditorBlockData::data(QTextBlock& block)
+{
+    TextEditorBlockData* data =
+        dynamic_cast<TextEditorBlockData*>(block.userData());
+    if (!data)
+    {
+        data = new TextEditorBlockData();
+        block.setUserData(data);
+    }
+    return data;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if the data is up-to-date.
+ * ---------------------------------------------------------------- */
+bool TextEditorBlockData::isValid(int revision, const JMdict& dict) const
+{
+    return blockRevision      == revision &&
+           dictionary         == &dict &&
+           dictionaryRevision == dict.wordIndexRevision;
+}
+
+} // namespace jpad
+} // namespace kuu
@@ -0,0 +1,102 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::jpad::TextEditorBlockData class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <vector>
+#include <QtGui/QTextBlock>
+#include <QtGui/QTextBlockUserData>
+#include "../jmdict/jmdict.h"
+
+namespace kuu
+{
+namespace jpad
+{
+
+/* ---------------------------------------------------------------- *
+   Dictionary words of a text block. The block is tokenized by
+   longest matches against the kanji and reading indexes of the
+   dictionary. The tokens are kept as the block user data and are
+   tokenized again only after the block or the dictionary has
+   changed.
+
+   The highlighter stores the frequency bands of the words next to
+   the tokens. The find keeps a kana and width folded copy of the
+   block text.
+ * ---------------------------------------------------------------- */
+class TextEditorBlockData : public QTextBlockUserData
+{
+public:
+    // Defines a dictionary word in the block.
+    using Token = JMdict::Token;
+
+    // Defines a frequency band of the text.
+    enum class Frequency
+    {
+        Common,  // common word
+        Rare,    // word without common priorities
+        Unknown  // Japanese text that is not in the dictionary
+    };
+
+    // Defines a text range of a frequency band.
+    struct Band
+    {
+        int position = 0;
+        int length   = 0;
+        Frequency frequency = Frequency::Common;
+    };
+
+    // Tokenizes the text with the entries of the words. An attached
+    // dictionary tokenizes the text with one request.
+    static std::vector<Token> tokenize(const QString& text,
+                                       const JMdict& dict);
+
+    // Returns the tokens of the block.
+    static const std::vector<Token>& tokens(QTextBlock block,
+                                            const JMdict& dict);
+    // Returns the token at the position in the block or nullptr if
+    // there is no word at the position.
+    static const Token* tokenAt(QTextBlock block,
+                                int positionInBlock,
+                                const JMdict& dict);
+
+    // Returns the frequency bands of the block or nullptr if the
+    // block has not been segmented since it or the dictionary has
+    // changed.
+    static const std::vector<Band>* bands(const QTextBlock& block,
+                                          const JMdict& dict);
+    // Sets the tokens and the frequency bands of the block. Nothing
+    // is set if the block has changed since the revision.
+    static void setSegments(QTextBlock block,
+                            int blockRevision,
+                            const JMdict& dict,
+                            std::vector<Token> tokens,
+                            std::vector<Band> bands);
+
+    // Returns the kana and width folded text of the block. The text
+    // is folded again only after the block has changed.
+    static QString foldedText(QTextBlock block);
+
+private:
+    // Returns the block data, the data is created if the block does
+    // not have it.
+    static TextEditorBlockData* data(QTextBlock& block);
+    // Returns true if the data is up-to-date.
+    bool isValid(int revision, const JMdict& dict) const;
+
+    int blockRevision = -1;
+    const JMdict* dictionary = nullptr;
+    quint32 dictionaryRevision = 0;
+    std::vector<Token> blockTokens;
+    std::vector<Band> blockBands;
+    bool hasBands = false;
+    int foldedRevision = -1;
+    QString folded;
+};
+
+} // namespace jpad
+} // namespace kuu
@@ -0,0 +1,175 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::jpad::TextEditorCandidatePrefetcher
+   class.
+ * ---------------------------------------------------------------- */
+
+#include "text_editor_candidate_prefetcher.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace kuu
+{
+namespace jpad
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+const size_t CACHE_SIZE = 16;
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Private data of the candidate prefetcher.
+ * ---------------------------------------------------------------- */
+struct TextEditorCandidatePrefetcher::Impl
+{
+    // A cached lookup result.
+    struct CacheEntry
+    {
+        QString reading;
+        std::vector<JMdict::Entry> candidates;
+    };
+
+    // Returns the cache entry of the reading or the end of cache.
+    // The cache is ordered from the most recently used.
+    std::deque<CacheEntry>::iterator find(const QString& reading)
+    {
+        return std::find_if(cache.begin(), cache.end(),
+            [&reading](const CacheEntry& e)
+        {
+            return e.reading == reading;
+        });
+    }
+
+    // Looks up the requested readings.
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            cv.wait(lock, [this]()
+            {
+                return !request.isEmpty() || stopped;
+            });
+            if (stopped)
+                return;
+
+            const QString reading = request;
+            JMdictPtr dict = dictionary;
+            request.clear();
+
+            if (!dict || find(reading) != cache.end())
+                continue;
+
+            lookup = reading;
+            lock.unlock();
+            std::vector<JMdict::Entry> candidates =
+                dict->searchByReading(reading);
+            lock.lock();
+            lookup.clear();
+
+            // The dictionary was changed during the lookup.
+            if (dict == dictionary)
+            {
+                cache.push_front({ reading, std::move(candidates) });
+                if (cache.size() > CACHE_SIZE)
+                    cache.pop_back();
+            }
+            cv.notify_all();
+        }
+    }
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    JMdictPtr dictionary;
+    QString request;   // next reading to look up
+    QString lookup;    // reading being looked up
+    std::deque<CacheEntry> cache;
+    bool stopped = false;
+};
+
+/* ---------------------------------------------------------------- *
+   Constructs the prefetcher.
+ * ---------------------------------------------------------------- */
+TextEditorCandidatePrefetcher::TextEditorCandidatePrefetcher()
+    : impl(std::make_shared<Impl>())
+{
+    impl->thread = std::thread(&Impl::run, impl.get());
+}
+
+/* ---------------------------------------------------------------- *
+   Stops the worker thread.
+ * ---------------------------------------------------------------- */
+TextEditorCandidatePrefetcher::~TextEditorCandidatePrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        impl->stopped = true;
+        impl->cv.notify_all();
+    }
+    impl->thread.join();
+}
+
+/* ---------------------------------------------------------------- *
+   Sets the dictionary.
+ * ---------------------------------------------------------------- */
+void TextEditorCandidatePrefetcher::setDictionary(JMdictPtr dictionary)
+{
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    impl->dictionary = dictionary;
+    impl->cache.clear();
+}
+
+/* ---------------------------------------------------------------- *
+   Requests the candidates of the reading to be looked up.
+ * ---------------------------------------------------------------- */
+void TextEditorCandidatePrefetcher::prefetch(const QString& reading)
+{
+    if (reading.isEmpty())
+        return;
+
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    impl->request = reading;
+    impl->cv.notify_all();
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the cached candidates of the reading.
+ * ---------------------------------------------------------------- */
+bool TextEditorCandidatePrefetcher::candidates(
+    const QString& reading,
+    std::vector<JMdict::Entry>& out)
+{
+    std::unique_lock<std::mutex> lock(impl->mutex);
+    Impl* d = impl.get();
+    d->cv.wait(lock, [d, &reading]()
+    {
+        return d->lookup != reading;
+    });
+
+    auto it = d->find(reading);
+    if (it == d->cache.end())
+        return false;
+
+    out = it->candidates;
+    if (it != d->cache.begin())
+    {
+        Impl::CacheEntry entry = std::move(*it);
+        d->cache.erase(it);
+        d->cache.push_front(std::move(entry));
+    }
+    return true;
+}
+
+} // namespace jpad
+} // namespace kuu
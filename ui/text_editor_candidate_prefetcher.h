@@ -0,0 +1,54 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::jpad::TextEditorCandidatePrefetcher class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "../jmdict/jmdict.h"
+
+namespace kuu
+{
+namespace jpad
+{
+
+/* ---------------------------------------------------------------- *
+   Looks up the reading-to-kanji candidates of the kana that is
+   being typed in a worker thread. The results are kept in a small
+   cache so that the conversion popup can be opened without
+   searching the dictionary.
+
+   Only the latest prefetch request is looked up. The requests that
+   were replaced before the worker got to them are dropped.
+ * ---------------------------------------------------------------- */
+class TextEditorCandidatePrefetcher
+{
+public:
+    // Constructs the prefetcher and starts the worker thread.
+    TextEditorCandidatePrefetcher();
+    // Stops the worker thread.
+    ~TextEditorCandidatePrefetcher();
+
+    // Sets the dictionary. Clears the cache.
+    void setDictionary(JMdictPtr dictionary);
+
+    // Requests the candidates of the reading to be looked up.
+    void prefetch(const QString& reading);
+
+    // Returns the cached candidates of the reading. If the reading
+    // is being looked up then waits for it. Returns false if the
+    // reading has not been prefetched.
+    bool candidates(const QString& reading,
+                    std::vector<JMdict::Entry>& out);
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace jpad
+} // namespace kuu
@@ -0,0 +1,354 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::jpad::TextEditorHighlighter class.
+ * ---------------------------------------------------------------- */
+
+#include "text_editor_highlighter.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <QtGui/QTextDocument>
+#include "text_editor_block_data.h"
+
+namespace kuu
+{
+namespace jpad
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+// Document property that is set while the highlighter reformats.
+const char* const REFORMATTING_PROPERTY = "jpadReformatting";
+
+using Token     = TextEditorBlockData::Token;
+using Band      = TextEditorBlockData::Band;
+using Frequency = TextEditorBlockData::Frequency;
+
+/* ---------------------------------------------------------------- *
+   Returns true if the character is a kana or a kanji.
+ * ---------------------------------------------------------------- */
+bool isJapanese(QChar c)
+{
+    const ushort u = c.unicode();
+    return (u >= 0x3041 && u <= 0x30FF) ||  // hiragana and katakana
+           (u >= 0x3400 && u <= 0x4DBF) ||  // CJK extension A
+           (u >= 0x4E00 && u <= 0x9FFF);    // CJK unified ideographs
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if the priorities mark a common word. JMdict marks
+   the common words with news1, ichi1, spec1, spec2 and gai1
+   priorities.
+ * ---------------------------------------------------------------- */
+bool isCommonPriority(const std::vector<QString>& priorities)
+{
+    for (const QString& priority : priorities)
+        if (priority == "news1" || priority == "ichi1" ||
+            priority == "spec1" || priority == "spec2" ||
+            priority == "gai1")
+        {
+            return true;
+        }
+    return false;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if any of the entries is a common word.
+ * ---------------------------------------------------------------- */
+bool isCommon(const JMdict& dict, const std::vector<qint32>& entries)
+{
+    for (const qint32 index : entries)
+    {
+        const JMdict::EntryPtr entry = dict.entry(index);
+        const JMdict::Entry& e = *entry;
+        for (const JMdict::Kanji& kanji : e.kanjis)
+            if (isCommonPriority(kanji.priorities))
+                return true;
+        for (const JMdict::Reading& reading : e.readings)
+            if (isCommonPriority(reading.priorities))
+                return true;
+    }
+    return false;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the frequency bands of the tokenized text. The Japanese
+   text between the tokens is unknown.
+ * ---------------------------------------------------------------- */
+std::vector<Band> bandsOf(const QString& text,
+                          const std::vector<Token>& tokens,
+                          const JMdict& dict)
+{
+    std::vector<Band> bands;
+    auto addUnknown = [&](int from, int to)
+    {
+        int i = from;
+        while (i < to)
+        {
+            if (!isJapanese(text[i]))
+            {
+                ++i;
+                continue;
+            }
+
+            Band band;
+            band.position  = i;
+            band.frequency = Frequency::Unknown;
+            while (i < to && isJapanese(text[i]))
+                ++i;
+            band.length = i - band.position;
+            bands.push_back(band);
+        }
+    };
+
+    int position = 0;
+    for (const Token& token : tokens)
+    {
+        addUnknown(position, token.position);
+
+        Band band;
+        band.position  = token.position;
+        band.length    = token.length;
+        band.frequency = isCommon(dict, token.entries)
+                       ? Frequency::Common
+                       : Frequency::Rare;
+        bands.push_back(band);
+
+        position = token.position + token.length;
+    }
+    addUnknown(position, text.size());
+
+    return bands;
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Private data of the highlighter.
+ * ---------------------------------------------------------------- */
+struct TextEditorHighlighter::Impl
+{
+    // A block to segment.
+    struct Request
+    {
+        int blockNumber;
+        int blockRevision;
+        QString text;
+    };
+
+    // A segmented block.
+    struct Result
+    {
+        Request request;
+        JMdictPtr dictionary;
+        std::vector<Token> tokens;
+        std::vector<Band> bands;
+    };
+
+    // Segments the requested blocks.
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            cv.wait(lock, [this]()
+            {
+                return !requests.empty() || stopped;
+            });
+            if (stopped)
+                return;
+
+            Result result;
+            result.request    = std::move(requests.front());
+            result.dictionary = dictionary;
+            requests.pop_front();
+            if (!result.dictionary)
+                continue;
+
+            lock.unlock();
+            const JMdict& dict = *result.dictionary;
+            result.tokens = TextEditorBlockData::tokenize(
+                result.request.text, dict);
+            result.bands = bandsOf(
+                result.request.text, result.tokens, dict);
+            lock.lock();
+
+            // The results are applied in one go in the GUI thread.
+            results.push_back(std::move(result));
+            if (results.size() == 1)
+                QMetaObject::invokeMethod(self, "applySegments",
+                                          Qt::QueuedConnection);
+        }
+    }
+
+    TextEditorHighlighter* self = nullptr;
+    QTextCharFormat rareFormat;
+    QTextCharFormat unknownFormat;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    JMdictPtr dictionary;
+    std::deque<Request> requests;
+    std::vector<Result> results;
+    bool stopped = false;
+};
+
+/* ---------------------------------------------------------------- *
+   Constructs the highlighter.
+ * ---------------------------------------------------------------- */
+TextEditorHighlighter::TextEditorHighlighter(QTextDocument* document)
+    : QSyntaxHighlighter(document)
+    , impl(std::make_shared<Impl>())
+{
+    impl->self = this;
+    impl->rareFormat.setForeground(QColor(176, 96, 0));
+    impl->unknownFormat.setUnderlineStyle(
+        QTextCharFormat::SpellCheckUnderline);
+    impl->unknownFormat.setUnderlineColor(QColor(200, 0, 0));
+
+    impl->thread = std::thread(&Impl::run, impl.get());
+}
+
+/* ---------------------------------------------------------------- *
+   Stops the worker thread.
+ * ---------------------------------------------------------------- */
+TextEditorHighlighter::~TextEditorHighlighter()
+{
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        impl->stopped = true;
+        impl->cv.notify_all();
+    }
+    impl->thread.join();
+}
+
+/* ---------------------------------------------------------------- *
+   Sets the dictionary.
+ * ---------------------------------------------------------------- */
+void TextEditorHighlighter::setDictionary(JMdictPtr dictionary)
+{
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        impl->dictionary = dictionary;
+        impl->requests.clear();
+    }
+    reformat(QTextBlock());
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true while the document is being reformatted.
+ * ---------------------------------------------------------------- */
+bool TextEditorHighlighter::isReformatting(const QTextDocument* document)
+{ return document->property(REFORMATTING_PROPERTY).toBool(); }
+
+/* ---------------------------------------------------------------- *
+   Segments the blocks in the worker thread.
+ * ---------------------------------------------------------------- */
+void TextEditorHighlighter::segment(const std::vector<QTextBlock>& blocks)
+{
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    if (!impl->dictionary)
+        return;
+
+    impl->requests.clear();
+    for (const QTextBlock& block : blocks)
+    {
+        if (TextEditorBlockData::bands(block, *impl->dictionary))
+            continue;
+        impl->requests.push_back(
+            { block.blockNumber(), block.revision(), block.text() });
+    }
+    impl->cv.notify_all();
+}
+
+/* ---------------------------------------------------------------- *
+   Applies the frequency bands of the current block.
+ * ---------------------------------------------------------------- */
+void TextEditorHighlighter::highlightBlock(const QString& /*text*/)
+{
+    JMdictPtr dict = impl->dictionary;
+    if (!dict)
+        return;
+
+    const std::vector<Band>* bands =
+        TextEditorBlockData::bands(currentBlock(), *dict);
+    if (!bands)
+        return;
+
+    for (const Band& band : *bands)
+    {
+        switch (band.frequency)
+        {
+            case Frequency::Rare:
+                setFormat(band.position, band.length, impl->rareFormat);
+                break;
+            case Frequency::Unknown:
+                setFormat(band.position, band.length, impl->unknownFormat);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Stores the segmented blocks and highlights them. The blocks that
+   have changed during the segmentation are skipped.
+ * ---------------------------------------------------------------- */
+void TextEditorHighlighter::applySegments()
+{
+    std::vector<Impl::Result> results;
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        results.swap(impl->results);
+    }
+
+    for (Impl::Result& result : results)
+    {
+        if (result.dictionary != impl->dictionary)
+            continue;
+
+        const QTextBlock block =
+            document()->findBlockByNumber(result.request.blockNumber);
+        if (!block.isValid() ||
+            block.revision() != result.request.blockRevision ||
+            block.text()     != result.request.text)
+        {
+            continue;
+        }
+
+        TextEditorBlockData::setSegments(block,
+                                         result.request.blockRevision,
+                                         *result.dictionary,
+                                         std::move(result.tokens),
+                                         std::move(result.bands));
+        reformat(block);
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Reformats the block or the document.
+ * ---------------------------------------------------------------- */
+void TextEditorHighlighter::reformat(const QTextBlock& block)
+{
+    QTextDocument* doc = document();
+    if (!doc)
+        return;
+
+    doc->setProperty(REFORMATTING_PROPERTY, true);
+    if (block.isValid())
+        rehighlightBlock(block);
+    else
+        rehighlight();
+    doc->setProperty(REFORMATTING_PROPERTY, false);
+}
+
+} // namespace jpad
+} // namespace kuu
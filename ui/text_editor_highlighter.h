@@ -0,0 +1,70 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::jpad::TextEditorHighlighter class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <QtGui/QSyntaxHighlighter>
+#include <QtGui/QTextBlock>
+#include "../jmdict/jmdict.h"
+
+namespace kuu
+{
+namespace jpad
+{
+
+/* ---------------------------------------------------------------- *
+   Colors the words of the text by their frequency band. Rare words
+   are colored and Japanese text that is not in the dictionary is
+   underlined.
+
+   The blocks are segmented in a worker thread only when asked,
+   e.g. for the visible blocks. The bands are applied when the
+   worker has finished. Until then the block is not colored.
+ * ---------------------------------------------------------------- */
+class TextEditorHighlighter : public QSyntaxHighlighter
+{
+    Q_OBJECT
+
+public:
+    // Constructs the highlighter of the document and starts the
+    // worker thread.
+    explicit TextEditorHighlighter(QTextDocument* document);
+    // Stops the worker thread.
+    ~TextEditorHighlighter();
+
+    // Sets the dictionary. The bands are cleared.
+    void setDictionary(JMdictPtr dictionary);
+
+    // Returns true while a highlighter of the document reformats
+    // blocks. QTextDocument reports the format changes as content
+    // changes of the same length, these are not edits.
+    static bool isReformatting(const QTextDocument* document);
+
+    // Segments the blocks that have changed since they were last
+    // segmented. Replaces the blocks of the previous call that the
+    // worker has not yet segmented.
+    void segment(const std::vector<QTextBlock>& blocks);
+
+protected:
+    void highlightBlock(const QString& text) override;
+
+private slots:
+    void applySegments();
+
+private:
+    // Reformats the block or the whole document if the block is not
+    // valid. The document is marked reformatting meanwhile.
+    void reformat(const QTextBlock& block);
+
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace jpad
+} // namespace kuu
@@ -7,18 +7,86 @@
  * ---------------------------------------------------------------- */
 
 #include "text_editor_reading_to_kanji_area.h"
+#include <vector>
+#include <QtGui/QKeyEvent>
+#include <QtGui/QPainter>
+#include <QtGui/QStaticText>
 
 namespace kuu
 {
 namespace jpad
 {
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+const int MARGIN  = 5;    // left and right margin
+const int SPACING = 28;   // space between candidates
+const int PADDING = 3;    // selection padding
+
+} // anonymous namespace
 
 /* ---------------------------------------------------------------- *
    Private data of text editor's reading-to-kanji area.
  * ---------------------------------------------------------------- */
 struct TextEditorReadingToKanjiArea::Impl
 {
-    std::vector<int> entryPositions;
+    // Prepares the glyphs of candidates.
+    void prepare(const QFont& font)
+    {
+        texts.resize(size_t(candidates.size()));
+        for (int i = 0; i < candidates.size(); ++i)
+        {
+            QStaticText& text = texts[size_t(i)];
+            text.setText(candidates[i]);
+            text.setTextFormat(Qt::PlainText);
+            text.prepare(QTransform(), font);
+        }
+    }
+
+    // Lays out the candidates into pages that fit the width.
+    void layout(int width)
+    {
+        positions.assign(texts.size(), 0);
+        pageOf.assign(texts.size(), 0);
+        pageStarts.clear();
+
+        int x = MARGIN;
+        for (size_t i = 0; i < texts.size(); ++i)
+        {
+            const int w = int(texts[i].size().width());
+            if (pageStarts.empty() ||
+                (x + w > width - MARGIN && pageStarts.back() != int(i)))
+            {
+                pageStarts.push_back(int(i));
+                x = MARGIN;
+            }
+            positions[i] = x;
+            pageOf[i]    = int(pageStarts.size()) - 1;
+            x += w + SPACING;
+        }
+    }
+
+    // Returns the rectangle of candidate including the selection
+    // padding.
+    QRect candidateRect(int index, int height) const
+    {
+        const QSizeF size = texts[size_t(index)].size();
+        return QRect(positions[size_t(index)] - PADDING, 0,
+                     int(size.width()) + 2 * PADDING, height);
+    }
+
+    // Returns the page count.
+    int pageCount() const
+    { return int(pageStarts.size()); }
+
+    QStringList candidates;
+    std::vector<QStaticText> texts;
+    std::vector<int> positions;   // x of each candidate
+    std::vector<int> pageOf;      // page of each candidate
+    std::vector<int> pageStarts;  // first candidate of each page
     int currentEntryPosition = 0;
 };
 
@@ -27,10 +95,11 @@ struct TextEditorReadingToKanjiArea::Impl
  * ---------------------------------------------------------------- */
 TextEditorReadingToKanjiArea::TextEditorReadingToKanjiArea(
         QWidget* parent)
-    : QPlainTextEdit(parent)
+    : QWidget(parent)
     , impl(std::make_shared<Impl>())
 {
-    setTextInteractionFlags(Qt::NoTextInteraction);
+    setFocusPolicy(Qt::StrongFocus);
+    setAttribute(Qt::WA_OpaquePaintEvent);
 }
 
 /* ---------------------------------------------------------------- *
@@ -45,7 +114,7 @@ void TextEditorReadingToKanjiArea::adjustSizeToTextEditor(
     const int extraSpace = 5;
     const int x = sideAreaSize.width() + extraSpace;
     const int w = textEditorSize.width() - x - extraSpace;
-    const int h = 25;
+    const int h = qMax(25, fontMetrics().height() + 2 * PADDING);
 
     // Move the area atop of the current text cursor if it would go
     // out-of-bounds.
@@ -60,30 +129,16 @@ void TextEditorReadingToKanjiArea::adjustSizeToTextEditor(
 }
 
 /* ---------------------------------------------------------------- *
-   Sets the entries.
+   Sets the candidates.
  * ---------------------------------------------------------------- */
-void TextEditorReadingToKanjiArea::setEntries(
-        const std::vector<JMdict::Entry>& entries,
-        const QString& reading)
+void TextEditorReadingToKanjiArea::setCandidates(
+        const QStringList& candidates)
 {
-    setPlainText("");
-    impl->entryPositions.clear();
-
-    QTextCursor tc = textCursor();
-    tc.setPosition(0);
-
-    for (const JMdict::Entry& entry : entries)
-    {
-        for (const JMdict::Kanji& kanji : entry.kanjis)
-        {
-            impl->entryPositions.push_back(tc.position());
-            tc.insertText(kanji.wordOrPhrase);
-            tc.insertText("       ");
-        }
-    }
-
-    impl->entryPositions.push_back(tc.position());
-    tc.insertText(reading);
+    impl->candidates = candidates;
+    impl->currentEntryPosition = 0;
+    impl->prepare(font());
+    impl->layout(width());
+    update();
 
     select(0);
 }
@@ -94,7 +149,7 @@ void TextEditorReadingToKanjiArea::setEntries(
 void TextEditorReadingToKanjiArea::selectNext()
 {
     int entryPosition = impl->currentEntryPosition + 1;
-    if (entryPosition >= int(impl->entryPositions.size()))
+    if (entryPosition >= impl->candidates.size())
         entryPosition = 0;
 
     select(entryPosition);
@@ -107,33 +162,71 @@ void TextEditorReadingToKanjiArea::selectPrevious()
 {
     int entryPosition = impl->currentEntryPosition - 1;
     if (entryPosition < 0)
-        entryPosition = int(impl->entryPositions.size()) - 1;
+        entryPosition = impl->candidates.size() - 1;
 
     select(entryPosition);
 }
 
 /* ---------------------------------------------------------------- *
-   Sets the next entry to be selected.
+   Selects the first entry of the next page.
+ * ---------------------------------------------------------------- */
+void TextEditorReadingToKanjiArea::selectNextPage()
+{
+    if (impl->candidates.isEmpty())
+        return;
+
+    int page = impl->pageOf[size_t(impl->currentEntryPosition)] + 1;
+    if (page >= impl->pageCount())
+        page = 0;
+    select(impl->pageStarts[size_t(page)]);
+}
+
+/* ---------------------------------------------------------------- *
+   Selects the first entry of the previous page.
+ * ---------------------------------------------------------------- */
+void TextEditorReadingToKanjiArea::selectPreviousPage()
+{
+    if (impl->candidates.isEmpty())
+        return;
+
+    int page = impl->pageOf[size_t(impl->currentEntryPosition)] - 1;
+    if (page < 0)
+        page = impl->pageCount() - 1;
+    select(impl->pageStarts[size_t(page)]);
+}
+
+/* ---------------------------------------------------------------- *
+   Sets the next entry to be selected. Only the changed part of
+   the area is repainted.
  * ---------------------------------------------------------------- */
 void TextEditorReadingToKanjiArea::select(int entryPosition)
 {
     if (entryPosition < 0 ||
-        entryPosition >= int(impl->entryPositions.size()))
+        entryPosition >= impl->candidates.size())
     {
         return;
     }
 
-    QTextCursor tc = textCursor();
-    tc.setPosition(impl->entryPositions[entryPosition]);
-    tc.select(QTextCursor::WordUnderCursor);
-    setTextCursor(tc);
+    const int previous = impl->currentEntryPosition;
     impl->currentEntryPosition = entryPosition;
-    emit selectedKanjisChanged(textCursor().selectedText());
+
+    if (previous < impl->candidates.size() &&
+        impl->pageOf[size_t(previous)] == impl->pageOf[size_t(entryPosition)])
+    {
+        update(impl->candidateRect(previous, height()));
+        update(impl->candidateRect(entryPosition, height()));
+    }
+    else
+    {
+        update();
+    }
+
+    emit selectedKanjisChanged(impl->candidates[entryPosition]);
 }
 
 /* ---------------------------------------------------------------- *
    User can press left or right arrow keys to move the selection
-   left or right.
+   left or right and page up or page down to change the page.
  * ---------------------------------------------------------------- */
 void TextEditorReadingToKanjiArea::keyPressEvent(QKeyEvent* event)
 {
@@ -149,6 +242,18 @@ void TextEditorReadingToKanjiArea::keyPressEvent(QKeyEvent* event)
             event->accept();
             return;
 
+        case Qt::Key_PageUp:
+        case Qt::Key_Up:
+            selectPreviousPage();
+            event->accept();
+            return;
+
+        case Qt::Key_PageDown:
+        case Qt::Key_Down:
+            selectNextPage();
+            event->accept();
+            return;
+
         case Qt::Key_Escape:
         case Qt::Key_Return:
             close();
@@ -168,7 +273,81 @@ void TextEditorReadingToKanjiArea::keyPressEvent(QKeyEvent* event)
 void TextEditorReadingToKanjiArea::closeEvent(QCloseEvent* event)
 {
     emit selectionFinished();
-    QPlainTextEdit::closeEvent(event);
+    QWidget::closeEvent(event);
+}
+
+/* ---------------------------------------------------------------- *
+   Paints the candidates of the current page.
+ * ---------------------------------------------------------------- */
+void TextEditorReadingToKanjiArea::paintEvent(QPaintEvent* event)
+{
+    QPainter painter(this);
+    painter.fillRect(event->rect(), palette().base());
+    painter.setPen(palette().mid().color());
+    painter.drawRect(rect().adjusted(0, 0, -1, -1));
+
+    if (impl->candidates.isEmpty())
+        return;
+
+    const int current = impl->currentEntryPosition;
+    const int page    = impl->pageOf[size_t(current)];
+    const int first   = impl->pageStarts[size_t(page)];
+    const int last    = page + 1 < impl->pageCount()
+                      ? impl->pageStarts[size_t(page + 1)]
+                      : impl->candidates.size();
+
+    for (int i = first; i < last; ++i)
+    {
+        const QRect r = impl->candidateRect(i, height());
+        if (!r.intersects(event->rect()))
+            continue;
+
+        const QStaticText& text = impl->texts[size_t(i)];
+        const int y = (height() - int(text.size().height())) / 2;
+        if (i == current)
+        {
+            painter.fillRect(r.adjusted(0, 1, 0, -1), palette().highlight());
+            painter.setPen(palette().highlightedText().color());
+        }
+        else
+        {
+            painter.setPen(palette().text().color());
+        }
+        painter.drawStaticText(impl->positions[size_t(i)], y, text);
+    }
+
+    // Page indicator.
+    if (impl->pageCount() > 1)
+    {
+        const QString pageText = QString("%1/%2")
+            .arg(page + 1).arg(impl->pageCount());
+        painter.setPen(palette().mid().color());
+        painter.drawText(rect().adjusted(0, 0, -MARGIN, 0),
+                         Qt::AlignRight | Qt::AlignVCenter,
+                         pageText);
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Lays out the candidates for the new width.
+ * ---------------------------------------------------------------- */
+void TextEditorReadingToKanjiArea::resizeEvent(QResizeEvent* event)
+{
+    QWidget::resizeEvent(event);
+    impl->layout(width());
+}
+
+/* ---------------------------------------------------------------- *
+   Prepares the glyphs again for the new font.
+ * ---------------------------------------------------------------- */
+void TextEditorReadingToKanjiArea::changeEvent(QEvent* event)
+{
+    if (event->type() == QEvent::FontChange)
+    {
+        impl->prepare(font());
+        impl->layout(width());
+    }
+    QWidget::changeEvent(event);
 }
 
 } // namespace jpad
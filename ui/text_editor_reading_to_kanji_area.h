@@ -7,8 +7,9 @@
 
 #pragma once
 
-#include <QtWidgets/QPlainTextEdit>
-#include "../jmdict/jmdict.h"
+#include <memory>
+#include <QtCore/QStringList>
+#include <QtWidgets/QWidget>
 
 namespace kuu
 {
@@ -17,8 +18,13 @@ namespace jpad
 
 /* ---------------------------------------------------------------- *
    Text editor's reading-to-kanji area.
+
+   The candidates are laid out once into pages that fit the area
+   width. The glyphs of candidates are cached so changing the
+   selection only repaints the previous and the new selection, or
+   the new page.
  * ---------------------------------------------------------------- */
-class TextEditorReadingToKanjiArea : public QPlainTextEdit
+class TextEditorReadingToKanjiArea : public QWidget
 {
     Q_OBJECT
 
@@ -33,14 +39,17 @@ public:
         const QSize& sideAreaSize,
         const QRect& cursorRect);
 
-    // Sets the entries.
-    void setEntries(const std::vector<JMdict::Entry>& entries,
-                    const QString& reading);
+    // Sets the candidates in rank order.
+    void setCandidates(const QStringList& candidates);
 
     // Sets the next entry to be selected.
     void selectNext();
     // Sets the previous entry to be selected.
     void selectPrevious();
+    // Selects the first entry of the next page.
+    void selectNextPage();
+    // Selects the first entry of the previous page.
+    void selectPreviousPage();
     // Select the entry.
     void select(int entryPosition);
 
@@ -49,8 +58,11 @@ signals:
     void selectionFinished();
 
 protected:
-    void keyPressEvent(QKeyEvent* event);
-    void closeEvent(QCloseEvent* event);
+    void keyPressEvent(QKeyEvent* event) override;
+    void closeEvent(QCloseEvent* event) override;
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void changeEvent(QEvent* event) override;
 
 private:
     struct Impl;
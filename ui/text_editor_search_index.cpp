@@ -0,0 +1,519 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::jpad::TextEditorSearchIndex class.
+ * ---------------------------------------------------------------- */
+
+#include "text_editor_search_index.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <QtCore/QStringMatcher>
+#include <QtCore/QTimer>
+#include <QtGui/QTextBlock>
+#include <QtGui/QTextDocument>
+#include "kana_conversion.h"
+#include "suffix_array.h"
+#include "text_editor_block_data.h"
+#include "text_editor_highlighter.h"
+
+namespace kuu
+{
+namespace jpad
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+// Character count of a segment.
+const int SEGMENT_SIZE = 1 << 20;
+// Delay in milliseconds after the last edit before the invalidated
+// segments are built.
+const int BUILD_DELAY = 500;
+
+/* ---------------------------------------------------------------- *
+   Returns true if the matches of the pattern can overlap, i.e. a
+   proper prefix of the pattern is also its suffix.
+ * ---------------------------------------------------------------- */
+bool canOverlap(const QString& pattern)
+{
+    for (int length = 1; length < pattern.size(); ++length)
+        if (pattern.leftRef(length) == pattern.rightRef(length))
+            return true;
+    return false;
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Private data of the search index.
+ * ---------------------------------------------------------------- */
+struct TextEditorSearchIndex::Impl
+{
+    // A suffix array of the folded text of segment blocks. The
+    // blocks are separated with line feeds.
+    struct Index
+    {
+        SuffixArray suffixArray;
+        std::vector<int> blockStarts;  // text position of each block
+    };
+
+    // A range of blocks. The segment is invalid if it does not have
+    // an index.
+    struct Segment
+    {
+        int id = 0;
+        int firstBlock = 0;
+        int blockCount = 0;
+        bool requested = false;        // index is being built
+        std::shared_ptr<const Index> index;
+    };
+
+    // Texts of segment blocks to index.
+    struct Request
+    {
+        int id;
+        std::vector<QString> blocks;
+    };
+
+    // An index of segment.
+    struct Result
+    {
+        int id;
+        std::shared_ptr<const Index> index;
+    };
+
+    // Builds the index of the blocks.
+    static std::shared_ptr<const Index> build(
+            const std::vector<QString>& blocks)
+    {
+        int size = 0;
+        for (const QString& block : blocks)
+            size += block.size() + 1;
+
+        QString text;
+        text.reserve(size);
+        std::shared_ptr<Index> index = std::make_shared<Index>();
+        index->blockStarts.reserve(blocks.size());
+        for (const QString& block : blocks)
+        {
+            index->blockStarts.push_back(text.size());
+            text += kana_conversion::fold(block);
+            text += QLatin1Char('\n');
+        }
+        index->suffixArray = SuffixArray(text);
+        return index;
+    }
+
+    // Builds the requested indexes.
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            cv.wait(lock, [this]()
+            {
+                return !requests.empty() || stopped;
+            });
+            if (stopped)
+                return;
+
+            Request request = std::move(requests.front());
+            requests.pop_front();
+
+            lock.unlock();
+            Result result = { request.id, build(request.blocks) };
+            lock.lock();
+
+            // The indexes are applied in one go in the GUI thread.
+            results.push_back(std::move(result));
+            if (results.size() == 1)
+                QMetaObject::invokeMethod(self, "applySuffixArrays",
+                                          Qt::QueuedConnection);
+        }
+    }
+
+    // Returns a new invalid segment.
+    Segment newSegment(int firstBlock, int blockCount)
+    {
+        Segment segment;
+        segment.id         = nextId++;
+        segment.firstBlock = firstBlock;
+        segment.blockCount = blockCount;
+        return segment;
+    }
+
+    // Returns the index of the segment that contains the block.
+    size_t segmentOf(int blockNumber) const
+    {
+        auto it = std::upper_bound(segments.begin(), segments.end(),
+                                   blockNumber,
+                                   [](int number, const Segment& s)
+        {
+            return number < s.firstBlock;
+        });
+        return it == segments.begin()
+             ? 0 : size_t(it - segments.begin()) - 1;
+    }
+
+    // Replaces the segments of the old blocks from the first to the
+    // last with one invalid segment. The block count has changed by
+    // the delta. The following segments are moved by the delta.
+    void invalidate(int first, int last, int delta)
+    {
+        const size_t a = segmentOf(first);
+        const size_t b = std::max(a, segmentOf(last));
+
+        const int firstBlock = segments[a].firstBlock;
+        const int blockCount = segments[b].firstBlock
+                             + segments[b].blockCount
+                             - firstBlock + delta;
+
+        std::vector<int> removed;
+        for (size_t i = a; i <= b; ++i)
+            if (segments[i].requested && !segments[i].index)
+                removed.push_back(segments[i].id);
+        if (!removed.empty())
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requests.erase(std::remove_if(requests.begin(), requests.end(),
+                [&](const Request& r)
+            {
+                return std::find(removed.begin(), removed.end(), r.id) !=
+                       removed.end();
+            }), requests.end());
+        }
+
+        segments.erase(segments.begin() + long(a) + 1,
+                       segments.begin() + long(b) + 1);
+        segments[a] = newSegment(firstBlock, blockCount);
+        for (size_t i = a + 1; i < segments.size(); ++i)
+            segments[i].firstBlock += delta;
+    }
+
+    // Appends the positions of matches in the blocks. A match starts
+    // after the end of the previous match.
+    void scan(int firstBlock, int blockCount,
+              const QStringMatcher& matcher,
+              std::vector<int>& out) const
+    {
+        QTextBlock block = document->findBlockByNumber(firstBlock);
+        for (int i = 0; i < blockCount && block.isValid(); ++i)
+        {
+            const QString text = TextEditorBlockData::foldedText(block);
+            const int length = matcher.pattern().size();
+            for (int index = matcher.indexIn(text, 0);
+                 index >= 0;
+                 index = matcher.indexIn(text, index + length))
+            {
+                out.push_back(block.position() + index);
+            }
+            block = block.next();
+        }
+    }
+
+    // Appends the positions of matches in the segment index. The
+    // occurrences that overlap the previous match are skipped. A
+    // match does not span blocks as the pattern has no line feed.
+    void lookup(const Segment& segment,
+                const QString& pattern,
+                std::vector<int>& out) const
+    {
+        const std::vector<int>& starts = segment.index->blockStarts;
+        const std::vector<int> positions =
+            segment.index->suffixArray.positions(pattern);
+
+        QTextBlock block;
+        int current = -1;
+        int end = 0;
+        for (const int position : positions)
+        {
+            if (position < end)
+                continue;
+            end = position + pattern.size();
+
+            const int local = int(std::upper_bound(starts.begin(),
+                                                   starts.end(),
+                                                   position)
+                                  - starts.begin()) - 1;
+            if (local != current)
+            {
+                current = local;
+                block = document->findBlockByNumber(
+                    segment.firstBlock + local);
+            }
+            out.push_back(block.position() + position
+                        - starts[size_t(local)]);
+        }
+    }
+
+    TextEditorSearchIndex* self = nullptr;
+    QTextDocument* document = nullptr;
+    bool enabled = false;
+    int blockCount = 0;          // block count before the change
+    int nextId = 0;
+    std::vector<Segment> segments;
+    QTimer buildTimer;
+
+    // Matches of the latest search.
+    quint64 changeCount = 0;
+    quint64 cachedChangeCount = 0;
+    QString cachedPattern;
+    std::vector<int> cachedMatches;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Request> requests;
+    std::vector<Result> results;
+    bool stopped = false;
+};
+
+/* ---------------------------------------------------------------- *
+   Constructs the search index.
+ * ---------------------------------------------------------------- */
+TextEditorSearchIndex::TextEditorSearchIndex(QTextDocument* document)
+    : QObject(document)
+    , impl(std::make_shared<Impl>())
+{
+    impl->self     = this;
+    impl->document = document;
+
+    impl->buildTimer.setSingleShot(true);
+    impl->buildTimer.setInterval(BUILD_DELAY);
+    connect(&impl->buildTimer, &QTimer::timeout,
+            this, &TextEditorSearchIndex::buildSegments);
+    connect(document, &QTextDocument::contentsChange,
+            this, &TextEditorSearchIndex::onContentsChange);
+
+    impl->thread = std::thread(&Impl::run, impl.get());
+}
+
+/* ---------------------------------------------------------------- *
+   Stops the worker thread.
+ * ---------------------------------------------------------------- */
+TextEditorSearchIndex::~TextEditorSearchIndex()
+{
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        impl->stopped = true;
+        impl->cv.notify_all();
+    }
+    impl->thread.join();
+}
+
+/* ---------------------------------------------------------------- *
+   Enables or disables the index. The whole document is one invalid
+   segment that is split when built.
+ * ---------------------------------------------------------------- */
+void TextEditorSearchIndex::setEnabled(bool enabled)
+{
+    if (enabled == impl->enabled)
+        return;
+    impl->enabled = enabled;
+
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        impl->requests.clear();
+    }
+    impl->segments.clear();
+    impl->blockCount = impl->document->blockCount();
+    if (enabled)
+    {
+        impl->segments.push_back(
+            impl->newSegment(0, impl->blockCount));
+        impl->buildTimer.start();
+    }
+    else
+    {
+        impl->buildTimer.stop();
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Returns true if the index is enabled.
+ * ---------------------------------------------------------------- */
+bool TextEditorSearchIndex::isEnabled() const
+{ return impl->enabled; }
+
+/* ---------------------------------------------------------------- *
+   Returns the count of matches. The indexed segments are counted
+   from the suffix arrays without collecting the positions unless
+   the occurrences of the text can overlap.
+ * ---------------------------------------------------------------- */
+int TextEditorSearchIndex::count(const QString& foldedText)
+{
+    if (foldedText.isEmpty() || foldedText.contains(QLatin1Char('\n')))
+        return 0;
+    if (foldedText == impl->cachedPattern &&
+        impl->changeCount == impl->cachedChangeCount)
+    {
+        return int(impl->cachedMatches.size());
+    }
+    if (canOverlap(foldedText))
+        return int(matches(foldedText).size());
+
+    const QStringMatcher matcher(foldedText);
+    std::vector<int> scanned;
+    int count = 0;
+    if (impl->segments.empty())
+        impl->scan(0, impl->document->blockCount(), matcher, scanned);
+    for (const Impl::Segment& segment : impl->segments)
+    {
+        if (segment.index)
+            count += segment.index->suffixArray.count(foldedText);
+        else
+            impl->scan(segment.firstBlock, segment.blockCount,
+                       matcher, scanned);
+    }
+    return count + int(scanned.size());
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the positions of matches. The segments are searched in
+   the document order so the positions are in ascending order.
+ * ---------------------------------------------------------------- */
+const std::vector<int>& TextEditorSearchIndex::matches(
+        const QString& foldedText)
+{
+    if (foldedText == impl->cachedPattern &&
+        impl->changeCount == impl->cachedChangeCount)
+    {
+        return impl->cachedMatches;
+    }
+
+    std::vector<int> out;
+    if (!foldedText.isEmpty() && !foldedText.contains(QLatin1Char('\n')))
+    {
+        const QStringMatcher matcher(foldedText);
+        if (impl->segments.empty())
+            impl->scan(0, impl->document->blockCount(), matcher, out);
+        for (const Impl::Segment& segment : impl->segments)
+        {
+            if (segment.index)
+                impl->lookup(segment, foldedText, out);
+            else
+                impl->scan(segment.firstBlock, segment.blockCount,
+                           matcher, out);
+        }
+    }
+
+    impl->cachedPattern     = foldedText;
+    impl->cachedChangeCount = impl->changeCount;
+    impl->cachedMatches.swap(out);
+    return impl->cachedMatches;
+}
+
+/* ---------------------------------------------------------------- *
+   Invalidates the segments of the changed blocks. The last changed
+   block before the change is found from the change of the block
+   count.
+ * ---------------------------------------------------------------- */
+void TextEditorSearchIndex::onContentsChange(int position,
+                                             int /*removed*/,
+                                             int added)
+{
+    if (TextEditorHighlighter::isReformatting(impl->document))
+        return;
+
+    ++impl->changeCount;
+    if (!impl->enabled)
+        return;
+
+    const int blockCount = impl->document->blockCount();
+    const int delta      = blockCount - impl->blockCount;
+
+    QTextBlock firstBlock = impl->document->findBlock(position);
+    QTextBlock lastBlock  = impl->document->findBlock(position + added);
+    if (!firstBlock.isValid())
+        firstBlock = impl->document->lastBlock();
+    if (!lastBlock.isValid())
+        lastBlock = impl->document->lastBlock();
+
+    const int first = firstBlock.blockNumber();
+    const int last  = qBound(first,
+                             lastBlock.blockNumber() - delta,
+                             impl->blockCount - 1);
+    impl->invalidate(first, last, delta);
+    impl->blockCount = blockCount;
+    impl->buildTimer.start();
+}
+
+/* ---------------------------------------------------------------- *
+   Requests the indexes of the invalid segments. The segments larger
+   than the segment size are split first.
+ * ---------------------------------------------------------------- */
+void TextEditorSearchIndex::buildSegments()
+{
+    std::vector<Impl::Segment> segments;
+    std::vector<Impl::Request> requests;
+    for (const Impl::Segment& segment : impl->segments)
+    {
+        if (segment.index || segment.requested)
+        {
+            segments.push_back(segment);
+            continue;
+        }
+
+        Impl::Segment part = impl->newSegment(segment.firstBlock, 0);
+        Impl::Request request = { part.id, std::vector<QString>() };
+        int size = 0;
+
+        QTextBlock block =
+            impl->document->findBlockByNumber(segment.firstBlock);
+        for (int i = 0; i < segment.blockCount && block.isValid(); ++i)
+        {
+            request.blocks.push_back(block.text());
+            size += block.length();
+            ++part.blockCount;
+            block = block.next();
+
+            if (size >= SEGMENT_SIZE && i + 1 < segment.blockCount)
+            {
+                part.requested = true;
+                segments.push_back(part);
+                requests.push_back(std::move(request));
+
+                part = impl->newSegment(segment.firstBlock + i + 1, 0);
+                request = { part.id, std::vector<QString>() };
+                size = 0;
+            }
+        }
+
+        part.requested = true;
+        segments.push_back(part);
+        requests.push_back(std::move(request));
+    }
+    impl->segments.swap(segments);
+
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    for (Impl::Request& request : requests)
+        impl->requests.push_back(std::move(request));
+    impl->cv.notify_all();
+}
+
+/* ---------------------------------------------------------------- *
+   Stores the built indexes. The indexes of segments that have been
+   invalidated during the build are skipped.
+ * ---------------------------------------------------------------- */
+void TextEditorSearchIndex::applySuffixArrays()
+{
+    std::vector<Impl::Result> results;
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        results.swap(impl->results);
+    }
+
+    for (Impl::Result& result : results)
+        for (Impl::Segment& segment : impl->segments)
+            if (segment.id == result.id)
+                segment.index = result.index;
+}
+
+} // namespace jpad
+} // namespace kuu
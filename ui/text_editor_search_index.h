@@ -0,0 +1,69 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::jpad::TextEditorSearchIndex class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <QtCore/QObject>
+
+class QTextDocument;
+
+namespace kuu
+{
+namespace jpad
+{
+
+/* ---------------------------------------------------------------- *
+   A suffix array index of the kana and width folded document text
+   for searching large documents.
+
+   The blocks of the document are split into segments of about the
+   same size and a suffix array of each segment is built in a worker
+   thread. An edit invalidates only the segments of the changed
+   blocks. They are built again after the edits have stopped. Until
+   then the invalidated segments are searched by scanning the
+   blocks.
+ * ---------------------------------------------------------------- */
+class TextEditorSearchIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Constructs the index of the document and starts the worker
+    // thread. The index is disabled.
+    explicit TextEditorSearchIndex(QTextDocument* document);
+    // Stops the worker thread.
+    ~TextEditorSearchIndex();
+
+    // Enables or disables the index. The segments are built in the
+    // background after the index is enabled.
+    void setEnabled(bool enabled);
+    // Returns true if the index is enabled.
+    bool isEnabled() const;
+
+    // Returns the count of matches of the folded text. The matches
+    // do not overlap, a match starts after the end of the previous
+    // one as in a replace-all.
+    int count(const QString& foldedText);
+    // Returns the document positions of the matches of the folded
+    // text in ascending order. The matches are cached until the
+    // document changes.
+    const std::vector<int>& matches(const QString& foldedText);
+
+private slots:
+    void onContentsChange(int position, int removed, int added);
+    void buildSegments();
+    void applySuffixArrays();
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace jpad
+} // namespace kuu
@@ -7,6 +7,7 @@
 
 #include "text_editor_side_area.h"
 #include <QtGui/QPainter>
+#include <QtGui/QStaticText>
 #include <QtGui/QTextBlock>
 #include "text_editor.h"
 
@@ -20,7 +21,36 @@ namespace jpad
  * ---------------------------------------------------------------- */
 struct TextEditorSideArea::Impl
 {
+    // Prepares the static texts of digits for the current font.
+    void prepareDigits(const QFont& font)
+    {
+        const QFontMetrics fm(font);
+        digitAdvance = 0;
+        for (int d = 0; d < 10; ++d)
+        {
+            const QChar c = QLatin1Char(char('0' + d));
+            digits[d].setText(QString(c));
+            digits[d].setTextFormat(Qt::PlainText);
+            digits[d].prepare(QTransform(), font);
+            digitWidths[d] = fm.width(c);
+            digitAdvance = qMax(digitAdvance, digitWidths[d]);
+        }
+        lineHeight = fm.height();
+        digitsPrepared = true;
+    }
+
     TextEditor* editor;
+
+    // Cached digit glyphs. Line numbers are drawn as runs of these.
+    QStaticText digits[10];
+    int digitWidths[10];
+    int digitAdvance = 0;
+    int lineHeight = 0;
+    bool digitsPrepared = false;
+
+    // Digit count of the largest line number and the area width.
+    int digitCount = 0;
+    int width = 0;
 };
 
 /* ---------------------------------------------------------------- *
@@ -31,6 +61,7 @@ TextEditorSideArea::TextEditorSideArea(TextEditor* editor)
     , impl(std::make_shared<Impl>())
 {
     impl->editor = editor;
+    updateAreaWidth();
 }
 
 /* ---------------------------------------------------------------- *
@@ -38,18 +69,45 @@ TextEditorSideArea::TextEditorSideArea(TextEditor* editor)
    the text editor.
  * ---------------------------------------------------------------- */
 int TextEditorSideArea::areaWidth() const
+{ return impl->width; }
+
+/* ---------------------------------------------------------------- *
+   Updates the area width if the digit count of the largest line
+   number has changed. Returns true if the width has changed.
+ * ---------------------------------------------------------------- */
+bool TextEditorSideArea::updateAreaWidth()
 {
     int digits = 1;
-    int max = qMax(1, impl->editor->blockCount());
+    qint64 max = qMax(qint64(1), impl->editor->lineCount());
     while (max >= 10)
     {
         max /= 10;
         ++digits;
     }
 
-    int space = 3 + fontMetrics().width(QLatin1Char('9')) * digits;
+    if (digits == impl->digitCount && impl->digitsPrepared)
+        return false;
 
-    return space + 20;
+    if (!impl->digitsPrepared)
+        impl->prepareDigits(font());
+    impl->digitCount = digits;
+
+    const int width = 3 + impl->digitAdvance * digits + 20;
+    if (width == impl->width)
+        return false;
+
+    impl->width = width;
+    return true;
+}
+
+/* ---------------------------------------------------------------- *
+   Drops the cached digits when the font changes.
+ * ---------------------------------------------------------------- */
+void TextEditorSideArea::changeEvent(QEvent* event)
+{
+    if (event->type() == QEvent::FontChange)
+        impl->digitsPrepared = false;
+    QWidget::changeEvent(event);
 }
 
 /* ---------------------------------------------------------------- *
@@ -60,35 +118,49 @@ void TextEditorSideArea::paintEvent(QPaintEvent* event)
     // Fill with background
     QPainter painter(this);
     painter.fillRect(event->rect(), QColor(236, 236, 236));
+    painter.setPen(Qt::black);
+
+    if (!impl->digitsPrepared)
+        impl->prepareDigits(font());
 
-    QTextBlock block = impl->editor->firstVisibleBlock();
-    QRectF blockBound =
-        impl->editor->blockBoundingGeometry(block);
-    int blockNumber = block.blockNumber();
+    const TextEditor* editor = impl->editor;
+    QTextBlock block = editor->firstVisibleBlock();
+    if (!block.isValid())
+        return;
 
-    int top = (int) blockBound.translated(impl->editor->contentOffset()).top();
-    int bottom = top + (int) blockBound.height();
+    // Only the first block geometry is needed, the rest of the
+    // blocks follow it.
+    qint64 lineNumber = impl->editor->firstLineNumber() + block.blockNumber();
+    qreal top = editor->blockBoundingGeometry(block)
+                    .translated(editor->contentOffset()).top();
 
+    char digits[20];
     while (block.isValid() && top <= event->rect().bottom())
     {
-        blockBound =
-            impl->editor->blockBoundingGeometry(block);
-        blockNumber = block.blockNumber();
-
-        top = (int) blockBound.translated(impl->editor->contentOffset()).top();
-        bottom = top + (int) blockBound.height();
+        const qreal bottom = top + editor->blockBoundingRect(block).height();
         if (block.isVisible() && bottom >= event->rect().top())
         {
-            QString number = QString::number(blockNumber + 1);
-            painter.setPen(Qt::black);
-            painter.drawText(0, top, width(), fontMetrics().height(),
-                             Qt::AlignCenter, number);
+            // Line number digits from the last one.
+            int count = 0;
+            for (qint64 n = lineNumber + 1; n > 0; n /= 10)
+                digits[count++] = char(n % 10);
+
+            // Centered as a run of fixed width digit cells.
+            int x = (width() - count * impl->digitAdvance) / 2;
+            const int y = int(top);
+            while (count > 0)
+            {
+                const int d = digits[--count];
+                painter.drawStaticText(
+                    x + (impl->digitAdvance - impl->digitWidths[d]) / 2, y,
+                    impl->digits[d]);
+                x += impl->digitAdvance;
+            }
         }
 
         block = block.next();
-//        top = bottom;
-//        bottom = top + (int) blockBound.height();
-        ++blockNumber;
+        top = bottom;
+        ++lineNumber;
     }
 }
 
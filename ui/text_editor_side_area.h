@@ -31,8 +31,13 @@ public:
     // Returns the area width based on the current content on
     // the text editor.
     int areaWidth() const;
+    // Updates the area width if the digit count of the largest
+    // line number has changed. Returns true if the width has
+    // changed.
+    bool updateAreaWidth();
 
 protected:
+    void changeEvent(QEvent* event) override;
     void paintEvent(QPaintEvent* event) override;
 
 private:
@@ -0,0 +1,118 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::jpad::TextFileReader class.
+ * ---------------------------------------------------------------- */
+
+#include "text_file_reader.h"
+#include <QtCore/QFile>
+#include <QtCore/QSemaphore>
+#include <QtCore/QTextCodec>
+#include <QtCore/QTextDecoder>
+
+namespace kuu
+{
+namespace jpad
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+const qint64 FIRST_CHUNK_SIZE = 64 * 1024;
+const qint64 CHUNK_SIZE       = 1024 * 1024;
+const int MAX_CHUNKS_IN_FLIGHT = 4;
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Private data of the text file reader.
+ * ---------------------------------------------------------------- */
+struct TextFileReader::Impl
+{
+    QString filePath;
+    QSemaphore freeChunks { MAX_CHUNKS_IN_FLIGHT };
+};
+
+/* ---------------------------------------------------------------- *
+   Constructs the reader of the file.
+ * ---------------------------------------------------------------- */
+TextFileReader::TextFileReader(const QString& filePath,
+                               QObject* parent)
+    : QThread(parent)
+    , impl(std::make_shared<Impl>())
+{
+    impl->filePath = filePath;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the file path.
+ * ---------------------------------------------------------------- */
+QString TextFileReader::filePath() const
+{ return impl->filePath; }
+
+/* ---------------------------------------------------------------- *
+   Notifies that a chunk has been handled.
+ * ---------------------------------------------------------------- */
+void TextFileReader::chunkConsumed()
+{ impl->freeChunks.release(); }
+
+/* ---------------------------------------------------------------- *
+   Stops reading and waits for the thread to finish.
+ * ---------------------------------------------------------------- */
+void TextFileReader::cancel()
+{
+    requestInterruption();
+    wait();
+}
+
+/* ---------------------------------------------------------------- *
+   Reads the file.
+ * ---------------------------------------------------------------- */
+void TextFileReader::run()
+{
+    QFile file(impl->filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        emit failed("Failed to load file " + impl->filePath);
+        return;
+    }
+
+    const qint64 size = qMax(file.size(), qint64(1));
+    std::unique_ptr<QTextDecoder> decoder(
+        QTextCodec::codecForName("UTF-8")->makeDecoder());
+
+    qint64 chunkSize = FIRST_CHUNK_SIZE;
+    int percent = -1;
+    while (!file.atEnd())
+    {
+        // Wait until the receiver has caught up.
+        while (!impl->freeChunks.tryAcquire(1, 50))
+            if (isInterruptionRequested())
+                return;
+        if (isInterruptionRequested())
+            return;
+
+        const QByteArray bytes = file.read(chunkSize);
+        if (bytes.isEmpty() && file.error() != QFile::NoError)
+        {
+            emit failed(file.errorString());
+            return;
+        }
+
+        emit chunkRead(decoder->toUnicode(bytes));
+        chunkSize = CHUNK_SIZE;
+
+        const int newPercent = int(file.pos() * 100 / size);
+        if (newPercent != percent)
+        {
+            percent = newPercent;
+            emit progressChanged(percent);
+        }
+    }
+}
+
+} // namespace jpad
+} // namespace kuu
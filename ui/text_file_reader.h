@@ -0,0 +1,63 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::jpad::TextFileReader class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <memory>
+#include <QtCore/QThread>
+
+namespace kuu
+{
+namespace jpad
+{
+
+/* ---------------------------------------------------------------- *
+   Reads and decodes a UTF-8 text file in a worker thread.
+
+   The text is emitted in chunks so that the receiver can insert
+   them into the document one at a time. The first chunk is small
+   to get the first screen of text visible quickly. At most a few
+   chunks are in flight at once: the receiver must call
+   chunkConsumed() after each handled chunk.
+ * ---------------------------------------------------------------- */
+class TextFileReader : public QThread
+{
+    Q_OBJECT
+
+public:
+    // Constructs the reader of the file. Call start() to start
+    // reading.
+    explicit TextFileReader(const QString& filePath,
+                            QObject* parent = nullptr);
+
+    // Returns the file path.
+    QString filePath() const;
+
+    // Notifies that a chunk has been handled.
+    void chunkConsumed();
+
+    // Stops reading and waits for the thread to finish.
+    void cancel();
+
+signals:
+    // A chunk of text has been read.
+    void chunkRead(const QString& text);
+    // Reading progress in range of [0, 100] has changed.
+    void progressChanged(int percent);
+    // Reading has failed.
+    void failed(const QString& error);
+
+protected:
+    void run() override;
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace jpad
+} // namespace kuu
@@ -0,0 +1,247 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::jpad::TextFileWriter class.
+ * ---------------------------------------------------------------- */
+
+#include "text_file_writer.h"
+#include <deque>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutex>
+#include <QtCore/QSaveFile>
+#include <QtCore/QWaitCondition>
+
+namespace kuu
+{
+namespace jpad
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+// Maximum count of queued chunks.
+const size_t MAX_QUEUED_CHUNKS = 4;
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Private data of the text file writer.
+ * ---------------------------------------------------------------- */
+struct TextFileWriter::Impl
+{
+    // A chunk of text or a piece table.
+    struct Chunk
+    {
+        QString text;
+        std::shared_ptr<PieceTable> table;
+    };
+
+    // Queues a chunk. Blocks while the queue is full. The chunk is
+    // dropped if the writer has stopped.
+    void push(const Chunk& chunk)
+    {
+        QMutexLocker locker(&mutex);
+        while (chunks.size() >= MAX_QUEUED_CHUNKS && !stopped)
+            notFull.wait(&mutex);
+        if (stopped)
+            return;
+
+        chunks.push_back(chunk);
+        available.wakeOne();
+    }
+
+    // Takes the next chunk from the queue. Blocks until a chunk is
+    // available. Returns false at the end of text.
+    bool take(Chunk& chunk)
+    {
+        QMutexLocker locker(&mutex);
+        while (chunks.empty() && !finished)
+            available.wait(&mutex);
+
+        if (chunks.empty())
+            return false;
+
+        chunk = chunks.front();
+        chunks.pop_front();
+        notFull.wakeAll();
+        return true;
+    }
+
+    // Stops taking chunks after a failure. The queued and the
+    // later chunks are dropped.
+    void stop()
+    {
+        QMutexLocker locker(&mutex);
+        stopped = true;
+        chunks.clear();
+        notFull.wakeAll();
+    }
+
+    QString filePath;
+    mutable QMutex mutex;
+    QWaitCondition available;
+    QWaitCondition notFull;
+    std::deque<Chunk> chunks;
+    bool finished = false;
+    bool stopped = false;
+    bool saved = false;
+};
+
+/* ---------------------------------------------------------------- *
+   Constructs the writer of the file.
+ * ---------------------------------------------------------------- */
+TextFileWriter::TextFileWriter(const QString& filePath,
+                               QObject* parent)
+    : QThread(parent)
+    , impl(std::make_shared<Impl>())
+{
+    impl->filePath = filePath;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the file path.
+ * ---------------------------------------------------------------- */
+QString TextFileWriter::filePath() const
+{ return impl->filePath; }
+
+/* ---------------------------------------------------------------- *
+   Returns true if the file has been saved.
+ * ---------------------------------------------------------------- */
+bool TextFileWriter::isSaved() const
+{ return impl->saved; }
+
+/* ---------------------------------------------------------------- *
+   Returns true if the queue is full.
+ * ---------------------------------------------------------------- */
+bool TextFileWriter::isQueueFull() const
+{
+    QMutexLocker locker(&impl->mutex);
+    return impl->chunks.size() >= MAX_QUEUED_CHUNKS;
+}
+
+/* ---------------------------------------------------------------- *
+   Queues a chunk of text to be written.
+ * ---------------------------------------------------------------- */
+void TextFileWriter::write(const QString& text)
+{
+    if (text.isEmpty())
+        return;
+
+    Impl::Chunk chunk;
+    chunk.text = text;
+    impl->push(chunk);
+}
+
+/* ---------------------------------------------------------------- *
+   Queues a piece table to be written.
+ * ---------------------------------------------------------------- */
+void TextFileWriter::write(const PieceTable& text)
+{
+    Impl::Chunk chunk;
+    chunk.table = std::make_shared<PieceTable>(text);
+    impl->push(chunk);
+}
+
+/* ---------------------------------------------------------------- *
+   Marks the end of text.
+ * ---------------------------------------------------------------- */
+void TextFileWriter::finish()
+{
+    QMutexLocker locker(&impl->mutex);
+    impl->finished = true;
+    impl->available.wakeOne();
+}
+
+/* ---------------------------------------------------------------- *
+   Writes the file.
+ * ---------------------------------------------------------------- */
+void TextFileWriter::run()
+{
+    Impl::Chunk chunk;
+
+    QFileInfo fi(impl->filePath);
+    QDir dir = fi.absoluteDir();
+    if (!dir.exists() && !dir.mkpath(dir.absolutePath()))
+    {
+        emit failed(QString("Failed to make path %1")
+                        .arg(dir.absolutePath()));
+        impl->stop();
+        return;
+    }
+
+    // QSaveFile writes into a temporary file and on commit syncs
+    // it to disk before renaming it over the target file.
+    QSaveFile file(impl->filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        emit failed("Failed to create file " + impl->filePath);
+        impl->stop();
+        return;
+    }
+
+    bool written = false;
+    while (impl->take(chunk))
+    {
+        if (chunk.table)
+        {
+            // The piece table has the line endings of the file.
+            file.setTextModeEnabled(false);
+            const bool ok = chunk.table->write(file);
+            file.setTextModeEnabled(true);
+            if (!ok)
+            {
+                emit failed(file.errorString());
+                file.cancelWriting();
+                impl->stop();
+                return;
+            }
+            written = true;
+            emit chunkWritten();
+            continue;
+        }
+
+        if (!written)
+        {
+            file.write("\xEF\xBB\xBF", 3);
+            written = true;
+        }
+
+        // Same conversions as QTextDocument::toPlainText().
+        for (QChar& c : chunk.text)
+        {
+            if (c == QChar::LineSeparator)
+                c = QLatin1Char('\n');
+            else if (c == QChar::Nbsp)
+                c = QLatin1Char(' ');
+        }
+
+        const QByteArray bytes = chunk.text.toUtf8();
+        if (file.write(bytes) != bytes.size())
+        {
+            emit failed(file.errorString());
+            file.cancelWriting();
+            impl->stop();
+            return;
+        }
+        emit chunkWritten();
+    }
+
+    if (!written)
+        file.write("\xEF\xBB\xBF", 3);
+
+    if (!file.commit())
+    {
+        emit failed(file.errorString());
+        return;
+    }
+
+    impl->saved = true;
+    emit saved();
+}
+
+} // namespace jpad
+} // namespace kuu
@@ -0,0 +1,78 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::jpad::TextFileWriter class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <memory>
+#include <QtCore/QThread>
+#include "piece_table.h"
+
+namespace kuu
+{
+namespace jpad
+{
+
+/* ---------------------------------------------------------------- *
+   Encodes and writes a UTF-8 text file with BOM in a worker thread.
+
+   The text is given in chunks with write() and the end of text is
+   marked with finish(). At most a few chunks are queued at once:
+   the sender should give the next chunk when chunkWritten() is
+   emitted. A piece table is written without a BOM as it already
+   holds the bytes of the file. The chunks are written into a
+   temporary file that is synced to disk and renamed over the
+   target file only after all of the text has been written. A
+   failed or an interrupted save leaves the target file untouched.
+ * ---------------------------------------------------------------- */
+class TextFileWriter : public QThread
+{
+    Q_OBJECT
+
+public:
+    // Constructs the writer of the file. Call start() to start
+    // writing.
+    explicit TextFileWriter(const QString& filePath,
+                            QObject* parent = nullptr);
+
+    // Returns the file path.
+    QString filePath() const;
+    // Returns true if the file has been saved. Call after the
+    // thread has finished.
+    bool isSaved() const;
+
+    // Returns true if the queue is full. A write would block until
+    // the writer has taken a chunk.
+    bool isQueueFull() const;
+
+    // Queues a chunk of text to be written. Blocks while the queue
+    // is full. The chunk is dropped if the saving has failed.
+    void write(const QString& text);
+    // Queues a piece table to be written. The UTF-8 text of the
+    // table is written as it is.
+    void write(const PieceTable& text);
+    // Marks the end of text. The file is committed after the
+    // queued chunks have been written.
+    void finish();
+
+signals:
+    // A chunk has been written and there is room in the queue.
+    void chunkWritten();
+    // The file has been saved.
+    void saved();
+    // Saving has failed.
+    void failed(const QString& error);
+
+protected:
+    void run() override;
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace jpad
+} // namespace kuu
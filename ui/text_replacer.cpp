@@ -0,0 +1,224 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::jpad::TextReplacer class.
+ * ---------------------------------------------------------------- */
+
+#include "text_replacer.h"
+#include <QtCore/QStringMatcher>
+#include "kana_conversion.h"
+
+namespace kuu
+{
+namespace jpad
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+// Size of the large file text that is decoded at once.
+const qint64 CHUNK_SIZE = 4 * 1024 * 1024;
+
+/* ---------------------------------------------------------------- *
+   Returns the UTF-8 byte count of the UTF-16 characters.
+ * ---------------------------------------------------------------- */
+qint64 utf8Length(const QChar* data, int count)
+{
+    qint64 length = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        const ushort c = data[i].unicode();
+        if (c < 0x80)
+            length += 1;
+        else if (c < 0x800)
+            length += 2;
+        else if (QChar::isHighSurrogate(c))
+            length += 4;
+        else if (!QChar::isLowSurrogate(c))
+            length += 3;
+    }
+    return length;
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Private data of the text replacer.
+ * ---------------------------------------------------------------- */
+struct TextReplacer::Impl
+{
+    // Finds the matches of the document blocks.
+    void matchBlocks(QThread* thread)
+    {
+        const QStringMatcher matcher(text);
+        for (size_t b = 0; b < foldedBlocks.size(); ++b)
+        {
+            if (thread->isInterruptionRequested())
+                return;
+
+            const QString& block = foldedBlocks[b];
+            int from = 0;
+            for (;;)
+            {
+                const int index = matcher.indexIn(block, from);
+                if (index < 0)
+                    break;
+                matches.push_back({ blockPositions[b] + index, text.size() });
+                from = index + text.size();
+            }
+        }
+        count = int(matches.size());
+    }
+
+    // Finds and replaces the matches of the large file. The text is
+    // decoded in chunks that end at a line feed.
+    void matchLargeFile(QThread* thread)
+    {
+        const QStringMatcher matcher(text);
+        const QByteArray replacementBytes = replacement.toUtf8();
+        std::vector<PieceTable::Edit> edits;
+
+        qint64 pos = 0;
+        while (pos < largeFile.size())
+        {
+            if (thread->isInterruptionRequested())
+                return;
+
+            QByteArray bytes = largeFile.read(pos, CHUNK_SIZE);
+            if (pos + bytes.size() < largeFile.size())
+            {
+                int end = bytes.lastIndexOf('\n') + 1;
+                if (end == 0)
+                {
+                    // A very long line, end at a character boundary.
+                    end = bytes.size();
+                    while (end > 0 && (uchar(bytes[end - 1]) & 0xC0) == 0x80)
+                        --end;
+                    if (end > 0 && uchar(bytes[end - 1]) >= 0xC0)
+                        --end;
+                    if (end == 0)
+                        end = bytes.size();
+                }
+                bytes.truncate(end);
+            }
+
+            const QString chunk  = QString::fromUtf8(bytes);
+            const QString folded = kana_conversion::fold(chunk);
+
+            int from = 0;
+            qint64 bytePos = pos;
+            for (;;)
+            {
+                const int index = matcher.indexIn(folded, from);
+                if (index < 0)
+                    break;
+
+                bytePos += utf8Length(chunk.constData() + from,
+                                      index - from);
+                const qint64 byteLength =
+                    utf8Length(chunk.constData() + index, text.size());
+                edits.push_back({ bytePos, byteLength, replacementBytes });
+
+                bytePos += byteLength;
+                from = index + text.size();
+            }
+
+            pos += bytes.size();
+        }
+
+        largeFile.replace(edits);
+        count = int(edits.size());
+    }
+
+    std::vector<QString> foldedBlocks;
+    std::vector<int> blockPositions;
+    PieceTable largeFile;
+    bool isLargeFile = false;
+
+    QString text;        // folded text to find
+    QString replacement;
+
+    std::vector<Match> matches;
+    int count = 0;
+};
+
+/* ---------------------------------------------------------------- *
+   Constructs the replacer of the folded document blocks.
+ * ---------------------------------------------------------------- */
+TextReplacer::TextReplacer(const std::vector<QString>& foldedBlocks,
+                           const std::vector<int>& blockPositions,
+                           const QString& text,
+                           QObject* parent)
+    : QThread(parent)
+    , impl(std::make_shared<Impl>())
+{
+    impl->foldedBlocks   = foldedBlocks;
+    impl->blockPositions = blockPositions;
+    impl->text           = kana_conversion::fold(text);
+}
+
+/* ---------------------------------------------------------------- *
+   Constructs the replacer of the large file text.
+ * ---------------------------------------------------------------- */
+TextReplacer::TextReplacer(const PieceTable& largeFile,
+                           const QString& text,
+                           const QString& replacement,
+                           QObject* parent)
+    : QThread(parent)
+    , impl(std::make_shared<Impl>())
+{
+    impl->largeFile   = largeFile;
+    impl->isLargeFile = true;
+    impl->text        = kana_conversion::fold(text);
+    impl->replacement = replacement;
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the count of matches.
+ * ---------------------------------------------------------------- */
+int TextReplacer::matchCount() const
+{ return impl->count; }
+
+/* ---------------------------------------------------------------- *
+   Returns the matches of the document.
+ * ---------------------------------------------------------------- */
+const std::vector<TextReplacer::Match>& TextReplacer::matches() const
+{ return impl->matches; }
+
+/* ---------------------------------------------------------------- *
+   Returns the large file with the matches replaced.
+ * ---------------------------------------------------------------- */
+PieceTable TextReplacer::replacedLargeFile() const
+{ return impl->largeFile; }
+
+/* ---------------------------------------------------------------- *
+   Stops matching and waits for the thread to finish. The copy of
+   the large file is released so that it does not keep the file
+   mapped.
+ * ---------------------------------------------------------------- */
+void TextReplacer::cancel()
+{
+    requestInterruption();
+    wait();
+    impl->largeFile = PieceTable();
+}
+
+/* ---------------------------------------------------------------- *
+   Finds the matches.
+ * ---------------------------------------------------------------- */
+void TextReplacer::run()
+{
+    if (impl->text.isEmpty())
+        return;
+
+    if (impl->isLargeFile)
+        impl->matchLargeFile(this);
+    else
+        impl->matchBlocks(this);
+}
+
+} // namespace jpad
+} // namespace kuu
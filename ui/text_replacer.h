@@ -0,0 +1,73 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::jpad::TextReplacer class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <QtCore/QThread>
+#include "piece_table.h"
+
+namespace kuu
+{
+namespace jpad
+{
+
+/* ---------------------------------------------------------------- *
+   Finds the matches of replace-all in a worker thread. The text is
+   matched kana and width insensitively.
+
+   A document is given as the folded texts of its blocks and the
+   matches are returned as document positions for the editor to
+   replace. A large file is given as a piece table and the matches
+   are replaced into a copy of it.
+ * ---------------------------------------------------------------- */
+class TextReplacer : public QThread
+{
+    Q_OBJECT
+
+public:
+    // Defines a match in the document.
+    struct Match
+    {
+        int position;
+        int length;
+    };
+
+    // Constructs the replacer of the folded document blocks. The
+    // block positions are the document positions of the blocks.
+    TextReplacer(const std::vector<QString>& foldedBlocks,
+                 const std::vector<int>& blockPositions,
+                 const QString& text,
+                 QObject* parent = nullptr);
+    // Constructs the replacer of the large file text.
+    TextReplacer(const PieceTable& largeFile,
+                 const QString& text,
+                 const QString& replacement,
+                 QObject* parent = nullptr);
+
+    // Returns the count of matches.
+    int matchCount() const;
+    // Returns the matches of the document in ascending order.
+    const std::vector<Match>& matches() const;
+    // Returns the large file with the matches replaced.
+    PieceTable replacedLargeFile() const;
+
+    // Stops matching and waits for the thread to finish. The copy of
+    // the large file is released.
+    void cancel();
+
+protected:
+    void run() override;
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace jpad
+} // namespace kuu
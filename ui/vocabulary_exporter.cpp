@@ -0,0 +1,340 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The implementation of kuu::jpad::VocabularyExporter class.
+ * ---------------------------------------------------------------- */
+
+#include "vocabulary_exporter.h"
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <QtCore/QHash>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStringList>
+
+namespace kuu
+{
+namespace jpad
+{
+namespace
+{
+
+/* ---------------------------------------------------------------- *
+   Definitions
+ * ---------------------------------------------------------------- */
+// Character count of the document text that is tokenized at once.
+const int CHUNK_CHARACTERS = 256 * 1024;
+// Size of the large file text that is decoded at once.
+const qint64 CHUNK_SIZE = 1024 * 1024;
+
+// A word of the vocabulary.
+struct Word
+{
+    qint64 count = 0;
+    std::vector<qint32> entries;
+};
+using Words = QHash<QString, Word>;
+
+/* ---------------------------------------------------------------- *
+   Counts the dictionary words of the text. The text is tokenized
+   at once so that an attached dictionary serves it with one
+   request. The entries are kept from the first occurrence of the
+   word.
+ * ---------------------------------------------------------------- */
+void countWords(const QString& text, const JMdict& dict, Words& words)
+{
+    for (JMdict::Token& token : dict.tokenize(text, true))
+    {
+        const QString word = QString::fromRawData(
+            text.constData() + token.position, token.length);
+        auto it = words.find(word);
+        if (it == words.end())
+        {
+            it = words.insert(QString(word.constData(), token.length),
+                              Word());
+            it->entries.swap(token.entries);
+        }
+        ++it->count;
+    }
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the space separated priorities of the kanji and reading
+   forms of the entries that equal the word.
+ * ---------------------------------------------------------------- */
+QString frequencyTags(const JMdict& dict, const QString& word,
+                      const std::vector<qint32>& entries)
+{
+    QStringList tags;
+    auto addTags = [&](const std::vector<QString>& priorities)
+    {
+        for (const QString& priority : priorities)
+            if (!tags.contains(priority))
+                tags << priority;
+    };
+
+    for (const qint32 index : entries)
+    {
+        const JMdict::EntryPtr entry = dict.entry(index);
+        const JMdict::Entry& e = *entry;
+        for (const JMdict::Kanji& kanji : e.kanjis)
+            if (kanji.wordOrPhrase == word)
+                addTags(kanji.priorities);
+        for (const JMdict::Reading& reading : e.readings)
+            if (reading.wordOrPhrase == word)
+                addTags(reading.priorities);
+    }
+    return tags.join(' ');
+}
+
+/* ---------------------------------------------------------------- *
+   Returns the field quoted for CSV or cleaned for TSV.
+ * ---------------------------------------------------------------- */
+QString field(QString text, bool csv)
+{
+    if (!csv)
+    {
+        text.replace('\t', ' ');
+        text.replace('\n', ' ');
+        return text;
+    }
+
+    if (text.contains(',') || text.contains('"') || text.contains('\n'))
+    {
+        text.replace("\"", "\"\"");
+        text = "\"" + text + "\"";
+    }
+    return text;
+}
+
+} // anonymous namespace
+
+/* ---------------------------------------------------------------- *
+   Private data of the vocabulary exporter.
+ * ---------------------------------------------------------------- */
+struct VocabularyExporter::Impl
+{
+    // Reads the next chunk of text. Returns false at the end of the
+    // text. The blocks are joined into chunks of about the same
+    // size. The large file is decoded in chunks that end at a line
+    // feed.
+    bool nextChunk(QString& chunk)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        chunk.clear();
+
+        if (!isLargeFile)
+        {
+            while (nextBlock < blocks.size() &&
+                   chunk.size() < CHUNK_CHARACTERS)
+            {
+                chunk += blocks[nextBlock++];
+                chunk += QLatin1Char('\n');
+            }
+            return !chunk.isEmpty();
+        }
+
+        if (nextPos >= largeFile.size())
+            return false;
+
+        QByteArray bytes = largeFile.read(nextPos, CHUNK_SIZE);
+        if (nextPos + bytes.size() < largeFile.size())
+        {
+            int end = bytes.lastIndexOf('\n') + 1;
+            if (end == 0)
+            {
+                // A very long line, end at a character boundary.
+                end = bytes.size();
+                while (end > 0 && (uchar(bytes[end - 1]) & 0xC0) == 0x80)
+                    --end;
+                if (end > 0 && uchar(bytes[end - 1]) >= 0xC0)
+                    --end;
+                if (end == 0)
+                    end = bytes.size();
+            }
+            bytes.truncate(end);
+        }
+        nextPos += bytes.size();
+        chunk = QString::fromUtf8(bytes);
+        return true;
+    }
+
+    // Counts the words of the chunks until the text ends.
+    void countChunks(QThread* thread, Words& words)
+    {
+        const JMdict& dict = *dictionary;
+        QString chunk;
+        while (!thread->isInterruptionRequested() && nextChunk(chunk))
+            countWords(chunk, dict, words);
+    }
+
+    // Writes the vocabulary table. Throws std::runtime_error if the
+    // file cannot be written.
+    void write(const Words& words)
+    {
+        const JMdict& dict = *dictionary;
+        const bool csv = filePath.endsWith(".csv", Qt::CaseInsensitive);
+        const QString separator = csv ? "," : "\t";
+
+        // The most frequent words first.
+        std::vector<Words::const_iterator> rows;
+        rows.reserve(size_t(words.size()));
+        for (auto it = words.constBegin(); it != words.constEnd(); ++it)
+            rows.push_back(it);
+        std::sort(rows.begin(), rows.end(),
+                  [](const Words::const_iterator& a,
+                     const Words::const_iterator& b)
+        {
+            if (a->count != b->count)
+                return a->count > b->count;
+            return a.key() < b.key();
+        });
+
+        QSaveFile file(filePath);
+        if (!file.open(QIODevice::WriteOnly))
+            throw std::runtime_error(file.errorString().toStdString());
+
+        QStringList header;
+        header << "word" << "reading" << "count" << "frequency"
+               << "meaning";
+        QString text = QString(QChar(0xFEFF)) + header.join(separator) + "\n";
+
+        for (const Words::const_iterator& row : rows)
+        {
+            const JMdict::EntryPtr entry =
+                dict.entry(row->entries.front());
+            const JMdict::Entry& e = *entry;
+
+            QStringList readings;
+            for (const JMdict::Reading& reading : e.readings)
+                readings << reading.wordOrPhrase;
+            QStringList glosses;
+            if (!e.senses.empty())
+                for (const QString& gloss : e.senses.front().glosses)
+                    glosses << gloss;
+
+            QStringList fields;
+            fields << field(row.key(), csv)
+                   << field(readings.join(QString::fromUtf8("、")), csv)
+                   << QString::number(row->count)
+                   << field(frequencyTags(dict, row.key(), row->entries), csv)
+                   << field(glosses.join("; "), csv);
+            text += fields.join(separator) + "\n";
+
+            if (text.size() >= CHUNK_CHARACTERS)
+            {
+                file.write(text.toUtf8());
+                text.clear();
+            }
+        }
+        file.write(text.toUtf8());
+
+        if (!file.commit())
+            throw std::runtime_error(file.errorString().toStdString());
+    }
+
+    JMdictPtr dictionary;
+    QString filePath;
+
+    std::vector<QString> blocks;
+    PieceTable largeFile;
+    bool isLargeFile = false;
+
+    std::mutex mutex;
+    size_t nextBlock = 0;
+    qint64 nextPos = 0;
+};
+
+/* ---------------------------------------------------------------- *
+   Constructs the exporter of the document blocks.
+ * ---------------------------------------------------------------- */
+VocabularyExporter::VocabularyExporter(JMdictPtr dictionary,
+                                       const std::vector<QString>& blocks,
+                                       const QString& filePath,
+                                       QObject* parent)
+    : QThread(parent)
+    , impl(std::make_shared<Impl>())
+{
+    impl->dictionary = dictionary;
+    impl->blocks     = blocks;
+    impl->filePath   = filePath;
+}
+
+/* ---------------------------------------------------------------- *
+   Constructs the exporter of the large file text.
+ * ---------------------------------------------------------------- */
+VocabularyExporter::VocabularyExporter(JMdictPtr dictionary,
+                                       const PieceTable& largeFile,
+                                       const QString& filePath,
+                                       QObject* parent)
+    : QThread(parent)
+    , impl(std::make_shared<Impl>())
+{
+    impl->dictionary  = dictionary;
+    impl->largeFile   = largeFile;
+    impl->isLargeFile = true;
+    impl->filePath    = filePath;
+}
+
+/* ---------------------------------------------------------------- *
+   Stops exporting and waits for the thread to finish.
+ * ---------------------------------------------------------------- */
+void VocabularyExporter::cancel()
+{
+    requestInterruption();
+    wait();
+}
+
+/* ---------------------------------------------------------------- *
+   Counts the words in parallel and writes the table. The words of
+   each thread are merged into the words of this thread.
+ * ---------------------------------------------------------------- */
+void VocabularyExporter::run()
+{
+    if (!impl->dictionary)
+    {
+        emit failed("The dictionary has not been loaded.");
+        return;
+    }
+
+    const int threadCount = std::max(1, QThread::idealThreadCount());
+    std::vector<Words> words(size_t(threadCount));
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threadCount; ++i)
+        threads.push_back(std::thread(&Impl::countChunks, impl.get(),
+                                      this, std::ref(words[size_t(i)])));
+    impl->countChunks(this, words[0]);
+    for (std::thread& thread : threads)
+        thread.join();
+
+    if (isInterruptionRequested())
+        return;
+
+    Words& merged = words[0];
+    for (size_t i = 1; i < words.size(); ++i)
+    {
+        for (auto it = words[i].begin(); it != words[i].end(); ++it)
+        {
+            Word& word = merged[it.key()];
+            if (word.entries.empty())
+                word.entries.swap(it->entries);
+            word.count += it->count;
+        }
+        words[i].clear();
+    }
+
+    try
+    {
+        impl->write(merged);
+        emit exported(merged.size());
+    }
+    catch (const std::runtime_error& ex)
+    {
+        emit failed(QString::fromStdString(ex.what()));
+    }
+}
+
+} // namespace jpad
+} // namespace kuu
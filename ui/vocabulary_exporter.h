@@ -0,0 +1,66 @@
+/* ---------------------------------------------------------------- *
+   Copyright (c) 2018 Kuu
+   Antti Jumpponen <kuumies@gmail.com>
+
+   The definition of kuu::jpad::VocabularyExporter class.
+ * ---------------------------------------------------------------- */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <QtCore/QThread>
+#include "../jmdict/jmdict.h"
+#include "piece_table.h"
+
+namespace kuu
+{
+namespace jpad
+{
+
+/* ---------------------------------------------------------------- *
+   Exports the vocabulary of a document into a CSV or a TSV file in
+   a worker thread.
+
+   The text is split into chunks that are tokenized in parallel
+   against the word indexes of the dictionary. Each thread counts
+   the words into its own hash map and the maps are merged at the
+   end. The table lists the words by descending count with the
+   readings, the frequency tags and the first meaning of the word.
+   A file with .csv suffix is written as CSV, otherwise as TSV.
+ * ---------------------------------------------------------------- */
+class VocabularyExporter : public QThread
+{
+    Q_OBJECT
+
+public:
+    // Constructs the exporter of the document blocks.
+    VocabularyExporter(JMdictPtr dictionary,
+                       const std::vector<QString>& blocks,
+                       const QString& filePath,
+                       QObject* parent = nullptr);
+    // Constructs the exporter of the large file text.
+    VocabularyExporter(JMdictPtr dictionary,
+                       const PieceTable& largeFile,
+                       const QString& filePath,
+                       QObject* parent = nullptr);
+
+    // Stops exporting and waits for the thread to finish.
+    void cancel();
+
+signals:
+    // The vocabulary has been exported.
+    void exported(int wordCount);
+    // Exporting has failed.
+    void failed(const QString& error);
+
+protected:
+    void run() override;
+
+private:
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+} // namespace jpad
+} // namespace kuu